@@ -0,0 +1,78 @@
+/**
+ * File: ContentHash.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: 64-bit hash of the content of a vocabulary
+ */
+
+#include "ContentHash.h"
+
+#include <string>
+#include <cstring>
+using namespace std;
+
+using namespace DBow;
+
+// FNV-1a 64-bit parameters
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+ContentHash::ContentHash(void): m_hash(FNV_OFFSET_BASIS)
+{
+}
+
+ContentHash::~ContentHash(void)
+{
+}
+
+ContentHash& ContentHash::operator<<(int v)
+{
+	add((unsigned int)v);
+	return *this;
+}
+
+ContentHash& ContentHash::operator<<(unsigned int v)
+{
+	add(v);
+	return *this;
+}
+
+ContentHash& ContentHash::operator<<(float v)
+{
+	unsigned int bits;
+	memcpy(&bits, &v, sizeof(bits));
+	add(bits);
+	return *this;
+}
+
+ContentHash& ContentHash::operator<<(double v)
+{
+	unsigned long long bits;
+	memcpy(&bits, &v, sizeof(bits));
+	add((unsigned int)(bits & 0xffffffffULL));
+	add((unsigned int)(bits >> 32));
+	return *this;
+}
+
+string ContentHash::toString() const
+{
+	const char *digits = "0123456789abcdef";
+	string s(16, '0');
+
+	unsigned long long h = m_hash;
+	for(int i = 15; i >= 0; i--){
+		s[i] = digits[h & 0xf];
+		h >>= 4;
+	}
+	return s;
+}
+
+void ContentHash::add(unsigned int v)
+{
+	for(int i = 0; i < 4; i++){
+		m_hash ^= (v & 0xff);
+		m_hash *= FNV_PRIME;
+		v >>= 8;
+	}
+}
+
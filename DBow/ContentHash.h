@@ -0,0 +1,70 @@
+/**
+ * File: ContentHash.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: 64-bit hash of the content of a vocabulary
+ *
+ * Note: values are hashed by their numeric value, not by their bytes in
+ *   memory, so that the same content gives the same hash in any machine.
+ *   The hash is FNV-1a. It identifies a vocabulary, but it is not meant
+ *   to resist forged contents.
+ */
+
+#pragma once
+#ifndef __D_CONTENT_HASH__
+#define __D_CONTENT_HASH__
+
+#include <string>
+using namespace std;
+
+namespace DBow {
+
+	class ContentHash
+	{
+	public:
+
+		/**
+		 * Starts a hash with no content
+		 */
+		ContentHash(void);
+
+		/**
+		 * Destructor
+		 */
+		~ContentHash(void);
+
+		/**
+		 * Adds a value to the hash
+		 * @param v
+		 * @return this hash
+		 */
+		ContentHash& operator<<(int v);
+		ContentHash& operator<<(unsigned int v);
+		ContentHash& operator<<(float v);
+		ContentHash& operator<<(double v);
+
+		/**
+		 * Returns the hash of the content added so far
+		 * @return hash as 16 hexadecimal digits
+		 */
+		string toString() const;
+
+	protected:
+
+		/**
+		 * Adds 32 bits to the hash, least significant byte first
+		 * @param v
+		 */
+		void add(unsigned int v);
+
+	protected:
+
+		// Current value of the hash
+		unsigned long long m_hash;
+
+	};
+
+}
+
+#endif
+
@@ -7,12 +7,25 @@
 
 #include "DatabaseTypes.h"
 #include "Database.h"
+#include "ShardedDatabase.h"
 #include "BowVector.h"
+#include "ContentHash.h"
 #include "DbInfo.h"
+#include "DescriptorFile.h"
+#include "DescriptorView.h"
+#include "EntryLog.h"
+#include "FeatureVector.h"
 #include "Vocabulary.h"
 #include "HVocabulary.h"
 #include "HVocParams.h"
 #include "QueryResults.h"
+#include "QueryContext.h"
+#include "SharedVocabulary.h"
 #include "VocInfo.h"
 #include "VocParams.h"
 
+#ifndef WIN32
+#include "QueryServer.h"
+#include "QueryClient.h"
+#endif
+
@@ -12,29 +12,93 @@
 #include "DUtils.h"
 
 #include <vector>
+#include <string>
 #include <algorithm>
 #include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <functional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 using namespace std;
 
 using namespace DBow;
 
+// Margin to compare score bounds when pruning queries, to absorb 
+// rounding errors
+#define QUERY_BOUND_MARGIN 1e-9
+
+// Number of entries of the blocks of the rows of the inverted file
+#define IF_BLOCK_SIZE 64
+
+// Number of queries of a batch that share the scan of the rows
+// (at most 32, the bits of the masks of the entries found)
+#define QUERY_BATCH_GROUP 16
+
+// Magic word of binary files that reference a vocabulary file
+#define VOC_REFERENCE_MAGIC '\1'
+
+// Keyword of text files that reference a vocabulary file
+#define VOC_REFERENCE_KEYWORD "vocabulary"
+
+// Maximum length of the name of a referenced vocabulary file
+#define VOC_REFERENCE_MAX_PATH 4096
+
 Database::Database(const Vocabulary &voc) :
-	m_voc(NULL), m_nentries(0)
+	m_voc(createVoc(voc.RetrieveInfo().VocType, &voc)), m_nentries(0), 
+	m_online(false), m_refresh_ratio(0.1), m_weighted_entries(0), 
+	m_tf_available(true), m_direct_enabled(false), m_direct_level(0), 
+	m_rerank_candidates(0), m_log_stale(false)
 {
-	initVoc(voc.RetrieveInfo().VocType, &voc);
 	m_index.resize(0);
 	m_index.resize(voc.NumberOfWords());
 }
 
+Database::Database(const SharedVocabulary &voc) :
+	m_voc(voc), m_nentries(0), m_online(false), m_refresh_ratio(0.1),
+	m_weighted_entries(0), m_tf_available(true), m_direct_enabled(false),
+	m_direct_level(0), m_rerank_candidates(0), m_log_stale(false)
+{
+	if(voc.empty()) throw DUtils::DException("Empty vocabulary handle");
+
+	m_index.resize(0);
+	m_index.resize(voc->NumberOfWords());
+}
+
 Database::Database(const char *filename) :
-	m_voc(NULL), m_nentries(0)
+	m_nentries(0), m_online(false), m_refresh_ratio(0.1),
+	m_weighted_entries(0), m_tf_available(true), m_direct_enabled(false),
+	m_direct_level(0), m_rerank_candidates(0), m_log_stale(false)
 {
 	Load(filename);
 }
 
 Database::~Database(void)
 {
-	delete m_voc;
+}
+
+void Database::swap(Database &db)
+{
+	m_voc.swap(db.m_voc);
+	m_index.swap(db.m_index);
+	std::swap(m_nentries, db.m_nentries);
+	std::swap(m_online, db.m_online);
+	std::swap(m_refresh_ratio, db.m_refresh_ratio);
+	m_online_weights.swap(db.m_online_weights);
+	std::swap(m_weighted_entries, db.m_weighted_entries);
+	std::swap(m_tf_available, db.m_tf_available);
+	std::swap(m_direct_enabled, db.m_direct_enabled);
+	std::swap(m_direct_level, db.m_direct_level);
+	m_direct.word_offsets.swap(db.m_direct.word_offsets);
+	m_direct.words.swap(db.m_direct.words);
+	m_direct.feature_offsets.swap(db.m_direct.feature_offsets);
+	m_direct.features.swap(db.m_direct.features);
+	std::swap(m_rerank_candidates, db.m_rerank_candidates);
+	m_log.swap(db.m_log);
+	std::swap(m_log_stale, db.m_log_stale);
 }
 
 DbInfo Database::RetrieveInfo() const
@@ -44,8 +108,41 @@ DbInfo Database::RetrieveInfo() const
 	return ret;
 }
 
-EntryId Database::_AddEntry(BowVector &v)
+EntryId Database::AddEntry(const DescriptorView &features)
+{
+	BowVector v;
+	vector<WordId> words;
+	vector<float> tf;
+
+	if(m_direct_enabled && m_direct_level > 0){
+		FeatureVector fv;
+		static_cast<const HVocabulary*>(m_voc.get())->Transform(features, v, words, 
+			fv, m_direct_level, false);
+		GetTermFrequencies(v, words, tf);
+		return _AddEntry(v, tf, &fv);
+
+	}else{
+		m_voc->Transform(features, v, words, false);
+		GetTermFrequencies(v, words, tf);
+		return _AddEntry(v, tf);
+	}
+}
+
+EntryId Database::_AddEntry(BowVector &v, const vector<float> &tf,
+	const FeatureVector *fv)
 {
+	assert(tf.size() == v.size());
+
+	if(m_log.isOpen() && !m_log_stale){
+		m_log.Append(m_nentries, v, tf, fv);
+	}
+
+	if(m_online && !m_online_weights.empty()){
+		// use the weights computed from the entries
+		for(unsigned int i = 0; i < v.size(); i++)
+			v[i].value = WeightedValue(tf[i], m_online_weights[v[i].id]);
+	}
+
 	VocParams::ScoringType norm;
 	if(VocParams::MustNormalize(m_voc->Scoring(), norm)){
 		// vectors are stored normalized if needed
@@ -58,245 +155,1065 @@ EntryId Database::_AddEntry(BowVector &v)
 	BowVector::const_iterator it;
 	for(it = v.begin(); it != v.end(); it++){
 		// eids are in ascending order in the index
-		m_index[it->id].push_back(IFEntry(eid, it->value));
+		m_index[it->id].Append(IFEntry(eid, it->value, tf[it - v.begin()]));
+	}
+
+	if(m_direct_enabled){
+		// update direct file
+		const unsigned int first = m_direct.words.size();
+		m_direct.words.insert(m_direct.words.end(), v.begin(), v.end());
+		sort(m_direct.words.begin() + first, m_direct.words.end());
+		m_direct.word_offsets.push_back(m_direct.words.size());
+
+		if(fv){
+			FeatureVector::const_iterator fit;
+			vector<unsigned int>::const_iterator iit;
+			for(fit = fv->begin(); fit != fv->end(); fit++){
+				for(iit = fit->second.begin(); iit != fit->second.end(); iit++){
+					m_direct.features.push_back(make_pair(fit->first, *iit));
+				}
+			}
+		}
+		m_direct.feature_offsets.push_back(m_direct.features.size());
 	}
 
 	m_nentries++;
 
+	if(m_online && m_nentries > m_weighted_entries * (1. + m_refresh_ratio))
+		RefreshWeights();
+
 	return eid;
 }
 
+void Database::GetTermFrequencies(const BowVector &v, 
+	vector<WordId> &words, vector<float> &tf) const
+{
+	// as in Vocabulary::ComputeBowVector, tf = n_id / n_d, where n_d is 
+	// the number of different words in the document, including stopped ones
+	sort(words.begin(), words.end());
+
+	double nd = 0;
+	for(unsigned int i = 0; i < words.size(); i++)
+		if(i == 0 || words[i] != words[i-1]) nd++;
+	
+	tf.resize(v.size());
+
+	for(unsigned int i = 0; i < v.size(); i++){
+		pair<vector<WordId>::const_iterator, vector<WordId>::const_iterator> r =
+			equal_range(words.begin(), words.end(), v[i].id);
+		tf[i] = (float)((r.second - r.first) / nd);
+	}
+}
+
+void Database::RecoverTermFrequencies(const BowVector &v, 
+	vector<float> &tf) const
+{
+	tf.resize(v.size());
+
+	for(unsigned int i = 0; i < v.size(); i++){
+		WordValue weight = m_voc->WordWeight(v[i].id);
+		tf[i] = (weight > 0 ? (float)(v[i].value / weight) : 0.f);
+	}
+}
+
+void Database::SetOnlineWeighting(bool enable, double refresh_ratio)
+{
+	if(enable && !m_tf_available)
+		throw DUtils::DException("Entries cannot be weighted again");
+
+	m_online = enable;
+	m_refresh_ratio = refresh_ratio;
+
+	// without tf, entries have never been weighted online, so that they
+	// already have the weights of the vocabulary
+	if(m_tf_available) RefreshWeights();
+	else m_online_weights.clear();
+
+	invalidateLog();
+}
+
+void Database::RefreshWeights()
+{
+	if(!m_tf_available)
+		throw DUtils::DException("Entries cannot be weighted again");
+
+	const int nwords = m_index.size();
+	vector<WordValue> weights(nwords);
+
+	const VocParams::WeightingType weighting = m_voc->Weighting();
+
+	if(m_online && 
+		(weighting == VocParams::IDF || weighting == VocParams::TF_IDF))
+	{
+		// idf = ln(N/Ni), with the entries of the database
+		// (words with no entries get the idf they would have with one)
+		for(int i = 0; i < nwords; i++){
+			const double Ni = max((size_t)1, m_index[i].size());
+			weights[i] = (m_nentries > 0 ? log((double)m_nentries / Ni) : 0);
+		}
+	}else{
+		for(int i = 0; i < nwords; i++){
+			weights[i] = m_voc->WordWeight(i);
+		}
+	}
+
+	// weight the entries and normalize them again if necessary
+	InvertedFile::iterator it;
+	IFRow::iterator rit;
+
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		const WordValue weight = weights[it - m_index.begin()];
+
+		for(rit = it->begin(); rit != it->end(); rit++){
+			rit->value = WeightedValue(rit->tf, weight);
+		}
+	}
+
+	normalizeEntries(vector<bool>(m_nentries, true));
+
+	if(m_online)
+		m_online_weights = weights;
+	else
+		m_online_weights.clear();
+
+	m_weighted_entries = m_nentries;
+
+	UpdateBlocks();
+
+	if(m_direct_enabled) BuildDirectIndex();
+}
+
+void Database::normalizeEntries(const vector<bool> &entries)
+{
+	VocParams::ScoringType norm = VocParams::L1_NORM;
+	if(!VocParams::MustNormalize(m_voc->Scoring(), norm)) return;
+
+	vector<double> norms(m_nentries, 0);
+	InvertedFile::iterator it;
+	IFRow::iterator rit;
+
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(rit = it->begin(); rit != it->end(); rit++){
+			if(!entries[rit->id]) continue;
+
+			if(norm == VocParams::L1_NORM)
+				norms[rit->id] += fabs(rit->value);
+			else
+				norms[rit->id] += rit->value * rit->value;
+		}
+	}
+
+	if(norm == VocParams::L2_NORM){
+		for(unsigned int i = 0; i < norms.size(); i++) 
+			norms[i] = sqrt(norms[i]);
+	}
+
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(rit = it->begin(); rit != it->end(); rit++){
+			if(entries[rit->id] && norms[rit->id] > 0) 
+				rit->value /= norms[rit->id];
+		}
+	}
+}
+
+void Database::SetDirectIndex(bool enable, int level)
+{
+	if(enable && level > 0 && 
+		m_voc->RetrieveInfo().VocType != VocParams::HIERARCHICAL_VOC)
+		throw DUtils::DException("Features can only be grouped by the nodes "
+			"of a hierarchical vocabulary");
+
+	m_direct_enabled = enable;
+	m_direct_level = (enable ? level : 0);
+	invalidateLog();
+
+	if(!enable) m_rerank_candidates = 0;
+
+	m_direct.features.clear();
+	m_direct.feature_offsets.clear();
+
+	if(enable){
+		BuildDirectIndex();
+		m_direct.feature_offsets.resize(m_nentries + 1, 0);
+	}else{
+		m_direct.words.clear();
+		m_direct.word_offsets.clear();
+	}
+}
+
+void Database::SetReranking(int candidates)
+{
+	if(candidates > 0 && !m_direct_enabled)
+		throw DUtils::DException("Reranking needs the direct index");
+
+	m_rerank_candidates = max(candidates, 0);
+}
+
+void Database::BuildDirectIndex()
+{
+	vector<unsigned int> &offsets = m_direct.word_offsets;
+	offsets.resize(0);
+	offsets.resize(m_nentries + 1, 0);
+
+	// count the words of each entry
+	InvertedFile::const_iterator it;
+	IFRow::const_iterator rit;
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(rit = it->begin(); rit != it->end(); rit++){
+			offsets[rit->id + 1]++;
+		}
+	}
+
+	for(unsigned int i = 1; i < offsets.size(); i++) 
+		offsets[i] += offsets[i-1];
+
+	// words are visited in ascending order
+	m_direct.words.resize(offsets.back());
+	vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		const WordId wid = it - m_index.begin();
+		for(rit = it->begin(); rit != it->end(); rit++){
+			m_direct.words[ next[rit->id]++ ] = BowVectorEntry(wid, rit->value);
+		}
+	}
+}
+
+void Database::RetrieveBowVector(EntryId id, BowVector &v) const
+{
+	if(!m_direct_enabled) 
+		throw DUtils::DException("The direct index is not enabled");
+	if(id >= m_nentries) 
+		throw DUtils::DException("Entry id out of range");
+
+	v.assign(m_direct.words.begin() + m_direct.word_offsets[id], 
+		m_direct.words.begin() + m_direct.word_offsets[id+1]);
+}
+
+void Database::RetrieveFeatureVector(EntryId id, FeatureVector &fv) const
+{
+	if(!m_direct_enabled) 
+		throw DUtils::DException("The direct index is not enabled");
+	if(id >= m_nentries) 
+		throw DUtils::DException("Entry id out of range");
+
+	fv.clear();
+
+	const unsigned int last = m_direct.feature_offsets[id+1];
+	for(unsigned int i = m_direct.feature_offsets[id]; i < last; i++){
+		fv.AddFeature(m_direct.features[i].first, m_direct.features[i].second);
+	}
+}
+
+void Database::UpdateBlocks()
+{
+	InvertedFile::iterator it;
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		it->UpdateBlocks();
+	}
+}
+
+void Database::IFRow::Append(const IFEntry &e)
+{
+	if(size() % IF_BLOCK_SIZE == 0){
+		IFBlock block;
+		block.first_id = e.id;
+		block.max_value = e.value;
+		blocks.push_back(block);
+	}else if(e.value > blocks.back().max_value){
+		blocks.back().max_value = e.value;
+	}
+	
+	blocks.back().last_id = e.id;
+	push_back(e);
+}
+
+void Database::IFRow::UpdateBlocks()
+{
+	blocks.resize((size() + IF_BLOCK_SIZE - 1) / IF_BLOCK_SIZE);
+
+	for(unsigned int b = 0; b < blocks.size(); b++){
+		const unsigned int first = b * IF_BLOCK_SIZE;
+		const unsigned int last = min(first + IF_BLOCK_SIZE, (unsigned int)size());
+		
+		IFBlock &block = blocks[b];
+		block.first_id = (*this)[first].id;
+		block.last_id = (*this)[last-1].id;
+		block.max_value = (*this)[first].value;
+
+		for(unsigned int i = first + 1; i < last; i++){
+			if((*this)[i].value > block.max_value) 
+				block.max_value = (*this)[i].value;
+		}
+	}
+}
+
+WordValue Database::IFRow::MaxValue() const
+{
+	WordValue max_value = 0;
+	
+	vector<IFBlock>::const_iterator bit;
+	for(bit = blocks.begin(); bit != blocks.end(); bit++){
+		if(bit == blocks.begin() || bit->max_value > max_value)
+			max_value = bit->max_value;
+	}
+	return max_value;
+}
+
 
 void Database::Clear()
 {
 	m_index.resize(0);
 	m_index.resize(m_voc->NumberOfWords());
 	m_nentries = 0;
+	m_online_weights.clear();
+	m_weighted_entries = 0;
+	m_tf_available = true;
+
+	if(m_direct_enabled) SetDirectIndex(true, m_direct_level);
+	invalidateLog();
 }
 
-void 
-Database::_Query(QueryResults &ret, BowVector &v, int max_results) const
+int Database::SplitWords(const vector<DescriptorView> &documents, 
+	float max_frequency)
 {
-	// This implementation is independent from that in Vocabulary::Score
+	if(m_voc->RetrieveInfo().VocType != VocParams::HIERARCHICAL_VOC)
+		throw DUtils::DException("This vocabulary cannot be adapted");
+
+	// the vocabulary may be shared with other databases, so that the 
+	// split is done in a copy
+	HVocabulary *voc = static_cast<HVocabulary*>(createVoc(
+		VocParams::HIERARCHICAL_VOC, m_voc.get()));
+	SharedVocabulary copy(voc);
+
+	map<WordId, vector<WordId> > splits;
+	int n = voc->SplitWords(documents, max_frequency, splits);
+
+	m_voc = copy;
+	RemapWords(splits);
+
+	return n;
+}
+
+void Database::RemapWords(const map<WordId, vector<WordId> > &splits)
+{
+	invalidateLog();
+
+	m_index.resize(m_voc->NumberOfWords());
+
+	// the features of the entries are not stored, so that the entries of
+	// a split word are shared among the new words in the proportion of 
+	// the features of the split word that each one received
+	vector<bool> affected(m_nentries, false);
+
+	map<WordId, vector<WordId> >::const_iterator sit;
+	for(sit = splits.begin(); sit != splits.end(); sit++){
+		const vector<WordId> &words = sit->second;
+
+		vector<double> share(words.size());
+		double total = 0;
+		for(unsigned int i = 0; i < words.size(); i++){
+			share[i] = m_voc->WordFrequency(words[i]);
+			total += share[i];
+		}
+		for(unsigned int i = 0; i < words.size(); i++){
+			share[i] = (total > 0 ? share[i] / total : 1. / words.size());
+		}
+
+		IFRow row;
+		row.swap(m_index[sit->first]);
+
+		for(unsigned int i = 0; i < words.size(); i++){
+			IFRow &new_row = m_index[words[i]];
+			new_row.clear();
+			new_row.reserve(row.size());
+
+			IFRow::const_iterator rit;
+			for(rit = row.begin(); rit != row.end(); rit++){
+				new_row.push_back(IFEntry(rit->id, rit->value * share[i], 
+					(float)(rit->tf * share[i])));
+				affected[rit->id] = true;
+			}
+		}
+	}
+
+	if(m_tf_available){
+		// the entries are weighted again with the weights of the new words
+		RefreshWeights();
+	}else{
+		normalizeEntries(affected);
+		UpdateBlocks();
+		if(m_direct_enabled) BuildDirectIndex();
+	}
+}
+
+// Contributions of a word to the similarity between a query and an entry
+// (the higher the better). Value is used when both have the word, and 
+// Missing when only the query has it
+namespace {
+
+	struct L1Contribution {
+		static inline double Value(WordValue q, WordValue d){
+			return fabs(q) + fabs(d) - fabs(q - d);
+		}
+		static inline double Missing(WordValue){ return 0; }
+	};
+
+	struct L2Contribution {
+		static inline double Value(WordValue q, WordValue d){
+			return q * d;
+		}
+		static inline double Missing(WordValue){ return 0; }
+	};
+
+	struct ChiSquareContribution {
+		static inline double Value(WordValue q, WordValue d){
+			// words with null weight have q = d = 0
+			return (q + d > 0 ? q + d - (q - d)*(q - d)/(q + d) : 0);
+		}
+		static inline double Missing(WordValue){ return 0; }
+	};
+
+	struct BhattacharyyaContribution {
+		static inline double Value(WordValue q, WordValue d){
+			return sqrt(q * d);
+		}
+		static inline double Missing(WordValue){ return 0; }
+	};
+
+	// KL is a divergence, so it is negated
+	struct KLContribution {
+		static inline double Value(WordValue q, WordValue d){
+			return -q * log(q/d);
+		}
+		static inline double Missing(WordValue q){ 
+			return -q * (log(q) - LOG_EPS); 
+		}
+	};
+
+	typedef L2Contribution DotProductContribution;
+
+	// Word of a query of a batch
+	struct QueryWord {
+		WordId id;
+		int query; // index of the query in its group
+		WordValue value;
+
+		QueryWord(WordId _id, int _query, WordValue _value):
+			id(_id), query(_query), value(_value){}
+
+		inline bool operator<(const QueryWord &w) const { 
+			return id < w.id || (id == w.id && query < w.query);
+		}
+	};
+
+	/**
+	 * Returns the k-th highest score of the given results
+	 * @param ret results (at least k)
+	 * @param k
+	 * @param scores vector to use to find the score
+	 * @return k-th highest score
+	 */
+	double KthScore(const QueryResults &ret, int k, vector<double> &scores)
+	{
+		scores.resize(ret.size());
+		for(unsigned int i = 0; i < ret.size(); i++) scores[i] = ret[i].Score;
+		nth_element(scores.begin(), scores.begin() + (k-1), scores.end(),
+			greater<double>());
+		return scores[k-1];
+	}
+
+	/**
+	 * Compares the entry ids of two results
+	 * @return true iif a.Id < b.Id
+	 */
+	bool LessId(const Result &a, const Result &b)
+	{
+		return a.Id < b.Id;
+	}
+
+	/**
+	 * Sorts the results in descending order of score and leaves only
+	 * the best ones
+	 * @param ret results
+	 * @param max_results number of results to leave. If <= 0, all of them
+	 *   are left
+	 */
+	void SortResults(QueryResults &ret, int max_results)
+	{
+		if(max_results > 0 && (int)ret.size() > max_results){
+			partial_sort(ret.begin(), ret.begin() + max_results, ret.end(), 
+				Result::GreaterThan);
+			ret.resize(max_results);
+		}else{
+			sort(ret.begin(), ret.end(), Result::GreaterThan);
+		}
+	}
+
+}
+
+void Database::PrepareQuery(BowVector &v, const vector<float> &tf) const
+{
+	assert(tf.size() == v.size());
+
+	if(m_online && !m_online_weights.empty()){
+		// use the same weights as the entries
+		for(unsigned int i = 0; i < v.size(); i++)
+			v[i].value = WeightedValue(tf[i], m_online_weights[v[i].id]);
+	}
 
 	// check if the vector must be normalized
-	VocInfo info = m_voc->RetrieveInfo();
 	VocParams::ScoringType norm;
-	if(VocParams::MustNormalize(info.Parameters->Scoring, norm)){
+	if(VocParams::MustNormalize(m_voc->Scoring(), norm)){
 		v.Normalize(norm);
 	}
+}
+
+void Database::QueryBatch(const vector<BowVector> &queries, 
+	vector<QueryResults> &ret, int max_results, QueryContext &context) const
+{
+	vector<BowVector> vs(queries);
+	vector<float> tf;
+
+	for(unsigned int i = 0; i < vs.size(); i++){
+		RecoverTermFrequencies(vs[i], tf);
+		PrepareQuery(vs[i], tf);
+		vs[i].PutInOrder();
+	}
 
-	// ret is not in order until the end
+	ret.resize(0);
+	ret.resize(vs.size());
+
+	const VocParams::ScoringType scoring = m_voc->Scoring();
+	const bool rerank = m_rerank_candidates > 0;
+
+	switch(scoring){
+		
+		case VocParams::L1_NORM:
+			doBatchQuery<L1Contribution>(vs, ret, max_results, rerank, 
+				context);
+			break;
+
+		case VocParams::L2_NORM:
+		case VocParams::DOT_PRODUCT:
+			doBatchQuery<DotProductContribution>(vs, ret, max_results, false,
+				context);
+			break;
+
+		case VocParams::CHI_SQUARE:
+			doBatchQuery<ChiSquareContribution>(vs, ret, max_results, rerank,
+				context);
+			break;
+
+		case VocParams::KL:
+			doBatchQuery<KLContribution>(vs, ret, max_results, rerank, 
+				context);
+			break;
+
+		case VocParams::BHATTACHARYYA:
+			doBatchQuery<BhattacharyyaContribution>(vs, ret, max_results, 
+				rerank, context);
+			break;
+	}
+
+	for(unsigned int i = 0; i < ret.size(); i++){
+		CompleteScores(ret[i], scoring, m_voc->ScaleScore());
+	}
+}
+
+void 
+Database::_Query(QueryResults &ret, int max_results, 
+	QueryContext &context) const
+{
+	// This implementation is independent from that in Vocabulary::Score
+
+	BowVector &v = context.m_v;
+	PrepareQuery(v, context.m_tf);
+
+	// the direct index is merged with the query words in order
+	if(m_rerank_candidates > 0) v.PutInOrder();
+
+	// ret is not in order until the end. Its memory is reused
 	ret.resize(0);
 	ret.reserve(100);
 
-	switch(info.Parameters->Scoring){
+	if(context.m_position.size() < m_nentries) 
+		context.m_position.resize(m_nentries, -1);
+
+	const bool scale_score = m_voc->ScaleScore();
+
+	switch(m_voc->Scoring()){
 		
 		case VocParams::L1_NORM:
-			doQueryL1(v, ret, max_results, info.Parameters->ScaleScore);
+			doQueryL1(v, ret, max_results, scale_score, context);
 			break;
 
 		case VocParams::L2_NORM:
-			doQueryL2(v, ret, max_results, info.Parameters->ScaleScore);
+			doQueryL2(v, ret, max_results, scale_score, context);
 			break;
 
 		case VocParams::CHI_SQUARE:
-			doQueryChiSquare(v, ret, max_results, info.Parameters->ScaleScore);
+			doQueryChiSquare(v, ret, max_results, scale_score, context);
 			break;
 
 		case VocParams::KL:
-			doQueryKL(v, ret, max_results, info.Parameters->ScaleScore);
+			doQueryKL(v, ret, max_results, scale_score, context);
 			break;
 
 		case VocParams::BHATTACHARYYA:
-			doQueryBhattacharyya(v, ret, max_results, info.Parameters->ScaleScore);
+			doQueryBhattacharyya(v, ret, max_results, scale_score, context);
 			break;
 
 		case VocParams::DOT_PRODUCT:
-			doQueryDotProduct(v, ret, max_results, info.Parameters->ScaleScore);
+			doQueryDotProduct(v, ret, max_results, scale_score, context);
 			break;
 	}
 }
 
-void Database::doQueryL1(const BowVector &v, QueryResults &ret, 
-						 const int max_results, const bool scale_score) const
+template<class TContribution>
+void Database::doQuery(const BowVector &v, QueryResults &ret, 
+	const int max_results, QueryContext &context) const
 {
-	BowVector::const_iterator it;
+	const bool prune = max_results > 0 && max_results < (int)m_nentries;
+
+	// upper bound of the contribution of each query word, in 
+	// descending order
+	vector<pair<double, int> > &words = context.m_bounds;
+	words.resize(0);
+
+	for(unsigned int i = 0; i < v.size(); i++){
+		words.push_back(make_pair(
+			TContribution::Value(v[i].value, m_index[v[i].id].MaxValue()), i));
+	}
+	sort(words.begin(), words.end(), greater<pair<double, int> >());
+
+	// remaining[j] = maximum score an entry can get from words j..end
+	vector<double> &remaining = context.m_remaining;
+	remaining.resize(0);
+	remaining.resize(words.size() + 1, 0);
+	for(int j = (int)words.size() - 1; j >= 0; j--)
+		remaining[j] = remaining[j+1] + words[j].first;
+
+	// position[eid] = index of entry eid in ret, or -1
+	vector<int> &position = context.m_position;
+	vector<double> &scores = context.m_scores;
+
+	// lower bound of the score of the max_results-th result. It is 
+	// computed again only after visiting as many entries as candidates
+	// there are, so that it does not cost more than the accumulation
+	double threshold = 0;
+	unsigned int visited = 0;
+
+	double best_score = 0;
 	IFRow::const_iterator rit;
-	QueryResults::iterator qit;
-	
-	for(it = v.begin(); it != v.end(); it++){
-		WordId wid = it->id;
-		WordValue qvalue = it->value;
-		
-		const IFRow& row = m_index[wid];
+	unsigned int j = 0;
+
+	// 1st phase: any entry can still get into the top results
+	for(; j < words.size(); j++){
+		if(prune && (int)ret.size() >= max_results && 
+			remaining[j] + QUERY_BOUND_MARGIN < best_score)
+		{
+			if(visited >= ret.size()){
+				threshold = KthScore(ret, max_results, scores);
+				visited = 0;
+			}
+			if(remaining[j] + QUERY_BOUND_MARGIN < threshold) break;
+		}
+
+		const WordValue qvalue = v[words[j].second].value;
+		const IFRow &row = m_index[v[words[j].second].id];
 
 		for(rit = row.begin(); rit != row.end(); rit++){
-			EntryId eid = rit->id;
-			WordValue dvalue = rit->value;
+			const double value = TContribution::Value(qvalue, rit->value);
+			
+			int &pos = position[rit->id];
+			if(pos < 0){
+				pos = ret.size();
+				ret.push_back(Result(rit->id, value));
+			}else{
+				ret[pos].Score += value;
+			}
+			
+			if(ret[pos].Score > best_score) best_score = ret[pos].Score;
+		}
 
-			// scoring-dependent value
-			double value = fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
+		visited += row.size();
+	}
 
-			// check if this entry is already in the returning vector
-			qit = find(ret.begin(), ret.end(), eid);
+	// the positions are not used any more
+	for(unsigned int i = 0; i < ret.size(); i++) position[ret[i].Id] = -1;
 
-			if(qit == ret.end()){
-				// insert
-				ret.push_back(Result(eid, value));
-			}else{
-				// update
-				qit->Score += value; 
+	// 2nd phase: only the current candidates can get into the top results.
+	// They are sorted by id to go through the blocks of the rows
+	visited = ret.size();
+	bool sorted = false;
+
+	for(; j < words.size(); j++){
+		if(visited >= ret.size()){
+			// drop the candidates that cannot reach the top
+			threshold = KthScore(ret, max_results, scores);
+			const double min_score = threshold - remaining[j] - QUERY_BOUND_MARGIN;
+			
+			unsigned int n = 0;
+			for(unsigned int i = 0; i < ret.size(); i++){
+				if(ret[i].Score >= min_score) ret[n++] = ret[i];
 			}
-		} // for each inverted row 
-	} // for each word in features	
+			ret.resize(n);
+			visited = 0;
 
-	// resulting "scores" are now in [-2 best .. 0 worst]
-	
-	// sort vector in ascending order
-	// (scores are inverted now --the lower the better--)
-	sort(ret.begin(), ret.end());
+			if(!sorted){
+				sort(ret.begin(), ret.end(), LessId);
+				sorted = true;
+			}
+		}
 
-	// cut vector
-	if((int)ret.size() > max_results) ret.resize(max_results);
+		const WordValue qvalue = v[words[j].second].value;
+		const IFRow &row = m_index[v[words[j].second].id];
+		const double rest = remaining[j+1] + QUERY_BOUND_MARGIN;
+
+		vector<IFBlock>::const_iterator bit = row.blocks.begin();
+		QueryResults::iterator qit = ret.begin();
+
+		if(ret.size() < row.blocks.size()){
+			// few candidates: look for each of them in the row
+			for(; qit != ret.end(); qit++){
+				// skip the blocks with no candidates
+				while(bit != row.blocks.end() && bit->last_id < qit->Id) bit++;
+				
+				if(bit == row.blocks.end()) break;
+				if(bit->first_id > qit->Id) continue;
+
+				// the candidate may be in this block. Skip it if it cannot reach 
+				// the top even with the max value of the block. Its score is
+				// not complete then, but it is left below the threshold
+				if(qit->Score + TContribution::Value(qvalue, bit->max_value) + rest
+					< threshold) continue;
+
+				IFRow::const_iterator first = 
+					row.begin() + (bit - row.blocks.begin()) * IF_BLOCK_SIZE;
+				IFRow::const_iterator last = 
+					(row.end() - first > IF_BLOCK_SIZE ? first + IF_BLOCK_SIZE : row.end());
+
+				rit = lower_bound(first, last, qit->Id);
+				if(rit != last && rit->id == qit->Id){
+					qit->Score += TContribution::Value(qvalue, rit->value);
+				}
+			}
+		}else{
+			// many candidates: go through the blocks
+			for(; bit != row.blocks.end() && qit != ret.end(); bit++){
+				// skip the candidates before the block
+				qit = lower_bound(qit, ret.end(), Result(bit->first_id, 0), LessId);
+
+				if(qit == ret.end() || qit->Id > bit->last_id) continue;
+
+				const double max_value = TContribution::Value(qvalue, bit->max_value);
+				
+				rit = row.begin() + (bit - row.blocks.begin()) * IF_BLOCK_SIZE;
+				
+				for(; qit != ret.end() && qit->Id <= bit->last_id; qit++){
+					if(qit->Score + max_value + rest < threshold) continue;
+					
+					while(rit->id < qit->Id) rit++;
+					if(rit->id == qit->Id){
+						qit->Score += TContribution::Value(qvalue, rit->value);
+					}
+				}
+			}
+		}
 
-	// complete score
-	// ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|) 
-	//		for all i | v_i != 0 and w_i != 0 
-	// (Nister, 2006)
-	if(scale_score){
-		for(qit = ret.begin(); qit != ret.end(); qit++) 
-			qit->Score = -qit->Score/2.0;
-	}else{
-		for(qit = ret.begin(); qit != ret.end(); qit++) 
-			qit->Score = 2.0 + qit->Score;
+		visited += ret.size() + row.blocks.size();
 	}
+
+	SortResults(ret, max_results);
 }
 
-void Database::doQueryL2(const BowVector &v, QueryResults &ret, 
-						 const int max_results, const bool scale_score) const
+template<class TContribution>
+void Database::doRerankedQuery(const BowVector &v, QueryResults &ret, 
+	const int max_results, QueryContext &context) const
+{
+	// 1st stage: candidates with the highest dot product
+	doQuery<DotProductContribution>(v, ret, 
+		max(m_rerank_candidates, max_results), context);
+
+	// 2nd stage: exact scores with the vectors of the direct index
+	RescoreCandidates<TContribution>(v, ret, max_results);
+}
+
+template<class TContribution>
+void Database::RescoreCandidates(const BowVector &v, QueryResults &ret, 
+	const int max_results) const
 {
-	BowVector::const_iterator it;
-	IFRow::const_iterator rit;
 	QueryResults::iterator qit;
+	for(qit = ret.begin(); qit != ret.end(); qit++){
+		vector<BowVectorEntry>::const_iterator wit = 
+			m_direct.words.begin() + m_direct.word_offsets[qit->Id];
+		const vector<BowVectorEntry>::const_iterator wend = 
+			m_direct.words.begin() + m_direct.word_offsets[qit->Id + 1];
 
-	for(it = v.begin(); it != v.end(); it++){
-		WordId wid = it->id;
-		WordValue qvalue = it->value;
-		
-		const IFRow& row = m_index[wid];
+		double score = 0;
 
-		for(rit = row.begin(); rit != row.end(); rit++){
-			EntryId eid = rit->id;
-			WordValue dvalue = rit->value;
+		BowVector::const_iterator it;
+		for(it = v.begin(); it != v.end(); it++){
+			while(wit != wend && wit->id < it->id) wit++;
 
-			// scoring-dependent value
-			double value = qvalue * dvalue;
-			value = -value; // trick for smart sorting
+			if(wit != wend && wit->id == it->id)
+				score += TContribution::Value(it->value, wit->value);
+			else
+				score += TContribution::Missing(it->value);
+		}
 
-			// check if this entry is already in the returning vector
-			qit = find(ret.begin(), ret.end(), eid);
+		qit->Score = score;
+	}
 
-			if(qit == ret.end()){
-				// insert
-				ret.push_back(Result(eid, value));
-			}else{
-				// update
-				qit->Score += value;
-			}
-		} // for each inverted row 
-	} // for each word in features	
+	SortResults(ret, max_results);
+}
 
-	// resulting "scores" are now in [ -1 best .. 0 worst ]
+template<class TContribution>
+void Database::doBatchQuery(const vector<BowVector> &queries, 
+	vector<QueryResults> &ret, const int max_results, const bool rerank,
+	QueryContext &context) const
+{
+	if(rerank){
+		doBatchQuery<DotProductContribution>(queries, ret, 
+			max(m_rerank_candidates, max_results), false, context);
 
-	// sort vector in ascending order
-	// (scores are inverted now --the lower the better--)
-	sort(ret.begin(), ret.end());
+		#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < (int)queries.size(); i++){
+			RescoreCandidates<TContribution>(queries[i], ret[i], max_results);
+		}
+		return;
+	}
 
-	// cut vector
-	if((int)ret.size() > max_results) ret.resize(max_results);
+	// queries are processed in groups that scan the rows of their words
+	// only once. The scores of a group are accumulated only for the 
+	// entries found, which are located with a table of N items per thread.
+	// As in _Query, all its items are -1 between groups
+	const int nqueries = queries.size();
+	const int ngroups = (nqueries + QUERY_BATCH_GROUP - 1) / QUERY_BATCH_GROUP;
+
+	#pragma omp parallel if(ngroups > 1)
+	{
+#ifdef _OPENMP
+		const bool main_thread = (omp_get_thread_num() == 0);
+#else
+		const bool main_thread = true;
+#endif
+
+		// the table of the context is reused by one of the threads
+		vector<int> own_position;
+		vector<int> &position = (main_thread ? context.m_position : 
+			own_position);
+		if(position.size() < m_nentries) position.resize(m_nentries, -1);
+
+		// entries found by the group, their scores (n per entry) and the 
+		// queries that found them (bit i for query i)
+		vector<EntryId> found;
+		vector<double> scores;
+		vector<unsigned int> masks;
+
+		vector<QueryWord> words;
+		vector<double> missing;
+
+		#pragma omp for schedule(dynamic)
+		for(int g = 0; g < ngroups; g++){
+			const int first = g * QUERY_BATCH_GROUP;
+			const int n = min(nqueries - first, QUERY_BATCH_GROUP);
+
+			// words of the queries of the group, sorted by word id
+			words.clear();
+			missing.assign(n, 0);
+
+			for(int i = 0; i < n; i++){
+				BowVector::const_iterator it;
+				const BowVector &q = queries[first + i];
+				for(it = q.begin(); it != q.end(); it++){
+					words.push_back(QueryWord(it->id, i, it->value));
+					missing[i] += TContribution::Missing(it->value);
+				}
+			}
+			sort(words.begin(), words.end());
+
+			found.resize(0);
+			scores.resize(0);
+			masks.resize(0);
+
+			vector<QueryWord>::const_iterator wit = words.begin();
+			while(wit != words.end()){
+				// queries wit..wend share the row
+				vector<QueryWord>::const_iterator wend = wit;
+				while(wend != words.end() && wend->id == wit->id) wend++;
+
+				const IFRow &row = m_index[wit->id];
+				IFRow::const_iterator rit;
+				vector<QueryWord>::const_iterator qit;
+				
+				for(rit = row.begin(); rit != row.end(); rit++){
+					int &pos = position[rit->id];
+					if(pos < 0){
+						pos = found.size();
+						found.push_back(rit->id);
+						scores.resize(scores.size() + n, 0);
+						masks.push_back(0);
+					}
+
+					double *score = &scores[pos * n];
+
+					for(qit = wit; qit != wend; qit++){
+						// for the entries that have the word, the missing part
+						// added in the end is replaced by the actual value
+						score[qit->query] += 
+							TContribution::Value(qit->value, rit->value)
+							- TContribution::Missing(qit->value);
+						masks[pos] |= (1u << qit->query);
+					}
+				}
+
+				wit = wend;
+			}
+
+			// results of each query, in the order the entries were found
+			for(unsigned int k = 0; k < found.size(); k++){
+				const double *score = &scores[k * n];
+				for(int i = 0; i < n; i++){
+					if(masks[k] & (1u << i)){
+						ret[first + i].push_back(Result(found[k], 
+							score[i] + missing[i]));
+					}
+				}
+				position[found[k]] = -1;
+			}
 
-	if(scale_score){
-		for(qit = ret.begin(); qit != ret.end(); qit++) 
-			qit->Score = 1.0 - sqrt(1.0 + qit->Score);
-	}else {
-		for(qit = ret.begin(); qit != ret.end(); qit++) 
-			qit->Score = sqrt(2 + 2 * qit->Score);
+			for(int i = 0; i < n; i++){
+				SortResults(ret[first + i], max_results);
+			}
+		}
 	}
 }
 
-void Database::doQueryChiSquare(const BowVector &v, QueryResults &ret, 
-						 const int max_results, const bool scale_score) const
+void Database::CompleteScores(QueryResults &ret, 
+	VocParams::ScoringType scoring, bool scale_score)
 {
-	BowVector::const_iterator it;
-	IFRow::const_iterator rit;
 	QueryResults::iterator qit;
-	
-	for(it = v.begin(); it != v.end(); it++){
-		WordId wid = it->id;
-		WordValue vi = it->value;
-		
-		const IFRow& row = m_index[wid];
-
-		for(rit = row.begin(); rit != row.end(); rit++){
-			EntryId eid = rit->id;
-			WordValue wi = rit->value;
 
-			// scoring-dependent value
-			double value = (vi - wi)*(vi - wi)/(vi + wi) - vi - wi;
-
-			// check if this db entry is already in the returning vector
-			qit = find(ret.begin(), ret.end(), eid);
-
-			if(qit == ret.end()){
-				// insert
-				ret.push_back(Result(eid, value));
+	switch(scoring){
+		case VocParams::L1_NORM:
+		case VocParams::CHI_SQUARE:
+			// resulting "scores" are now in [2 best .. 0 worst]
+
+			// complete score
+			// ||v - w||_{L1} = 2 - Sum(|v_i| + |w_i| - |v_i - w_i|) 
+			//		for all i | v_i != 0 and w_i != 0 
+			// (Nister, 2006)
+			//
+			// chi square: score = Sum (vi - wi)^2 / (vi + wi) ==
+			//   Sum vi + Sum wi - Sum{i, wi != 0} vi - Sum{i, vi != 0} wi +
+			//   + Sum_{i, vi != 0 && wi != 0} (vi - wi)^2 / (vi + wi)
+			//
+			// if there are no negative items, Sum vi = Sum wi = 1, since they
+			// are normalized
+			//
+			// NOTE: this implementation assumes there are no negative items in
+			// the vectors (there should not be if tf, idf or tf-idf are used)
+			//
+			if(scale_score){
+				for(qit = ret.begin(); qit != ret.end(); qit++) 
+					qit->Score = qit->Score/2.0;
 			}else{
-				// update
-				qit->Score += value; 
+				for(qit = ret.begin(); qit != ret.end(); qit++) 
+					qit->Score = 2.0 - qit->Score;
 			}
-		} // for each inverted row 
-	} // for each word in features	
+			break;
 
-	// resulting "scores" are now in [-2 best .. 0 worst]
-	
-	// sort vector in ascending order
-	// (scores are inverted now --the lower the better--)
-	sort(ret.begin(), ret.end());
+		case VocParams::L2_NORM:
+			// resulting "scores" are now in [ 1 best .. 0 worst ]
+			// (rounding errors may make them slightly higher than 1)
+			if(scale_score){
+				for(qit = ret.begin(); qit != ret.end(); qit++) 
+					qit->Score = 1.0 - sqrt(max(0., 1.0 - qit->Score));
+			}else {
+				for(qit = ret.begin(); qit != ret.end(); qit++) 
+					qit->Score = sqrt(max(0., 2 - 2 * qit->Score));
+			}
+			break;
 
-	// cut vector
-	if((int)ret.size() > max_results) ret.resize(max_results);
+		case VocParams::KL:
+			// scores are negated divergences, real scores are in 
+			// [0 best .. X worst]. This score cannot be scaled
+			for(qit = ret.begin(); qit != ret.end(); ++qit) 
+				qit->Score = -qit->Score;
+			break;
 
-	// complete score
-	// score = Sum (vi - wi)^2 / (vi + wi) ==
-	//   Sum vi + Sum wi - Sum{i, wi != 0} vi - Sum{i, vi != 0} wi +
-	//   + Sum_{i, vi != 0 && wi != 0} (vi - wi)^2 / (vi + wi)
-	//
-	// if there are no negative items, Sum vi = Sum wi = 1, since they
-	// are normalized
-	//
-	// NOTE: this implementation assumes there are no negative items in
-	// the vectors (there should not be if tf, idf or tf-idf are used)
-	//
-	if(scale_score){
-		for(qit = ret.begin(); qit != ret.end(); qit++) 
-			qit->Score = -qit->Score/2.0;
-	}else{
-		for(qit = ret.begin(); qit != ret.end(); qit++) 
-			qit->Score = 2.0 + qit->Score;
+		case VocParams::BHATTACHARYYA:
+			// resulting "scores" are now in [1 best .. 0 worst]
+			// this score is already scaled
+			break;
+
+		case VocParams::DOT_PRODUCT:
+			// resulting "scores" are now in [0 worst .. X best]
+			// this score cannot be scaled
+			break;
 	}
 }
 
+void Database::doQueryL1(const BowVector &v, QueryResults &ret, 
+						 const int max_results, const bool scale_score,
+						 QueryContext &context) const
+{
+	if(m_rerank_candidates > 0)
+		doRerankedQuery<L1Contribution>(v, ret, max_results, context);
+	else
+		doQuery<L1Contribution>(v, ret, max_results, context);
+
+	CompleteScores(ret, VocParams::L1_NORM, scale_score);
+}
+
+void Database::doQueryL2(const BowVector &v, QueryResults &ret, 
+						 const int max_results, const bool scale_score,
+						 QueryContext &context) const
+{
+	doQuery<L2Contribution>(v, ret, max_results, context);
+
+	CompleteScores(ret, VocParams::L2_NORM, scale_score);
+}
+
+void Database::doQueryChiSquare(const BowVector &v, QueryResults &ret, 
+						 const int max_results, const bool scale_score,
+						 QueryContext &context) const
+{
+	if(m_rerank_candidates > 0)
+		doRerankedQuery<ChiSquareContribution>(v, ret, max_results, context);
+	else
+		doQuery<ChiSquareContribution>(v, ret, max_results, context);
+
+	CompleteScores(ret, VocParams::CHI_SQUARE, scale_score);
+}
+
 void Database::doQueryKL(const BowVector &v, QueryResults &ret, 
-						 const int max_results, const bool scale_score) const
+						 const int max_results, const bool scale_score,
+						 QueryContext &context) const
 {
+	if(m_rerank_candidates > 0){
+		doRerankedQuery<KLContribution>(v, ret, max_results, context);
+		CompleteScores(ret, VocParams::KL, scale_score);
+		return;
+	}
+
 	BowVector::const_iterator it;
 	IFRow::const_iterator rit;
 	QueryResults::iterator qit;
 
+	// position[eid] = index of entry eid in ret, or -1
+	vector<int> &position = context.m_position;
+
+	// sum of vi * (log(vi) - LOG_EPS) of the words each entry has
+	vector<double> &common = context.m_common;
+	common.resize(0);
+
 	for(it = v.begin(); it != v.end(); it++){
 		WordId wid = it->id;
 		WordValue vi = it->value;
+		const double missing = vi * (log(vi) - LOG_EPS);
 		
 		const IFRow& row = m_index[wid];
 
@@ -308,14 +1225,17 @@ void Database::doQueryKL(const BowVector &v, QueryResults &ret,
 			double value = vi * log(vi/wi);
 
 			// check if this db entry is already in the returning vector
-			qit = find(ret.begin(), ret.end(), eid);
+			int &pos = position[eid];
 
-			if(qit == ret.end()){
+			if(pos < 0){
 				// insert
+				pos = ret.size();
 				ret.push_back(Result(eid, value));
+				common.push_back(missing);
 			}else{
 				// update
-				qit->Score += value; 
+				ret[pos].Score += value;
+				common[pos] += missing;
 			}
 		} // for each inverted row 
 	} // for each word in features	
@@ -324,21 +1244,15 @@ void Database::doQueryKL(const BowVector &v, QueryResults &ret,
 	// but we cannot make sure which ones are better without calculating
 	// the complete score
 
-	// complete scores
-	for(qit = ret.begin(); qit != ret.end(); ++qit){
-		EntryId eid = qit->Id;
-		double value = 0.0;
-		
-		for(it = v.begin(); it != v.end(); it++){
-			const WordValue vi = it->value;
-			const IFRow& row = m_index[it->id];
-
-			if(row.end() == find(row.begin(), row.end(), IFEntry(eid, 0) )){
-				value += vi * (log(vi) - LOG_EPS);
-			}
-		}
+	// complete scores with the words each entry does not have
+	double missing = 0;
+	for(it = v.begin(); it != v.end(); it++){
+		missing += it->value * (log(it->value) - LOG_EPS);
+	}
 
-		qit->Score += value;
+	for(qit = ret.begin(); qit != ret.end(); ++qit){
+		qit->Score += missing - common[qit - ret.begin()];
+		position[qit->Id] = -1;
 	}
 
 	// real scores are now in [0 best .. X worst]
@@ -354,124 +1268,190 @@ void Database::doQueryKL(const BowVector &v, QueryResults &ret,
 }
 
 void Database::doQueryBhattacharyya(const BowVector &v, QueryResults &ret, 
-						 const int max_results, const bool scale_score) const
+						 const int max_results, const bool scale_score,
+						 QueryContext &context) const
 {
-	BowVector::const_iterator it;
-	IFRow::const_iterator rit;
-	QueryResults::iterator qit;
-	
-	for(it = v.begin(); it != v.end(); it++){
-		WordId wid = it->id;
-		WordValue vi = it->value;
-		
-		const IFRow& row = m_index[wid];
+	if(m_rerank_candidates > 0)
+		doRerankedQuery<BhattacharyyaContribution>(v, ret, max_results, context);
+	else
+		doQuery<BhattacharyyaContribution>(v, ret, max_results, context);
 
-		for(rit = row.begin(); rit != row.end(); rit++){
-			EntryId eid = rit->id;
-			WordValue wi = rit->value;
+	CompleteScores(ret, VocParams::BHATTACHARYYA, scale_score);
+}
 
-			// scoring-dependent value
-			double value = sqrt(vi * wi);
+void Database::doQueryDotProduct(const BowVector &v, QueryResults &ret, 
+						 const int max_results, const bool scale_score,
+						 QueryContext &context) const
+{
+	doQuery<DotProductContribution>(v, ret, max_results, context);
 
-			// check if this db entry is already in the returning vector
-			qit = find(ret.begin(), ret.end(), eid);
+	CompleteScores(ret, VocParams::DOT_PRODUCT, scale_score);
+}
 
-			if(qit == ret.end()){
-				// insert
-				ret.push_back(Result(eid, value));
-			}else{
-				// update
-				qit->Score += value; 
-			}
-		} // for each inverted row 
-	} // for each word in features	
+void Database::Save(const char *filename, bool binary) const
+{
+	if(binary){
+		SaveBinary(filename);
+	}else{
+		SaveText(filename);
+	}
+}
 
-	// resulting "scores" are now in [1 best .. 0 worst]
-	
-	// sort vector in descending order
-	sort(ret.begin(), ret.end(), Result::GreaterThan);
+void Database::Save(const char *filename, const char *voc_filename, 
+	bool binary) const
+{
+	if(binary){
+		SaveBinary(filename, voc_filename);
+	}else{
+		SaveText(filename, voc_filename);
+	}
+}
 
-	// cut vector
-	if((int)ret.size() > max_results) ret.resize(max_results);
+void Database::Load(const char *filename)
+{
+	Load(filename, SharedVocabulary());
+}
+
+void Database::Load(const char *filename, const SharedVocabulary &voc)
+{
+	const SharedVocabulary *pvoc = (voc.empty() ? NULL : &voc);
+
+	fstream f(filename, ios::in | ios::binary);
 
-	// this score is already scaled
+	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+
+	char c;
+	f.get(c);
+
+	f.close();
+
+	// if c is >= 32, it is text
+	if(c >= 32)
+		LoadText(filename, pvoc);
+	else
+		LoadBinary(filename, pvoc);
+
+	invalidateLog();
 }
 
-void Database::doQueryDotProduct(const BowVector &v, QueryResults &ret, 
-						 const int max_results, const bool scale_score) const
+string Database::ReferencedVocabulary(const char *filename)
 {
-	BowVector::const_iterator it;
-	IFRow::const_iterator rit;
-	QueryResults::iterator qit;
-	
-	for(it = v.begin(); it != v.end(); it++){
-		WordId wid = it->id;
-		WordValue vi = it->value;
-		
-		const IFRow& row = m_index[wid];
+	fstream test(filename, ios::in | ios::binary);
+	if(!test.is_open()) throw DUtils::DException("Cannot open file");
+	char c = 0;
+	test.get(c);
+	test.close();
+
+	VocParams::VocType type;
+	string hash, voc_filename;
+
+	if(c == VOC_REFERENCE_MAGIC){
+		DUtils::BinaryFile f(filename, DUtils::READ);
+		f.DiscardNextByte(); // magic word
+		readVocReference(f, type, hash, voc_filename);
+		f.Close();
+
+	}else if(c == VOC_REFERENCE_KEYWORD[0]){
+		DUtils::TextFile f(filename, DUtils::READ);
+		string keyword;
+		f >> keyword;
+		readVocReference(f, type, hash, voc_filename);
+		f.Close();
 
-		for(rit = row.begin(); rit != row.end(); rit++){
-			EntryId eid = rit->id;
-			WordValue wi = rit->value;
+	}else{
+		return string();
+	}
 
-			// scoring-dependent value
-			double value = vi * wi;
+	return referencedVocPath(filename, voc_filename);
+}
+
+void Database::OpenLog(const char *filename)
+{
+	EntryId next = m_log.Open(filename);
 
-			// check if this db entry is already in the returning vector
-			qit = find(ret.begin(), ret.end(), eid);
+	if(next > m_nentries){
+		m_log.Close();
+		throw DUtils::DException("The log has entries that are not in the "
+			"database");
+	}
 
-			if(qit == ret.end()){
-				// insert
-				ret.push_back(Result(eid, value));
-			}else{
-				// update
-				qit->Score += value; 
-			}
-		} // for each inverted row 
-	} // for each word in features	
-	
-	// resulting "scores" are now in [0 worst .. X best]
+	m_log_stale = false;
+}
 
-	// sort vector in descending order
-	sort(ret.begin(), ret.end(), Result::GreaterThan);
+void Database::CloseLog()
+{
+	m_log.Close();
+	m_log_stale = false;
+}
 
-	// cut vector
-	if((int)ret.size() > max_results) ret.resize(max_results);
+void Database::Checkpoint()
+{
+	if(!m_log.isOpen()) throw DUtils::DException("The log is not open");
+	if(m_log_stale) 
+		throw DUtils::DException("The database has changes that are not "
+			"logged and must be saved with Compact");
 
-	// this score cannot be scaled
+	m_log.Flush();
 }
 
-void Database::Save(const char *filename, bool binary) const
+void Database::Compact(const char *filename, bool binary)
 {
-	if(binary){
-		SaveBinary(filename);
-	}else{
-		SaveText(filename);
+	// the old snapshot is kept until the new one is complete
+	string tmp = string(filename) + ".tmp";
+	Save(tmp.c_str(), binary);
+
+	// the snapshot must be on disk before it replaces the old one and the
+	// log is emptied
+	EntryLog::SyncFile(tmp.c_str());
+
+#ifdef WIN32
+	remove(filename);
+#endif
+	if(rename(tmp.c_str(), filename) != 0) 
+		throw DUtils::DException("Cannot replace the snapshot");
+
+	EntryLog::SyncDirectory(filename);
+
+	if(m_log.isOpen()){
+		m_log.Clear();
+		m_log_stale = false;
 	}
 }
 
-void Database::Load(const char *filename)
+unsigned int Database::ReplayLog(const char *filename)
 {
-	fstream f(filename, ios::in | ios::binary);
+	DUtils::BinaryFile f(filename, DUtils::READ);
 
-	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+	EntryId id;
+	BowVector v;
+	vector<float> tf;
+	FeatureVector fv;
+	unsigned int n = 0;
 
-	char c;
-	f.get(c);
+	const WordId nwords = m_index.size();
 
-	f.close();
+	while(EntryLog::ReadRecord(f, id, v, tf, fv)){
+		// entries before the snapshot are skipped
+		if(id < m_nentries) continue;
 
-	// if c is >= 32, it is text
-	if(c >= 32)
-		LoadText(filename);
-	else
-		LoadBinary(filename);
+		if(id > m_nentries)
+			throw DUtils::DException("The log does not follow the database");
+
+		for(unsigned int i = 0; i < v.size(); i++)
+			if(v[i].id >= nwords) throw DUtils::DException("Wrong word in log");
+
+		_AddEntry(v, tf, (fv.empty() ? NULL : &fv));
+		n++;
+	}
+
+	return n;
 }
 
-void Database::SaveBinary(const char *filename) const
+void Database::SaveBinary(const char *filename, const char *voc_filename,
+	bool check_voc) const
 {
 	// Format:
-	// [Vocabulary] (with magic word)
+	// [Vocabulary] (with magic word) | [Reference]
 	// N W'
 	// WordId_0 K_0 EntryId_0_0 Value_0_0 ... EntryId_0_(K_0) Value_0_(K_0)
 	// ...
@@ -485,9 +1465,69 @@ void Database::SaveBinary(const char *filename) const
 	// K_i (int32): number of entries in the row of the WordId_i
 	// EntryId_i_k (int32): doc (entry) id where the word WordId_i is present
 	// Value_i_k (double64): value of word WordId_i in entry EntryId_i_k
+	// O R
+	// Tf_0_0 ... Tf_0_(K_0) ... Tf_(W'-1)_0 ... Tf_(W'-1)_{K_(W'-1)}
+	//
+	// O (int32): 1 if online weighting is enabled, 0 otherwise
+	// R (double64): refresh ratio of online weighting
+	// Tf_i_k (float32): term frequency of word WordId_i in entry EntryId_i_k
+	//   (not present if O R is not present, in older files)
+	// S
+	// First_0_0 Last_0_0 Max_0_0 ... First_(W'-1)_{B_(W'-1)} ... Max_(W'-1)_{B_(W'-1)}
+	//
+	// S (int32): number of entries per block of the rows
+	// B_i: number of blocks of row WordId_i, ceil(K_i / S)
+	// First_i_b (int32): id of the first entry of the b-th block of row WordId_i
+	// Last_i_b (int32): id of the last entry of the block
+	// Max_i_b (double64): maximum value of the entries of the block
+	//   (not present in older files)
+	// D L
+	// F_0 Node_0_0 Feature_0_0 ... F_(N-1) ... Feature_(N-1)_{F_(N-1)}
+	//
+	// D (int32): 1 if the direct index is enabled, 0 otherwise
+	// L (int32): level of the nodes of the features in the direct index
+	// F_i (int32): number of features of entry i in the direct index
+	// Node_i_f (int32): node of the f-th feature of entry i
+	// Feature_i_f (int32): index of the feature in its image
+	//   (F_i, Node_i_f and Feature_i_f are present only if D is 1. The words
+	//   of the direct index are recovered from the inverted file)
+	// M
+	// Ow_0 ... Ow_(M-1) E
+	//
+	// M (int32): number of online weights (0 if they are not in use)
+	// Ow_i (double64): weight of word i computed from the entries
+	// E (int32): number of entries when the online weights were computed
+	//   (not present in older files)
+	//
+
+	// Reference format:
+	// XX Vt H_0 ... H_15 P C_0 ... C_(P-1)
+	//
+	// XX (byte): magic word (byte with value 1)
+	// Vt (int32): vocabulary type
+	// H_i (byte): hexadecimal digits of the content hash of the vocabulary
+	// P (int32): length of the name of the vocabulary file
+	// C_i (byte): name of the vocabulary file
 	//
 
-	m_voc->Save(filename, true);
+	if(voc_filename){
+		if(check_voc) saveReferencedVoc(filename, voc_filename);
+
+		const string hash = m_voc.Hash();
+		const string name = voc_filename;
+
+		DUtils::BinaryFile f(filename, DUtils::WRITE);
+
+		f << VOC_REFERENCE_MAGIC << (int)m_voc->RetrieveInfo().VocType;
+		for(unsigned int i = 0; i < hash.size(); i++) f << hash[i];
+
+		f << (int)name.size();
+		for(unsigned int i = 0; i < name.size(); i++) f << name[i];
+
+		f.Close();
+	}else{
+		m_voc->Save(filename, true);
+	}
 
 	DUtils::BinaryFile f(filename, DUtils::FILE_MODES(DUtils::WRITE | DUtils::APPEND));
 
@@ -515,11 +1555,50 @@ void Database::SaveBinary(const char *filename) const
 		}
 	}
 
+	f << (int)m_online << m_refresh_ratio;
+
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(rit = it->begin(); rit != it->end(); rit++){
+			f << rit->tf;
+		}
+	}
+
+	f << (int)IF_BLOCK_SIZE;
+
+	vector<IFBlock>::const_iterator bit;
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(bit = it->blocks.begin(); bit != it->blocks.end(); bit++){
+			f << (int)bit->first_id << (int)bit->last_id << (double)bit->max_value;
+		}
+	}
+
+	f << (int)m_direct_enabled << m_direct_level;
+
+	if(m_direct_enabled){
+		for(unsigned int i = 0; i < m_nentries; i++){
+			const unsigned int first = m_direct.feature_offsets[i];
+			const unsigned int last = m_direct.feature_offsets[i+1];
+			
+			f << (int)(last - first);
+			for(unsigned int j = first; j < last; j++){
+				f << (int)m_direct.features[j].first 
+					<< (int)m_direct.features[j].second;
+			}
+		}
+	}
+
+	f << (int)m_online_weights.size();
+	for(unsigned int i = 0; i < m_online_weights.size(); i++){
+		f << (double)m_online_weights[i];
+	}
+	f << (int)m_weighted_entries;
+
 	f.Close();
 }
 
 	
-void Database::SaveText(const char *filename) const
+void Database::SaveText(const char *filename, const char *voc_filename,
+	bool check_voc) const
 {
 	// Format:
 	// [Vocabulary]
@@ -536,12 +1615,65 @@ void Database::SaveText(const char *filename) const
 	// K_i (int32): number of entries in the row of the WordId_i
 	// EntryId_i_k (int32): doc (entry) id where the word WordId_i is present
 	// Value_i_k (double64): value of word WordId_i in entry EntryId_i_k
+	// O R
+	// Tf_0_0 ... Tf_0_(K_0) ... Tf_(W'-1)_0 ... Tf_(W'-1)_{K_(W'-1)}
+	//
+	// O (int32): 1 if online weighting is enabled, 0 otherwise
+	// R (double64): refresh ratio of online weighting
+	// Tf_i_k (float32): term frequency of word WordId_i in entry EntryId_i_k
+	//   (not present if O R is not present, in older files)
+	// S
+	// First_0_0 Last_0_0 Max_0_0 ... First_(W'-1)_{B_(W'-1)} ... Max_(W'-1)_{B_(W'-1)}
+	//
+	// S (int32): number of entries per block of the rows
+	// B_i: number of blocks of row WordId_i, ceil(K_i / S)
+	// First_i_b (int32): id of the first entry of the b-th block of row WordId_i
+	// Last_i_b (int32): id of the last entry of the block
+	// Max_i_b (double64): maximum value of the entries of the block
+	//   (not present in older files)
+	// D L
+	// F_0 Node_0_0 Feature_0_0 ... F_(N-1) ... Feature_(N-1)_{F_(N-1)}
+	//
+	// D (int32): 1 if the direct index is enabled, 0 otherwise
+	// L (int32): level of the nodes of the features in the direct index
+	// F_i (int32): number of features of entry i in the direct index
+	// Node_i_f (int32): node of the f-th feature of entry i
+	// Feature_i_f (int32): index of the feature in its image
+	//   (F_i, Node_i_f and Feature_i_f are present only if D is 1. The words
+	//   of the direct index are recovered from the inverted file)
+	// M
+	// Ow_0 ... Ow_(M-1) E
+	//
+	// M (int32): number of online weights (0 if they are not in use)
+	// Ow_i (double64): weight of word i computed from the entries
+	// E (int32): number of entries when the online weights were computed
+	//   (not present in older files)
 	//
 
-	m_voc->Save(filename, false);
+	// Reference format:
+	// vocabulary Vt H P
+	//
+	// Vt: vocabulary type
+	// H: content hash of the vocabulary
+	// P: name of the vocabulary file, up to the end of the line
+	//
 
-	fstream f(filename, ios::out | ios::app);
-	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+	if(voc_filename){
+		if(check_voc) saveReferencedVoc(filename, voc_filename);
+
+		DUtils::TextFile f(filename, DUtils::WRITE);
+
+		f << VOC_REFERENCE_KEYWORD << " " 
+			<< (int)m_voc->RetrieveInfo().VocType << " "
+			<< m_voc.Hash() << " " 
+			<< voc_filename << '\n';
+
+		f.Close();
+	}else{
+		m_voc->Save(filename, false);
+	}
+
+	DUtils::TextFile f(filename, DUtils::FILE_MODES(DUtils::WRITE | DUtils::APPEND));
 
 	int N = m_nentries;
 	int W = 0;
@@ -551,7 +1683,7 @@ void Database::SaveText(const char *filename) const
 		if(!it->empty()) W++;
 	}
 
-	f << N << " " << W << endl;
+	f << N << " " << W << '\n';
 
 	IFRow::const_iterator rit;
 	for(it = m_index.begin(); it != m_index.end(); it++){
@@ -565,26 +1697,85 @@ void Database::SaveText(const char *filename) const
 				f << (int)rit->id << " " 
 					<< (double)rit->value << " ";
 			}
-			f << endl;
+			f << '\n';
 		}
 	}
 
-	f.close();
+	f << (int)m_online << " " << m_refresh_ratio << '\n';
+
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(rit = it->begin(); rit != it->end(); rit++){
+			f << rit->tf << " ";
+		}
+	}
+	f << '\n';
+
+	f << IF_BLOCK_SIZE << '\n';
+
+	vector<IFBlock>::const_iterator bit;
+	for(it = m_index.begin(); it != m_index.end(); it++){
+		for(bit = it->blocks.begin(); bit != it->blocks.end(); bit++){
+			f << (int)bit->first_id << " " << (int)bit->last_id << " "
+				<< (double)bit->max_value << " ";
+		}
+	}
+	f << '\n';
+
+	f << (int)m_direct_enabled << " " << m_direct_level << '\n';
+
+	if(m_direct_enabled){
+		for(unsigned int i = 0; i < m_nentries; i++){
+			const unsigned int first = m_direct.feature_offsets[i];
+			const unsigned int last = m_direct.feature_offsets[i+1];
+			
+			f << (last - first) << " ";
+			for(unsigned int j = first; j < last; j++){
+				f << m_direct.features[j].first << " " 
+					<< m_direct.features[j].second << " ";
+			}
+			f << '\n';
+		}
+	}
+
+	f << (int)m_online_weights.size() << '\n';
+	for(unsigned int i = 0; i < m_online_weights.size(); i++){
+		f << (double)m_online_weights[i] << " ";
+	}
+	f << '\n' << (int)m_weighted_entries << '\n';
+
+	f.Close();
 }
 
 
-void Database::LoadBinary(const char *filename)
+void Database::LoadBinary(const char *filename, const SharedVocabulary *voc)
 {
 	// read type of voc (@see Vocabulary::SaveBinaryHeader)
 	DUtils::BinaryFile f(filename, DUtils::READ);
-	f.DiscardNextByte(); // magic word
+	char magic;
+	f >> magic;
+
+	if(magic == VOC_REFERENCE_MAGIC){
+		VocParams::VocType type;
+		string hash, voc_filename;
+		readVocReference(f, type, hash, voc_filename);
+
+		setReferencedVoc(filename, type, hash, voc_filename, voc);
+
+		_load<DUtils::BinaryFile>(f);
+
+		f.Close();
+		return;
+	}
+
 	int voctype;
 	f >> voctype;
 	f.Close();
 
-	initVoc((VocParams::VocType)voctype);
+	Vocabulary *loaded = createVoc((VocParams::VocType)voctype);
+	SharedVocabulary handle(loaded);
 
-	unsigned int pos = m_voc->Load(filename);
+	unsigned int pos = loaded->Load(filename);
+	setLoadedVoc(handle, voc);
 	
 	f.OpenForReading(filename);
 	f.DiscardBytes(pos); // vocabulary read
@@ -594,26 +1785,127 @@ void Database::LoadBinary(const char *filename)
 	f.Close();
 }
 
-void Database::LoadText(const char *filename) 
+void Database::LoadText(const char *filename, const SharedVocabulary *voc) 
 {
 	// read type of voc (@see Vocabulary::SaveTextHeader)
-	fstream f(filename, ios::in);
+	DUtils::TextFile f(filename, DUtils::READ);
+
+	if(f.Peek() == VOC_REFERENCE_KEYWORD[0]){
+		string keyword;
+		f >> keyword;
+		if(keyword != VOC_REFERENCE_KEYWORD) 
+			throw DUtils::DException("Wrong file format");
+
+		VocParams::VocType type;
+		string hash, voc_filename;
+		readVocReference(f, type, hash, voc_filename);
+
+		setReferencedVoc(filename, type, hash, voc_filename, voc);
+
+		_load<DUtils::TextFile>(f);
+
+		f.Close();
+		return;
+	}
+
 	int voctype;
 	f >> voctype;
-	f.close();
+	f.Close();
 
-	initVoc((VocParams::VocType)voctype);
+	Vocabulary *loaded = createVoc((VocParams::VocType)voctype);
+	SharedVocabulary handle(loaded);
 
-	unsigned int pos = m_voc->Load(filename);
+	unsigned int pos = loaded->Load(filename);
+	setLoadedVoc(handle, voc);
 
-	f.open(filename, ios::in);
-	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+	f.OpenForReading(filename);
+	f.Seek(pos); // vocabulary read
 
-	f.seekg(pos); // vocabulary read
+	_load<DUtils::TextFile>(f);
 
-	_load<fstream>(f);
+	f.Close();
+}
 
-	f.close();
+template<class T>
+void Database::readRows(T &f, int nrows)
+{
+	for(int i = 0; i < nrows; i++){
+		int wordid, k;
+		f >> wordid >> k;
+
+		for(int j = 0; j < k; j++){
+			int eid;
+			double value;
+
+			f >> eid >> value;
+
+			m_index[wordid].push_back(IFEntry(eid, value));
+		}
+	}
+}
+
+void Database::readRows(DUtils::TextFile &f, int nrows)
+{
+	const int nwords = m_index.size();
+	const unsigned int start = f.Position();
+	const char *data = f.Data();
+
+	vector<unsigned int> lines;
+	bool ok = f.FindLines(nrows, lines);
+
+	vector<int> wids(nrows);
+
+	// the ids are read first, so that each line writes a different row
+	if(ok){
+		vector<bool> found(nwords, false);
+
+		for(int i = 0; ok && i < nrows; i++){
+			ok = DUtils::TextFile::Parse(data + lines[i], data + lines[i+1], 
+				wids[i]) && wids[i] >= 0 && wids[i] < nwords && !found[wids[i]];
+
+			if(ok) found[wids[i]] = true;
+		}
+	}
+
+	if(ok){
+		int wrong = 0;
+
+		#pragma omp parallel for reduction(+:wrong) schedule(dynamic, 64)
+		for(int i = 0; i < nrows; i++){
+			const char *end = data + lines[i+1];
+			const char *p;
+			int wordid, k = -1;
+
+			p = DUtils::TextFile::Parse(data + lines[i], end, wordid);
+			if(p) p = DUtils::TextFile::Parse(p, end, k);
+
+			IFRow &row = m_index[wids[i]];
+			if(p && k >= 0) row.reserve(k);
+
+			for(int j = 0; p && j < k; j++){
+				int eid;
+				double value;
+
+				p = DUtils::TextFile::Parse(p, end, eid);
+				if(p) p = DUtils::TextFile::Parse(p, end, value);
+				if(p) row.push_back(IFEntry(eid, value));
+			}
+
+			if(!p || k < 0 || !DUtils::TextFile::isBlank(p, end)) wrong++;
+		}
+
+		ok = (wrong == 0);
+	}
+
+	if(ok){
+		f.Seek(lines[nrows]);
+	}else{
+		m_index.resize(0);
+		m_index.resize(nwords);
+
+		f.Seek(start);
+		readRows<DUtils::TextFile>(f, nrows);
+	}
 }
 
 template<class T> 
@@ -633,6 +1925,39 @@ void Database::_load(T& f)
 	// K_i (int32): number of entries in the row of the WordId_i
 	// EntryId_i_k (int32): doc (entry) id where the word WordId_i is present
 	// Value_i_k (double64): value of word WordId_i in entry EntryId_i_k
+	// O R
+	// Tf_0_0 ... Tf_0_(K_0) ... Tf_(W'-1)_0 ... Tf_(W'-1)_{K_(W'-1)}
+	//
+	// O (int32): 1 if online weighting is enabled, 0 otherwise
+	// R (double64): refresh ratio of online weighting
+	// Tf_i_k (float32): term frequency of word WordId_i in entry EntryId_i_k
+	//   (not present if O R is not present, in older files)
+	// S
+	// First_0_0 Last_0_0 Max_0_0 ... First_(W'-1)_{B_(W'-1)} ... Max_(W'-1)_{B_(W'-1)}
+	//
+	// S (int32): number of entries per block of the rows
+	// B_i: number of blocks of row WordId_i, ceil(K_i / S)
+	// First_i_b (int32): id of the first entry of the b-th block of row WordId_i
+	// Last_i_b (int32): id of the last entry of the block
+	// Max_i_b (double64): maximum value of the entries of the block
+	//   (not present in older files)
+	// D L
+	// F_0 Node_0_0 Feature_0_0 ... F_(N-1) ... Feature_(N-1)_{F_(N-1)}
+	//
+	// D (int32): 1 if the direct index is enabled, 0 otherwise
+	// L (int32): level of the nodes of the features in the direct index
+	// F_i (int32): number of features of entry i in the direct index
+	// Node_i_f (int32): node of the f-th feature of entry i
+	// Feature_i_f (int32): index of the feature in its image
+	//   (F_i, Node_i_f and Feature_i_f are present only if D is 1. The words
+	//   of the direct index are recovered from the inverted file)
+	// M
+	// Ow_0 ... Ow_(M-1) E
+	//
+	// M (int32): number of online weights (0 if they are not in use)
+	// Ow_i (double64): weight of word i computed from the entries
+	// E (int32): number of entries when the online weights were computed
+	//   (not present in older files)
 	//
 
 	int N, W;
@@ -642,37 +1967,289 @@ void Database::_load(T& f)
 	m_index.resize(m_voc->NumberOfWords());
 	m_nentries = N;
 
-	for(int i = 0; i < W; i++){
-		int wordid, k;
-		f >> wordid >> k;
+	readRows(f, W);
 
-		for(int j = 0; j < k; j++){
-			int eid;
-			double value;
+	m_online = false;
+	m_online_weights.clear();
+	m_weighted_entries = m_nentries;
 
-			f >> eid >> value;
+	int online = 0;
+	f >> online >> m_refresh_ratio;
+	
+	m_tf_available = !EndOfFile(f);
 
-			m_index[wordid].push_back(IFEntry(eid, value));
+	if(m_tf_available){
+		InvertedFile::iterator it;
+		IFRow::iterator rit;
+		for(it = m_index.begin(); it != m_index.end(); it++){
+			for(rit = it->begin(); rit != it->end(); rit++){
+				f >> rit->tf;
+			}
+		}
+
+	}else{
+		// old file
+		m_refresh_ratio = 0.1;
+		m_tf_available = (m_nentries == 0);
+	}
+
+	// blocks are computed again if they are not in the file or have
+	// a different size. The sections after them can be read in both cases
+	bool blocks_read = false;
+	bool blocks_available = false;
+	
+	if(m_tf_available){
+		int S = 0;
+		f >> S;
+		blocks_read = !EndOfFile(f) && S > 0;
+		
+		InvertedFile::iterator it;
+		for(it = m_index.begin(); blocks_read && it != m_index.end(); it++){
+			it->blocks.resize((it->size() + S - 1) / S);
+
+			vector<IFBlock>::iterator bit;
+			for(bit = it->blocks.begin(); bit != it->blocks.end(); bit++){
+				int first, last;
+				double max_value;
+				f >> first >> last >> max_value;
+
+				bit->first_id = first;
+				bit->last_id = last;
+				bit->max_value = max_value;
+			}
+		}
+		
+		blocks_available = blocks_read && S == IF_BLOCK_SIZE;
+	}
+
+	m_direct_enabled = false;
+	m_direct_level = 0;
+
+	if(m_tf_available){
+		int direct = 0, level = 0;
+		f >> direct >> level;
+
+		if(!EndOfFile(f) && direct){
+			m_direct_enabled = true;
+			m_direct_level = level;
+
+			m_direct.feature_offsets.resize(m_nentries + 1);
+			m_direct.feature_offsets[0] = 0;
+			m_direct.features.resize(0);
+
+			for(unsigned int i = 0; i < m_nentries; i++){
+				int F;
+				f >> F;
+				for(int j = 0; j < F; j++){
+					int node, feature;
+					f >> node >> feature;
+					m_direct.features.push_back(make_pair(node, feature));
+				}
+				m_direct.feature_offsets[i+1] = m_direct.features.size();
+			}
+		}
+	}
+
+	// the online weights in use when the file was saved are kept, so 
+	// that the entries are not weighted again
+	bool weights_read = false;
+
+	if(m_tf_available){
+		int M = 0;
+		f >> M;
+
+		if(!EndOfFile(f) && M >= 0 && M <= (int)m_voc->NumberOfWords()){
+			vector<WordValue> weights(M);
+			for(int i = 0; i < M; i++){
+				double w;
+				f >> w;
+				weights[i] = w;
+			}
+
+			int E = 0;
+			f >> E;
+
+			if(!EndOfFile(f) && E >= 0){
+				weights_read = true;
+				m_online_weights.swap(weights);
+				m_weighted_entries = E;
+			}
+		}
+	}
+
+	if(online && !weights_read){
+		// older file: the weights are computed from the entries
+		SetOnlineWeighting(true, m_refresh_ratio);
+	}else{
+		m_online = (online != 0);
+		if(!online) m_online_weights.clear();
+		if(!blocks_available) UpdateBlocks();
+		if(m_direct_enabled) BuildDirectIndex();
+	}
+}
+
+void Database::setLoadedVoc(const SharedVocabulary &loaded, 
+	const SharedVocabulary *voc)
+{
+	if(voc){
+		// the tree is not compared, only its size and parameters
+		if(loaded->RetrieveInfo().VocType != (*voc)->RetrieveInfo().VocType ||
+			loaded->NumberOfWords() != (*voc)->NumberOfWords() ||
+			loaded->DescriptorLength() != (*voc)->DescriptorLength() ||
+			loaded->Weighting() != (*voc)->Weighting() ||
+			loaded->Scoring() != (*voc)->Scoring())
+			throw DUtils::DException("The vocabulary of the file is different");
+
+		m_voc = *voc;
+	}else{
+		m_voc = loaded;
+	}
+}
+
+void Database::setReferencedVoc(const char *filename, 
+	VocParams::VocType type, const string &hash, const string &voc_filename,
+	const SharedVocabulary *voc)
+{
+	if(voc){
+		// the vocabulary file is not read
+		if((*voc)->RetrieveInfo().VocType != type || voc->Hash() != hash)
+			throw DUtils::DException("The vocabulary of the file is different");
+
+		m_voc = *voc;
+	}else{
+		Vocabulary *loaded = createVoc(type);
+		SharedVocabulary handle(loaded);
+
+		loaded->Load(referencedVocPath(filename, voc_filename).c_str());
+
+		if(handle.Hash() != hash)
+			throw DUtils::DException("The vocabulary file has changed");
+
+		m_voc = handle;
+	}
+}
+
+void Database::saveReferencedVoc(const char *filename, 
+	const char *voc_filename) const
+{
+	const string path = referencedVocPath(filename, voc_filename);
+
+	fstream test(path.c_str(), ios::in | ios::binary);
+	if(!test.is_open()){
+		// binary, so that the hash of the vocabulary read is the same
+		m_voc->Save(path.c_str(), true);
+		return;
+	}
+	test.close();
+
+	// the file is never replaced, since other databases may reference it
+	string hash = Vocabulary::StoredHash(path.c_str());
+
+	if(hash.empty()){
+		// saved by an older version: the hash is computed once
+		Vocabulary *voc = createVoc(m_voc->RetrieveInfo().VocType);
+		try{
+			voc->Load(path.c_str());
+			hash = voc->Hash();
+		}catch(...){
+			delete voc;
+			throw DUtils::DException("The vocabulary file cannot be read");
 		}
+		delete voc;
+
+		if(hash == m_voc.Hash()) Vocabulary::StoreHash(path.c_str(), hash);
 	}
 
+	if(hash != m_voc.Hash())
+		throw DUtils::DException("The vocabulary file has another vocabulary");
+}
+
+string Database::referencedVocPath(const char *filename, 
+	const string &voc_filename)
+{
+	const bool absolute = !voc_filename.empty() && 
+		(voc_filename[0] == '/' || voc_filename[0] == '\\' || 
+		(voc_filename.size() > 1 && voc_filename[1] == ':'));
+
+	if(absolute) return voc_filename;
+
+	const string db_filename = filename;
+	string::size_type i = db_filename.find_last_of("/\\");
+
+	if(i == string::npos) return voc_filename;
+	else return db_filename.substr(0, i + 1) + voc_filename;
+}
+
+void Database::readVocReference(DUtils::BinaryFile &f, 
+	VocParams::VocType &type, string &hash, string &voc_filename)
+{
+	int voctype, length;
+
+	f >> voctype;
+
+	hash.resize(16);
+	for(int i = 0; i < 16; i++) f >> hash[i];
+
+	f >> length;
+	if(f.Eof() || length <= 0 || length > VOC_REFERENCE_MAX_PATH)
+		throw DUtils::DException("Wrong vocabulary reference");
+
+	voc_filename.resize(length);
+	for(int i = 0; i < length; i++) f >> voc_filename[i];
+
+	if(f.Eof()) throw DUtils::DException("Wrong vocabulary reference");
+
+	type = (VocParams::VocType)voctype;
+}
+
+void Database::readVocReference(DUtils::TextFile &f, 
+	VocParams::VocType &type, string &hash, string &voc_filename)
+{
+	int voctype;
+
+	f >> voctype >> hash;
+	f.GetLine(voc_filename);
+
+	// the name starts after a space and may end with \r
+	string::size_type first = voc_filename.find_first_not_of(' ');
+	string::size_type last = voc_filename.find_last_not_of("\r");
+
+	if(f.Fail() || hash.size() != 16 || first == string::npos)
+		throw DUtils::DException("Wrong vocabulary reference");
+
+	voc_filename = voc_filename.substr(first, last - first + 1);
+	type = (VocParams::VocType)voctype;
+}
+
+bool Database::EndOfFile(DUtils::BinaryFile &f)
+{
+	return f.Eof();
 }
 
-void Database::initVoc(VocParams::VocType type, const Vocabulary *copy)
+bool Database::EndOfFile(DUtils::TextFile &f)
 {
-	delete m_voc;
+	return f.Fail();
+}
+
+Vocabulary* Database::createVoc(VocParams::VocType type, 
+	const Vocabulary *copy)
+{
+	Vocabulary *voc = NULL;
 	
 	switch(type){
 		case VocParams::HIERARCHICAL_VOC:
 
 			if(copy)
-				m_voc = new HVocabulary(
+				voc = new HVocabulary(
 					*(static_cast<const HVocabulary*>(copy)));
 			else
-				m_voc = new HVocabulary(HVocParams(2,1));
+				voc = new HVocabulary(HVocParams(2,1));
 
 			break;
 	}
 
+	if(!voc) throw DUtils::DException("Unknown vocabulary type");
+
+	return voc;
 }
 
@@ -10,12 +10,18 @@
 #define __D_DATABASE__
 
 #include "BowVector.h"
+#include "FeatureVector.h"
+#include "DescriptorView.h"
 #include "Vocabulary.h"
+#include "SharedVocabulary.h"
 #include "DbInfo.h"
 #include "DatabaseTypes.h"
 #include "QueryResults.h"
+#include "QueryContext.h"
+#include "EntryLog.h"
 #include <vector>
-#include <list>
+#include <map>
+#include <string>
 using namespace std;
 
 namespace DBow {
@@ -25,11 +31,20 @@ class Database
 public:
 
 	/**
-	 * Creates a database from the given vocabulary.
+	 * Creates a database from the given vocabulary. The database keeps
+	 * its own copy of it
 	 * @param voc vocabulary
 	 */
 	Database(const Vocabulary &voc);
 
+	/**
+	 * Creates a database that uses a shared vocabulary without copying it.
+	 * Copies of the database share it too
+	 * @param voc handle to the vocabulary
+	 * @throws DException if voc is empty
+	 */
+	Database(const SharedVocabulary &voc);
+
 	/**
 	 * Creates a database from a file
 	 * @param filename
@@ -41,6 +56,13 @@ public:
 	 */
 	virtual ~Database(void);
 
+	/**
+	 * Exchanges the content of two databases without copying them.
+	 * This moves a database into another one
+	 * @param db database
+	 */
+	void swap(Database &db);
+
 	/**
 	 * Retrieves infoa bout the database
 	 * @return db info
@@ -54,6 +76,13 @@ public:
 	 */
 	EntryId AddEntry(const vector<float> &features);
 
+	/**
+	 * Adds an entry to the database without copying its features
+	 * @param features view of the features of the image
+	 * @return id of the new entry
+	 */
+	EntryId AddEntry(const DescriptorView &features);
+
 	/**
 	 * Adds an entry to the database
 	 * @param v bow vector to add
@@ -81,6 +110,15 @@ public:
 	void Query(QueryResults &ret, const vector<float> &features, 
 		int max_results = 1) const;
 
+	/**
+	 * Queries the database with some features without copying them
+	 * @param ret (out) query results
+	 * @param features view of the query features
+	 * @param max_results number of results to return
+	 */
+	void Query(QueryResults &ret, const DescriptorView &features, 
+		int max_results = 1) const;
+
 	/**
 	 * Queries the database with a bow vector
 	 * @param ret (out) query results
@@ -90,6 +128,186 @@ public:
 	void Query(QueryResults &ret, const BowVector &v, 
 		int max_results = 1) const;
 
+	/**
+	 * Queries the database with some features, using the memory of the
+	 * given context. Once the context has grown enough, the query does not 
+	 * allocate memory if ret has enough capacity
+	 * @param ret (out) query results
+	 * @param features view of the query features
+	 * @param max_results number of results to return
+	 * @param context working memory of the query
+	 */
+	void Query(QueryResults &ret, const DescriptorView &features, 
+		int max_results, QueryContext &context) const;
+
+	/**
+	 * Queries the database with a bow vector, using the memory of the
+	 * given context
+	 * @param ret (out) query results
+	 * @param v vector to query with
+	 * @param max_results number of results to return
+	 * @param context working memory of the query
+	 * @see Query(QueryResults&, const DescriptorView&, int, QueryContext&)
+	 */
+	void Query(QueryResults &ret, const BowVector &v, 
+		int max_results, QueryContext &context) const;
+
+	/**
+	 * Queries the database with several bow vectors at once. Queries are
+	 * processed in groups that read the rows of their words only once,
+	 * and groups run in parallel. Results are those of Query, but their
+	 * scores may differ in the last digits (e.g. 1e-8), since the 
+	 * contributions of the words are added in another order, so entries
+	 * with almost the same score may be returned in another order.
+	 * Queries are not pruned, so this is faster than several calls to
+	 * Query when there are many queries with common words (e.g. to
+	 * evaluate a whole sequence offline), not for single queries
+	 * @param queries vectors to query with
+	 * @param ret (out) ret[i] are the results of queries[i]
+	 * @param max_results number of results to return for each query
+	 */
+	void QueryBatch(const vector<BowVector> &queries, 
+		vector<QueryResults> &ret, int max_results = 1) const;
+
+	/**
+	 * Queries the database with several bow vectors at once, keeping the
+	 * working memory in the given context. Each thread of the batch needs
+	 * a table of one item per entry; the one of the calling thread is 
+	 * kept in the context, so that it is not allocated again by later
+	 * batches
+	 * @param queries vectors to query with
+	 * @param ret (out) ret[i] are the results of queries[i]
+	 * @param max_results number of results to return for each query
+	 * @param context working memory of the queries
+	 * @see QueryBatch(const vector<BowVector>&, vector<QueryResults>&, int)
+	 */
+	void QueryBatch(const vector<BowVector> &queries, 
+		vector<QueryResults> &ret, int max_results, 
+		QueryContext &context) const;
+
+	/**
+	 * Enables or disables online weighting. With online weighting, the idf
+	 * of the words is computed from the entries of the database instead of
+	 * the images used to create the vocabulary, so that weights reflect
+	 * the data actually stored. The weights of all the entries are
+	 * updated when the number of entries grows by refresh_ratio since
+	 * the last update, or when RefreshWeights is called. Queries always
+	 * use the same weights as the stored entries. The weights in use are
+	 * saved with the database and restored when it is loaded.
+	 * Only makes sense with idf or tf-idf weighting
+	 * @param enable
+	 * @param refresh_ratio (default: 0.1) growth of the database that
+	 *    triggers an update of the weights
+	 * @throws DException if enabling it in a database loaded from an 
+	 *    older file, which has no term frequencies
+	 */
+	void SetOnlineWeighting(bool enable, double refresh_ratio = 0.1);
+
+	/**
+	 * Says whether online weighting is used
+	 * @return true iif online weighting is enabled
+	 */
+	inline bool OnlineWeighting() const { return m_online; }
+
+	/**
+	 * Computes the word weights again (only with online weighting) and
+	 * updates the values of all the entries accordingly
+	 */
+	void RefreshWeights();
+
+	/**
+	 * Enables or disables the direct index, which keeps the bow vector of
+	 * each entry, and optionally its features grouped by vocabulary node, 
+	 * so that they can be retrieved by entry id (e.g. to score them again
+	 * or to check the geometry of the results). If the database is not
+	 * empty, the bow vectors of its entries are recovered from the 
+	 * inverted file, but their features are not available
+	 * @param enable
+	 * @param level (default: 0) if > 0, the features of the entries added 
+	 *   from their descriptors are grouped by the node they go through at
+	 *   this level of the tree. Only for hierarchical vocabularies.
+	 *   @see HVocabulary::Transform
+	 */
+	void SetDirectIndex(bool enable, int level = 0);
+
+	/**
+	 * Says whether the direct index is kept
+	 * @return true iif the direct index is enabled
+	 */
+	inline bool DirectIndex() const { return m_direct_enabled; }
+
+	/**
+	 * Returns the level of the nodes the features are grouped by in the 
+	 * direct index
+	 * @return level, or 0 if features are not stored
+	 */
+	inline int DirectIndexLevel() const { return m_direct_level; }
+
+	/**
+	 * Returns the bow vector of an entry, as stored in the database.
+	 * The direct index must be enabled
+	 * @param id entry id
+	 * @param v (out) bow vector, with words in ascending order
+	 */
+	void RetrieveBowVector(EntryId id, BowVector &v) const;
+
+	/**
+	 * Returns the features of an entry grouped by vocabulary node.
+	 * The direct index must be enabled. fv is empty if the entry was not
+	 * added from its features, or the direct index does not store them
+	 * @param id entry id
+	 * @param fv (out) feature vector
+	 */
+	void RetrieveFeatureVector(EntryId id, FeatureVector &fv) const;
+
+	/**
+	 * Makes queries run in two stages. First, the candidates with the 
+	 * highest dot product with the query are retrieved from the inverted 
+	 * file, which is cheap to compute and to prune. Then, only these
+	 * candidates are scored with the scoring of the vocabulary, with the
+	 * vectors stored in the direct index. This speeds up the expensive 
+	 * scorings (KL, chi-square, L1, Bhattacharyya) at the risk of missing
+	 * results whose dot product is low. L2 and dot product queries are not
+	 * affected, since their ranking is already that of the dot product.
+	 * The direct index must be enabled. This setting is not saved
+	 * @param candidates number of candidates retrieved in the first stage 
+	 *   (at least max_results are always retrieved). 0 disables reranking
+	 */
+	void SetReranking(int candidates);
+
+	/**
+	 * Returns the number of candidates retrieved in the first stage of
+	 * queries
+	 * @return number of candidates, or 0 if reranking is disabled
+	 */
+	inline int Reranking() const { return m_rerank_candidates; }
+
+	/**
+	 * Adapts the vocabulary of the database to new data by splitting its
+	 * overloaded words, and updates the database accordingly.
+	 * Only hierarchical vocabularies can be adapted
+	 * @see HVocabulary::SplitWords
+	 * @see RemapWords
+	 * @param documents features of some new images
+	 * @param max_frequency frequency in per one units above which a word
+	 *    is split
+	 * @return number of words split
+	 */
+	int SplitWords(const vector<DescriptorView> &documents, 
+		float max_frequency);
+
+	/**
+	 * Updates the inverted file after some words of the vocabulary were
+	 * split. The features of the existing entries are not available to find
+	 * out the right new word, so that the value of a split word in an entry
+	 * is shared among the new words in the proportion of their frequencies.
+	 * Then, the entries are weighted with the new words (or just normalized
+	 * again, if they have no term frequencies). Entries added afterwards use
+	 * only the right word
+	 * @param splits splits[old word id] = ids of the words it was split into
+	 */
+	void RemapWords(const map<WordId, vector<WordId> > &splits);
+
 	/**
 	 * Saves the database along with the vocabulary in the given file
 	 * @param filename file
@@ -98,11 +316,116 @@ public:
 	void Save(const char *filename, bool binary = true) const;
 
 	/**
-	 * Loads the database from a file
+	 * Saves the database in the given file without the vocabulary, which
+	 * is only referenced by its file name and its content hash, so that 
+	 * several database files can share one vocabulary file:
+	 *
+	 *   db.Save("session1.db", "voc.bin"); 
+	 *   ...
+	 *   SharedVocabulary voc(new HVocabulary("voc.bin"));
+	 *   Database db1(voc), db2(voc);
+	 *   db1.Load("session1.db", voc); // checks the hash, does not read voc.bin
+	 *   db2.Load("session2.db", voc);
+	 *
+	 * @param filename file
+	 * @param voc_filename vocabulary file, absolute or relative to the 
+	 *   directory of filename. If it does not exist, the vocabulary is
+	 *   saved there in binary format. If it exists, its content hash is
+	 *   checked with the hash stored along with it (@see 
+	 *   Vocabulary::StoredHash). It is never overwritten
+	 * @param binary (default: true) store in binary format
+	 * @throws DException if voc_filename has a different vocabulary or 
+	 *   cannot be read as a vocabulary
+	 */
+	void Save(const char *filename, const char *voc_filename, 
+		bool binary = true) const;
+
+	/**
+	 * Loads the database from a file. If the file references a vocabulary
+	 * file, the vocabulary is read from it
 	 * @param filename
+	 * @throws DException if the file references a vocabulary file whose
+	 *   content has changed
 	 */
 	void Load(const char *filename);
 
+	/**
+	 * Loads the database from a file, but uses the given vocabulary instead
+	 * of the one stored in the file, so that several databases loaded from
+	 * files can share the same vocabulary. If the file references a 
+	 * vocabulary file, it is not read; the hash of voc is checked instead
+	 * @param filename
+	 * @param voc vocabulary. It must be the same as the one of the file
+	 * @throws DException if the vocabulary of the file is different
+	 */
+	void Load(const char *filename, const SharedVocabulary &voc);
+
+	/**
+	 * Returns the vocabulary file referenced by a database file 
+	 * @param filename database file
+	 * @return path of the vocabulary file, or empty if the vocabulary is
+	 *   stored in the database file
+	 * @see Save(const char*, const char*, bool)
+	 */
+	static string ReferencedVocabulary(const char *filename);
+
+	/**
+	 * Starts logging the entries added to the database in an append-only
+	 * file. Saving a log is much cheaper than saving the whole database,
+	 * so that a database can be saved often by calling Checkpoint, and 
+	 * only once in a while by calling Compact. It is recovered by loading
+	 * its last snapshot and replaying the log:
+	 *
+	 *   db.Load("map.db"); db.ReplayLog("map.log"); db.OpenLog("map.log");
+	 *
+	 * Only new entries are logged. After other changes (Clear, Load, 
+	 * SplitWords, RemapWords, SetOnlineWeighting, SetDirectIndex), 
+	 * entries are not logged until Compact is called. The entries the 
+	 * database had before opening the log must be in its snapshot
+	 * @param filename log file. If it exists, new records are appended
+	 * @throws DException if the log has entries that are not in the 
+	 *   database (it must be replayed first)
+	 */
+	void OpenLog(const char *filename);
+
+	/**
+	 * Stops logging entries, writing the pending records
+	 */
+	void CloseLog();
+
+	/**
+	 * Says whether entries are being logged
+	 * @return true iif there is a log open
+	 */
+	inline bool isLogOpen() const { return m_log.isOpen(); }
+
+	/**
+	 * Writes the log records that are still buffered to the log file and
+	 * syncs it to disk. Its cost depends on the entries added since the 
+	 * last checkpoint only
+	 * @throws DException if there is no log, if the database has
+	 *   changes that are not logged and must be saved with Compact, or if
+	 *   the log cannot be synced
+	 */
+	void Checkpoint();
+
+	/**
+	 * Saves the whole database in a snapshot file and empties the log
+	 * @param filename snapshot file. It is replaced when the new snapshot
+	 *   is complete and synced to disk
+	 * @param binary (default: true) store in binary format
+	 */
+	void Compact(const char *filename, bool binary = true);
+
+	/**
+	 * Adds the entries of a log that are not in the database yet
+	 * @param filename log file
+	 * @return number of entries added
+	 * @throws DException if the log does not follow the entries of the
+	 *   database
+	 */
+	unsigned int ReplayLog(const char *filename);
+
 	/**
 	 * Saves the vocabulary in a file
 	 * @param filename file to store the vocabulary in
@@ -121,46 +444,190 @@ public:
 		return *m_voc;
 	}
 
+	/**
+	 * Returns a handle to the vocabulary of this database, to create other
+	 * databases that share it
+	 * @return handle to the vocabulary
+	 */
+	inline SharedVocabulary SharedVoc() const {
+		return m_voc;
+	}
+
+	/**
+	 * Creates an instance of a vocabulary object of the given type
+	 * @param type type of vocabulary
+	 * @param copy (default: NULL) if given, the vocabulary
+	 *   is initiated as a copy of this vocabulary
+	 * @return new vocabulary, allocated with new
+	 * @throws DException if the type is unknown
+	 */
+	static Vocabulary* createVoc(VocParams::VocType type, 
+		const Vocabulary *copy = NULL);
+
 protected:
 
+	// shards are saved without checking the vocabulary file again
+	friend class ShardedDatabase;
+
 	/**
 	 * Saves the database in binary format
 	 * @param filename
+	 * @param voc_filename (default: NULL) if given, vocabulary file to
+	 *   reference instead of storing the vocabulary
+	 * @param check_voc (default: true) if false, voc_filename is assumed
+	 *   to have already been saved with the vocabulary of the database
 	 */
-	void SaveBinary(const char *filename) const;
+	void SaveBinary(const char *filename, const char *voc_filename = NULL,
+		bool check_voc = true) const;
 
 	/**
 	 * Saves the database in text format
 	 * @param filename
+	 * @param voc_filename (default: NULL) if given, vocabulary file to
+	 *   reference instead of storing the vocabulary
+	 * @param check_voc (default: true) if false, voc_filename is assumed
+	 *   to have already been saved with the vocabulary of the database
 	 */
-	void SaveText(const char *filename) const;
+	void SaveText(const char *filename, const char *voc_filename = NULL,
+		bool check_voc = true) const;
+
+	/**
+	 * Saves in binary format the vocabulary file referenced by a database
+	 * file, if it does not exist. If it exists, its stored hash is checked
+	 * against the vocabulary of the database. Files saved without it are
+	 * read once to compute it
+	 * @param filename database file
+	 * @param voc_filename vocabulary file
+	 * @throws DException if the file has a different vocabulary or cannot 
+	 *   be read as a vocabulary
+	 */
+	void saveReferencedVoc(const char *filename, const char *voc_filename) 
+		const;
 
 	/**
 	 * Loads the database from a binary file
 	 * @param filename
+	 * @param voc (default: NULL) if given, vocabulary to use instead of the
+	 *   one of the file
 	 */
-	void LoadBinary(const char *filename);
+	void LoadBinary(const char *filename, const SharedVocabulary *voc = NULL);
 
 	/**
 	 * Loads the database from a text file
 	 * @param filename
+	 * @param voc (default: NULL) if given, vocabulary to use instead of the
+	 *   one of the file
+	 */
+	void LoadText(const char *filename, const SharedVocabulary *voc = NULL);
+
+	/**
+	 * Sets the vocabulary read from a file, or the given one instead
+	 * @param loaded vocabulary read from a file
+	 * @param voc (default: NULL) if given, vocabulary to use instead of 
+	 *   loaded
+	 * @throws DException if voc is different from loaded
+	 */
+	void setLoadedVoc(const SharedVocabulary &loaded, 
+		const SharedVocabulary *voc);
+
+	/**
+	 * Sets the vocabulary referenced by a database file, or the given one
+	 * instead
+	 * @param filename database file
+	 * @param type type of the referenced vocabulary
+	 * @param hash content hash of the referenced vocabulary
+	 * @param voc_filename referenced vocabulary file
+	 * @param voc (default: NULL) if given, vocabulary to use instead of 
+	 *   reading voc_filename
+	 * @throws DException if the vocabulary is not the referenced one
+	 */
+	void setReferencedVoc(const char *filename, VocParams::VocType type,
+		const string &hash, const string &voc_filename, 
+		const SharedVocabulary *voc);
+
+	/**
+	 * Returns the path of a vocabulary file referenced by a database file
+	 * @param filename database file
+	 * @param voc_filename vocabulary file as stored in the database file
+	 * @return voc_filename if it is absolute, or voc_filename in the 
+	 *   directory of filename
+	 */
+	static string referencedVocPath(const char *filename, 
+		const string &voc_filename);
+
+	/**
+	 * Reads the vocabulary reference at the beginning of a database file
+	 * @param f file, positioned after the magic word (binary) or the
+	 *   keyword (text)
+	 * @param type (out) vocabulary type
+	 * @param hash (out) content hash of the vocabulary
+	 * @param voc_filename (out) vocabulary file
+	 * @throws DException if the reference is wrong
 	 */
-	void LoadText(const char *filename);
+	static void readVocReference(DUtils::BinaryFile &f, 
+		VocParams::VocType &type, string &hash, string &voc_filename);
+	static void readVocReference(DUtils::TextFile &f, 
+		VocParams::VocType &type, string &hash, string &voc_filename);
 
 	/**
 	 * Does the internal work to add an entry to the database
 	 * @param v vector to add (it is modified)
+	 * @param tf term frequency of each word of v
+	 * @param fv (default: NULL) features of the entry grouped by node, 
+	 *   to store in the direct index
 	 * @return added entry id
 	 */
-	EntryId _AddEntry(BowVector &v);
+	EntryId _AddEntry(BowVector &v, const vector<float> &tf, 
+		const FeatureVector *fv = NULL);
+
+	/**
+	 * Builds the words of the direct index from the inverted file
+	 */
+	void BuildDirectIndex();
 
 	/**
 	 * Does the internal work to query the database
 	 * @param ret (out) query results
-	 * @param v bow vector (it is modified)
 	 * @param max_results returns only this number of results
+	 * @param context context with the query vector and its term 
+	 *   frequencies (it is modified)
+	 */
+	void _Query(QueryResults &ret, int max_results, 
+		QueryContext &context) const;
+
+	/**
+	 * Weights and normalizes a query vector as the entries of the database
+	 * @param v bow vector (it is modified)
+	 * @param tf term frequency of each word of v
+	 */
+	void PrepareQuery(BowVector &v, const vector<float> &tf) const;
+
+	/**
+	 * Computes the term frequency of the words of a bow vector, as the
+	 * vocabulary does
+	 * @param v bow vector
+	 * @param words words of all the features of the image. They are sorted
+	 * @param tf (out) tf[i] is the term frequency of word v[i].id
 	 */
-	void _Query(QueryResults &ret, BowVector &v, int max_results) const;
+	void GetTermFrequencies(const BowVector &v, vector<WordId> &words,
+		vector<float> &tf) const;
+
+	/**
+	 * Recovers the term frequency of the words of a weighted bow vector
+	 * by dividing by the word weights. This is not possible for words with
+	 * weight 0, whose tf is set to 0
+	 * @param v bow vector
+	 * @param tf (out) tf[i] is the term frequency of word v[i].id
+	 */
+	void RecoverTermFrequencies(const BowVector &v, vector<float> &tf) const;
+
+	/**
+	 * Returns the value of a word in a vector before normalizing
+	 * @param tf term frequency of the word
+	 * @param weight weight of the word
+	 * @return value
+	 */
+	inline WordValue WeightedValue(float tf, WordValue weight) const;
 	
 protected:
 
@@ -170,10 +637,12 @@ protected:
 
 	struct IFEntry{
 		EntryId id;
+		float tf; // term frequency, to weight the entry again
 		WordValue value;
 
-		IFEntry(EntryId _id, WordValue _value){
+		IFEntry(EntryId _id, WordValue _value, float _tf = 0){
 			id = _id;
+			tf = _tf;
 			value = _value;
 		}
 
@@ -183,9 +652,52 @@ protected:
 		 * @return true iif ids are the same
 		 */
 		inline bool operator==(const IFEntry &e) const { return id == e.id; }
+
+		/**
+		 * Compares the id of the entry with the given one
+		 * @param _id entry id
+		 * @return true iif id < _id
+		 */
+		inline bool operator<(EntryId _id) const { return id < _id; }
 	};
 
-	typedef list<IFEntry> IFRow;
+	// Summary of a block of consecutive entries of a row
+	struct IFBlock{
+		EntryId first_id; // id of the first entry of the block
+		EntryId last_id; // id of the last entry of the block
+		WordValue max_value; // maximum value of the entries of the block
+	};
+
+	// Entries of a row are sorted by id, and grouped in blocks of 
+	// IF_BLOCK_SIZE consecutive entries
+	class IFRow: public vector<IFEntry>
+	{
+	public:
+		// blocks[b] summarizes the entries [b * IF_BLOCK_SIZE, 
+		// (b+1) * IF_BLOCK_SIZE) of the row
+		vector<IFBlock> blocks;
+
+		IFRow(){}
+		~IFRow(){}
+
+		/**
+		 * Adds an entry at the end of the row and updates its blocks
+		 * @param e entry with an id higher than those in the row
+		 */
+		void Append(const IFEntry &e);
+
+		/**
+		 * Computes the blocks of the row again. Must be called after
+		 * modifying the entries without Append
+		 */
+		void UpdateBlocks();
+
+		/**
+		 * Returns the maximum value of the entries of the row
+		 * @return max value, or 0 if the row is empty
+		 */
+		WordValue MaxValue() const;
+	};
 
 	// InvertedFile[wordid] = [ <docid,value>, ... ]
 	class InvertedFile: public vector<IFRow>
@@ -197,8 +709,9 @@ protected:
 
 protected:
 
-	// Vocabulary associated to this database
-	Vocabulary *m_voc;
+	// Vocabulary associated to this database. It may be shared with other
+	// databases, so it must not be modified
+	SharedVocabulary m_voc;
 
 	// Inverted file 
 	InvertedFile m_index;
@@ -206,16 +719,58 @@ protected:
 	// Number of entries in the db
 	unsigned int m_nentries;
 
-private:
+	// Online weighting enabled
+	bool m_online;
+
+	// Growth of the db that triggers an update of the online weights
+	double m_refresh_ratio;
+
+	// Word weights computed from the entries (only with online weighting)
+	vector<WordValue> m_online_weights;
+
+	// Number of entries when m_online_weights were computed
+	unsigned int m_weighted_entries;
+
+	// Says if the tf of the entries is known (it is not if they were 
+	// loaded from an old file)
+	bool m_tf_available;
 
 	/**
-	 * Creates an instance of a vocabulary object
-	 * depending on the header of the given filename
-	 * @param type type of vocabulary
-	 * @param copy (default: NULL) if given, the vocabulary
-	 *   is initiated as a copy of this vocabulary
+	 * Direct file types
 	 */
-	void initVoc(VocParams::VocType type, const Vocabulary *copy = NULL);
+
+	// Words and features of the entries, stored contiguously
+	struct DirectFile{
+		// words[word_offsets[i] .. word_offsets[i+1]) are the words of 
+		// entry i, in ascending order of id
+		vector<unsigned int> word_offsets;
+		vector<BowVectorEntry> words;
+
+		// features[feature_offsets[i] .. feature_offsets[i+1]) are the pairs
+		// <node id, feature index> of entry i, in ascending order of node
+		vector<unsigned int> feature_offsets;
+		vector<pair<NodeId, unsigned int> > features;
+	};
+
+	// Direct index enabled
+	bool m_direct_enabled;
+
+	// Level of the nodes of the features in the direct index (0 for none)
+	int m_direct_level;
+
+	// Direct file
+	DirectFile m_direct;
+
+	// Candidates of the first stage of queries (0 for single-stage queries)
+	int m_rerank_candidates;
+
+	// Log of the entries added since the last snapshot
+	EntryLog m_log;
+
+	// The log misses some changes and needs a snapshot
+	bool m_log_stale;
+
+private:
 
 	/**
 	 * Loads the database from a filename
@@ -224,25 +779,149 @@ private:
 	 */
 	template<class T> void _load(T& f);
 
+	/**
+	 * Reads the rows of the inverted file, one by one
+	 * @param f file stream, after the number of rows
+	 * @param nrows number of rows in the file
+	 */
+	template<class T> void readRows(T &f, int nrows);
+
+	/**
+	 * Reads the rows of the inverted file from a text file. Each row is
+	 * in a line, so that lines are parsed by several threads. If the rows
+	 * are not one per line, they are read one by one
+	 * @see readRows(T&, int)
+	 */
+	void readRows(DUtils::TextFile &f, int nrows);
+
+	/**
+	 * Says if the last read operation on a file failed by reaching its end
+	 * @param f file
+	 * @return true iif the end was reached
+	 */
+	static bool EndOfFile(DUtils::BinaryFile &f);
+	static bool EndOfFile(DUtils::TextFile &f);
+
+	/**
+	 * Stops logging entries until the next snapshot, because the database
+	 * has changed in a way the log cannot record
+	 */
+	inline void invalidateLog() { if(m_log.isOpen()) m_log_stale = true; }
+
+	/**
+	 * Computes the blocks of every row of the inverted file
+	 */
+	void UpdateBlocks();
+
+	/**
+	 * Normalizes the values of some entries, if the scoring requires it
+	 * @param entries entries[i] is true if the entry i must be normalized
+	 */
+	void normalizeEntries(const vector<bool> &entries);
+
+	/**
+	 * Accumulates the contributions of the entries sharing words with
+	 * the query, and leaves in ret the best max_results of them, sorted in
+	 * descending order. Query words are processed by decreasing upper bound
+	 * of their contribution (i.e. rarer words first). When the words left
+	 * cannot make an unseen entry reach the current top results, new
+	 * entries are no longer considered, candidates that cannot reach the
+	 * top are dropped, and long rows are probed by binary search instead
+	 * of being scanned (MaxScore, Turtle and Flood, 1995). The blocks of the
+	 * rows are used to skip the entries that are not candidates, and to
+	 * drop candidates whose block max value is not enough to reach the top
+	 * (Ding and Suel, 2011). Results are the same as without pruning.
+	 * TContribution::Value(q, d) must return the contribution of a word 
+	 * with value q in the query and d in an entry, the higher the better,
+	 * and must be non-negative and non-decreasing in d
+	 * @param v bow vector to query (already normalized if necessary)
+	 * @param ret allocated and empty vector to store the results in
+	 * @param max_results maximum number of results in ret
+	 * @param context working memory
+	 */
+	template<class TContribution>
+	void doQuery(const BowVector &v, QueryResults &ret, 
+		const int max_results, QueryContext &context) const;
+
+	/**
+	 * Queries in two stages: retrieves the best m_rerank_candidates entries
+	 * by dot product and scores them again with TContribution and the 
+	 * vectors of the direct index. Leaves in ret the best max_results of
+	 * them, in descending order
+	 * @param v bow vector to query (already normalized if necessary), 
+	 *   in ascending order of word id
+	 * @param ret allocated and empty vector to store the results in
+	 * @param max_results maximum number of results in ret
+	 * @param context working memory
+	 */
+	template<class TContribution>
+	void doRerankedQuery(const BowVector &v, QueryResults &ret, 
+		const int max_results, QueryContext &context) const;
+
+	/**
+	 * Scores the given results again with TContribution and the vectors of
+	 * the direct index. Leaves in ret the best max_results of them, in
+	 * descending order
+	 * @param v bow vector of the query (already normalized if necessary),
+	 *   in ascending order of word id
+	 * @param ret candidates
+	 * @param max_results maximum number of results in ret
+	 */
+	template<class TContribution>
+	void RescoreCandidates(const BowVector &v, QueryResults &ret, 
+		const int max_results) const;
+
+	/**
+	 * Performs several queries sharing the scan of the rows
+	 * @param queries bow vectors (already normalized if necessary), in
+	 *   ascending order of word id
+	 * @param ret results of each query, allocated and empty
+	 * @param max_results maximum number of results of each query
+	 * @param rerank if true, the queries run in two stages
+	 * @param context working memory of the calling thread
+	 * @see doRerankedQuery
+	 */
+	template<class TContribution>
+	void doBatchQuery(const vector<BowVector> &queries, 
+		vector<QueryResults> &ret, const int max_results, 
+		const bool rerank, QueryContext &context) const;
+
+	/**
+	 * Turns the accumulated contributions of the results into the final
+	 * scores of the given scoring type
+	 * @param ret results in descending order of accumulated contribution
+	 * @param scoring scoring type
+	 * @param scale_score says if score must be scaled (if applicable)
+	 */
+	static void CompleteScores(QueryResults &ret, 
+		VocParams::ScoringType scoring, bool scale_score);
+
 	/**
 	 * Performs several kinds of queries
 	 * @param v bow vector to query (already normalized if necessary)
 	 * @param ret allocated and empty vector to store the results in
 	 * @param max_results maximum number of results in ret
 	 * @param scale_score says if score must be scaled in the end (if applicable)
+	 * @param context working memory
 	 */
 	void doQueryL1(const BowVector &v, QueryResults &ret, 
-		const int max_results, const bool scale_score) const;
+		const int max_results, const bool scale_score, 
+		QueryContext &context) const;
 	void doQueryL2(const BowVector &v, QueryResults &ret, 
-			const int max_results, const bool scale_score) const;
+		const int max_results, const bool scale_score, 
+		QueryContext &context) const;
 	void doQueryChiSquare(const BowVector &v, QueryResults &ret, 
-		const int max_results, const bool scale_score) const;
+		const int max_results, const bool scale_score, 
+		QueryContext &context) const;
 	void doQueryKL(const BowVector &v, QueryResults &ret, 
-		const int max_results, const bool scale_score) const;
+		const int max_results, const bool scale_score, 
+		QueryContext &context) const;
 	void doQueryBhattacharyya(const BowVector &v, QueryResults &ret, 
-		const int max_results, const bool scale_score) const;
+		const int max_results, const bool scale_score, 
+		QueryContext &context) const;
 	void doQueryDotProduct(const BowVector &v, QueryResults &ret, 
-		const int max_results, const bool scale_score) const;
+		const int max_results, const bool scale_score, 
+		QueryContext &context) const;
 
 };
 
@@ -253,33 +932,84 @@ private:
 inline DBow::EntryId DBow::Database::AddEntry(const DBow::BowVector &v)
 {
 	DBow::BowVector w = v;
-	return _AddEntry(w);
+	vector<float> tf;
+	RecoverTermFrequencies(w, tf);
+	return _AddEntry(w, tf);
 }
 
 inline DBow::EntryId DBow::Database::AddEntry(const vector<float>& features)
 {
-	DBow::BowVector v;
-	m_voc->Transform(features, v, false);
-	return _AddEntry(v);
+	return AddEntry(DBow::DescriptorView(features, m_voc->DescriptorLength()));
 }
 
 inline void
 DBow::Database::Query(DBow::QueryResults &ret, const vector<float> &features, 
 				int max_results) const
 {
-	DBow::BowVector v;
-	m_voc->Transform(features, v, false);
-	_Query(ret, v, max_results);
+	Query(ret, DBow::DescriptorView(features, m_voc->DescriptorLength()), 
+		max_results);
+}
+
+inline void
+DBow::Database::Query(DBow::QueryResults &ret, 
+				const DBow::DescriptorView &features, int max_results) const
+{
+	DBow::QueryContext context;
+	Query(ret, features, max_results, context);
+}
+
+inline void
+DBow::Database::QueryBatch(const vector<DBow::BowVector> &queries, 
+				vector<DBow::QueryResults> &ret, int max_results) const
+{
+	DBow::QueryContext context;
+	QueryBatch(queries, ret, max_results, context);
 }
 
 inline void
 DBow::Database::Query(DBow::QueryResults &ret, const DBow::BowVector &v, 
 				int max_results) const
 {
-	DBow::BowVector w = v;
-	_Query(ret, w, max_results);
+	DBow::QueryContext context;
+	Query(ret, v, max_results, context);
 }
 
+inline void
+DBow::Database::Query(DBow::QueryResults &ret, 
+				const DBow::DescriptorView &features, int max_results,
+				DBow::QueryContext &context) const
+{
+	if(m_voc->Type() == VocParams::HIERARCHICAL_VOC){
+		static_cast<const HVocabulary*>(m_voc.get())->Transform(features, 
+			context.m_v, context.m_words, context.m_leaves, context.m_beam, 
+			false);
+	}else{
+		m_voc->Transform(features, context.m_v, context.m_words, false);
+	}
+	GetTermFrequencies(context.m_v, context.m_words, context.m_tf);
+	_Query(ret, max_results, context);
+}
+
+inline void
+DBow::Database::Query(DBow::QueryResults &ret, const DBow::BowVector &v, 
+				int max_results, DBow::QueryContext &context) const
+{
+	context.m_v = v;
+	RecoverTermFrequencies(context.m_v, context.m_tf);
+	_Query(ret, max_results, context);
+}
+
+
+inline DBow::WordValue 
+DBow::Database::WeightedValue(float tf, DBow::WordValue weight) const
+{
+	switch(m_voc->Weighting()){
+		case VocParams::TF_IDF: return tf * weight;
+		case VocParams::IDF: return weight;
+		case VocParams::TF: return tf;
+		default: return 1; // BINARY
+	}
+}
 
 #endif
 
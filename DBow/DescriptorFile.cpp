@@ -0,0 +1,130 @@
+/**
+ * File: DescriptorFile.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: reads and writes feature descriptors in binary files
+ */
+
+#include "DescriptorFile.h"
+#include "DUtils.h"
+
+#include <cassert>
+#include <fstream>
+#include <vector>
+using namespace std;
+
+using namespace DBow;
+
+// Maximum number of values of a document, to reject corrupted counts
+#define DESCRIPTOR_FILE_MAX_ITEMS (1 << 28)
+
+// Format:
+// XX D
+// N_0 d_0_0_0 ... d_0_0_(D-1) ... d_0_(N_0-1)_(D-1)
+// ...
+//
+// Where:
+// XX (byte): magic word (byte with value 0) to identify the binary file
+// D (int32): descriptor length
+// N_i (int32): number of features of the i-th document
+// d_i_j_k (float32): k-th value of the j-th descriptor of the i-th document
+//
+// Documents are read until the end of the file
+
+DescriptorFile::DescriptorFile(void): m_desc_length(0)
+{
+}
+
+DescriptorFile::DescriptorFile(const char *filename): m_desc_length(0)
+{
+	OpenForReading(filename);
+}
+
+DescriptorFile::~DescriptorFile(void)
+{
+	Close();
+}
+
+void DescriptorFile::Close()
+{
+	m_f.Close();
+}
+
+void DescriptorFile::OpenForReading(const char *filename)
+{
+	m_f.OpenForReading(filename);
+	m_f.DiscardNextByte(); // magic word
+	m_f >> m_desc_length;
+
+	if(m_f.Eof() || m_desc_length <= 0)
+		throw DUtils::DException(string("Wrong descriptor file ") + filename);
+}
+
+void DescriptorFile::OpenForWriting(const char *filename, int desc_length)
+{
+	assert(desc_length > 0);
+
+	m_f.OpenForWriting(filename);
+	m_desc_length = desc_length;
+	m_f << '\0' << m_desc_length;
+}
+
+void DescriptorFile::OpenForAppending(const char *filename, int desc_length)
+{
+	fstream test(filename, ios::in | ios::binary);
+	bool exists = test.is_open();
+	test.close();
+
+	if(!exists){
+		OpenForWriting(filename, desc_length);
+	}else{
+		// the new descriptors must be like the ones in the file
+		int stored_length;
+		{
+			DescriptorFile f(filename);
+			stored_length = f.DescriptorLength();
+		}
+		if(stored_length != desc_length)
+			throw DUtils::DException(string("Wrong descriptor length in ") + 
+				filename);
+
+		m_f.OpenForAppending(filename);
+		m_desc_length = desc_length;
+	}
+}
+
+void DescriptorFile::Write(const DescriptorView &features)
+{
+	assert(features.empty() || features.Cols() == m_desc_length);
+
+	m_f << features.Rows();
+
+	if(features.Stride() == features.Cols()){
+		m_f.Write(features[0], features.Rows() * m_desc_length);
+	}else{
+		for(int i = 0; i < features.Rows(); i++)
+			m_f.Write(features[i], m_desc_length);
+	}
+}
+
+bool DescriptorFile::Read(vector<float> &features)
+{
+	int n;
+	m_f >> n;
+
+	if(m_f.Eof()){
+		features.resize(0);
+		return false;
+	}
+
+	if(n < 0 || n > DESCRIPTOR_FILE_MAX_ITEMS / m_desc_length)
+		throw DUtils::DException("Wrong number of features in descriptor file");
+
+	features.resize(n * m_desc_length);
+	if(n > 0) m_f.Read(&features[0], n * m_desc_length);
+
+	if(m_f.Eof()) throw DUtils::DException("Unexpected end of descriptor file");
+
+	return true;
+}
+
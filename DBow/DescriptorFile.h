@@ -0,0 +1,119 @@
+/**
+ * File: DescriptorFile.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: reads and writes feature descriptors in binary files,
+ *   one document (image) at a time, so that large sets of training 
+ *   features can be processed without loading them in memory
+ */
+
+#pragma once
+#ifndef __D_DESCRIPTOR_FILE__
+#define __D_DESCRIPTOR_FILE__
+
+#include "DescriptorView.h"
+#include "DUtils.h"
+
+#include <vector>
+using namespace std;
+
+namespace DBow {
+
+	class DescriptorFile
+	{
+	public:
+
+		/**
+		 * Creates an object with no file
+		 */
+		DescriptorFile(void);
+
+		/**
+		 * Opens a file for reading
+		 * @param filename
+		 * @throws DException if the file cannot be opened
+		 */
+		DescriptorFile(const char *filename);
+
+		/**
+		 * Closes any opened file
+		 */
+		~DescriptorFile(void);
+
+		/**
+		 * Opens a file for reading. It closes any other opened file
+		 * @param filename
+		 * @throws DException if the file cannot be opened
+		 */
+		void OpenForReading(const char *filename);
+
+		/**
+		 * Creates a file for writing. It closes any other opened file
+		 * @param filename
+		 * @param desc_length length of the descriptors of the file
+		 * @throws DException if the file cannot be created
+		 */
+		void OpenForWriting(const char *filename, int desc_length);
+
+		/**
+		 * Opens a file for writing at the end. If the file does not exist,
+		 * it is created. It closes any other opened file
+		 * @param filename
+		 * @param desc_length length of the descriptors of the file
+		 * @throws DException if the file cannot be opened or has descriptors
+		 *    of another length
+		 */
+		void OpenForAppending(const char *filename, int desc_length);
+
+		/**
+		 * Closes the file. It is not necessary to call this function 
+		 * explicitly
+		 */
+		void Close();
+
+		/**
+		 * Returns the length of the descriptors of the file
+		 * @return descriptor length
+		 */
+		inline int DescriptorLength() const { return m_desc_length; }
+
+		/**
+		 * Appends the features of a document to the file
+		 * @param features features of the document. Its number of cols must 
+		 *    be the descriptor length of the file
+		 * @throws DException if wrong access mode
+		 */
+		void Write(const DescriptorView &features);
+
+		/**
+		 * Appends the features of a document to the file
+		 * @param features features in the OpenCV format
+		 * @throws DException if wrong access mode
+		 */
+		inline void Write(const vector<float> &features)
+		{
+			Write(DescriptorView(features, m_desc_length));
+		}
+
+		/**
+		 * Reads the features of the next document of the file
+		 * @param features (out) features in the OpenCV format
+		 * @return false iif there are no more documents in the file
+		 * @throws DException if wrong access mode or the file is corrupted
+		 */
+		bool Read(vector<float> &features);
+
+	protected:
+
+		// Underlying file
+		DUtils::BinaryFile m_f;
+
+		// Descriptor length
+		int m_desc_length;
+
+	};
+
+}
+
+#endif
+
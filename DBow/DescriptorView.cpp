@@ -0,0 +1,41 @@
+/**
+ * File: DescriptorView.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: non-owning view of a matrix of feature descriptors
+ */
+
+#include "DescriptorView.h"
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+using namespace DBow;
+
+DescriptorView::DescriptorView(void):
+	m_data(NULL), m_rows(0), m_cols(0), m_stride(0)
+{
+}
+
+DescriptorView::DescriptorView(const float *data, int rows, int cols,
+	int stride):
+	m_data(data), m_rows(rows), m_cols(cols),
+	m_stride(stride > 0 ? stride : cols)
+{
+	assert(rows == 0 || data != NULL);
+	assert(m_stride >= cols);
+}
+
+DescriptorView::DescriptorView(const vector<float> &features, int cols):
+	m_data(features.empty() ? NULL : &features[0]), m_cols(cols), m_stride(cols)
+{
+	assert(cols > 0 && features.size() % cols == 0);
+	m_rows = (cols > 0 ? features.size() / cols : 0);
+}
+
+DescriptorView::~DescriptorView(void)
+{
+}
+
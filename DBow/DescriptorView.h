@@ -0,0 +1,118 @@
+/**
+ * File: DescriptorView.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: non-owning view of a matrix of feature descriptors
+ *
+ * Note: a view does not copy the descriptors, it only points to them.
+ *   The memory must remain valid while the view is used.
+ *   Each row of the matrix is a descriptor of Cols() floats. Rows may
+ *   be separated by some padding (stride), so that views can be created
+ *   on top of cv::Mat objects or custom arenas without copying data:
+ *
+ *     cv::Mat m; // CV_32F, one descriptor per row
+ *     DescriptorView view(m.ptr<float>(), m.rows, m.cols, m.step1());
+ */
+
+#pragma once
+#ifndef __D_DESCRIPTOR_VIEW__
+#define __D_DESCRIPTOR_VIEW__
+
+#include <vector>
+using namespace std;
+
+namespace DBow {
+
+	class DescriptorView
+	{
+	public:
+
+		/**
+		 * Creates an empty view
+		 */
+		DescriptorView(void);
+
+		/**
+		 * Creates a view of a descriptor matrix
+		 * @param data pointer to the first float of the first descriptor
+		 * @param rows number of descriptors
+		 * @param cols descriptor length
+		 * @param stride (default: 0) number of floats between the beginning
+		 *    of two consecutive descriptors. 0 means cols (no padding)
+		 */
+		DescriptorView(const float *data, int rows, int cols, int stride = 0);
+
+		/**
+		 * Creates a view of features in the OpenCV format (all the
+		 * descriptors concatenated in a single vector)
+		 * @param features features. Its size must be multiple of cols
+		 * @param cols descriptor length
+		 */
+		DescriptorView(const vector<float> &features, int cols);
+
+		/**
+		 * Destructor
+		 */
+		~DescriptorView(void);
+
+		/**
+		 * Returns a pointer to the i-th descriptor
+		 * @param i row index
+		 * @return pointer to the first float of the descriptor
+		 */
+		inline const float* Row(int i) const {
+			return m_data + i * m_stride;
+		}
+
+		/**
+		 * Returns a pointer to the i-th descriptor
+		 * @see Row
+		 */
+		inline const float* operator[](int i) const {
+			return Row(i);
+		}
+
+		/**
+		 * Returns the number of descriptors
+		 * @return number of rows
+		 */
+		inline int Rows() const { return m_rows; }
+
+		/**
+		 * Returns the descriptor length
+		 * @return number of cols
+		 */
+		inline int Cols() const { return m_cols; }
+
+		/**
+		 * Returns the number of floats between two consecutive descriptors
+		 * @return stride
+		 */
+		inline int Stride() const { return m_stride; }
+
+		/**
+		 * Says whether the view contains no descriptors
+		 * @return true iif there are no rows
+		 */
+		inline bool empty() const { return m_rows == 0; }
+
+	protected:
+
+		// Beginning of the first descriptor
+		const float *m_data;
+
+		// Number of descriptors
+		int m_rows;
+
+		// Descriptor length
+		int m_cols;
+
+		// Floats between the beginning of two consecutive rows
+		int m_stride;
+
+	};
+
+}
+
+#endif
+
@@ -0,0 +1,270 @@
+/**
+ * File: EntryLog.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: append-only log of the entries added to a database
+ */
+
+#include "EntryLog.h"
+#include "DatabaseTypes.h"
+#include "BowVector.h"
+#include "FeatureVector.h"
+#include "DUtils.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+using namespace std;
+
+using namespace DBow;
+
+// Mark at the beginning of each record ("DBLG")
+#define LOG_RECORD_MARK 0x44424c47
+
+// Maximum number of items of a record, to reject corrupted data
+#define LOG_MAX_ITEMS (1 << 26)
+
+// ---------------------------------------------------------------------------
+
+EntryLog::EntryLog(void): m_file(NULL)
+{
+}
+
+EntryLog::EntryLog(const EntryLog &): m_file(NULL)
+{
+}
+
+EntryLog::~EntryLog(void)
+{
+	Close();
+}
+
+EntryLog& EntryLog::operator=(const EntryLog &log)
+{
+	if(this != &log) Close();
+	return *this;
+}
+
+void EntryLog::swap(EntryLog &log)
+{
+	DUtils::BinaryFile *f = m_file;
+	m_file = log.m_file;
+	log.m_file = f;
+
+	m_filename.swap(log.m_filename);
+}
+
+// ---------------------------------------------------------------------------
+
+EntryId EntryLog::Open(const char *filename)
+{
+	Close();
+
+	// find the end of the last complete record
+	unsigned int valid_bytes = 0;
+	unsigned int file_bytes = 0;
+	EntryId next = 0;
+
+	fstream test(filename, ios::in | ios::binary);
+	if(test.is_open()){
+		test.seekg(0, ios::end);
+		file_bytes = (unsigned int)test.tellg();
+		test.close();
+
+		DUtils::BinaryFile f(filename, DUtils::READ);
+		EntryId id;
+		BowVector v;
+		vector<float> tf;
+		FeatureVector fv;
+
+		while(ReadRecord(f, id, v, tf, fv)){
+			valid_bytes = f.BytesRead();
+			next = id + 1;
+		}
+	}
+
+	if(valid_bytes < file_bytes){
+		// remove the incomplete record by copying the others
+		string tmp = string(filename) + ".tmp";
+		{
+			fstream in(filename, ios::in | ios::binary);
+			fstream out(tmp.c_str(), ios::out | ios::binary);
+			if(!out.is_open()) throw DUtils::DException("Cannot repair log");
+
+			vector<char> buf(64 * 1024);
+			unsigned int left = valid_bytes;
+			while(left > 0){
+				unsigned int n = (left < buf.size() ? left : buf.size());
+				in.read(&buf[0], n);
+				out.write(&buf[0], n);
+				left -= n;
+			}
+		}
+		SyncFile(tmp.c_str());
+
+#ifdef WIN32
+		remove(filename);
+#endif
+		if(rename(tmp.c_str(), filename) != 0)
+			throw DUtils::DException("Cannot repair log");
+		SyncDirectory(filename);
+	}
+
+	m_file = new DUtils::BinaryFile;
+	try{
+		m_file->OpenForAppending(filename);
+	}catch(...){
+		delete m_file;
+		m_file = NULL;
+		throw;
+	}
+	m_filename = filename;
+
+	return next;
+}
+
+void EntryLog::Close()
+{
+	if(m_file){
+		m_file->Close();
+		delete m_file;
+		m_file = NULL;
+	}
+	m_filename.clear();
+}
+
+void EntryLog::Flush()
+{
+	if(!m_file) throw DUtils::DException("The log is not open");
+	m_file->Flush();
+	SyncFile(m_filename.c_str());
+}
+
+void EntryLog::Clear()
+{
+	if(!m_file) throw DUtils::DException("The log is not open");
+	m_file->OpenForWriting(m_filename.c_str());
+	SyncFile(m_filename.c_str());
+}
+
+// ---------------------------------------------------------------------------
+
+void EntryLog::SyncFile(const char *filename)
+{
+	// the file is opened again because fstream does not give its descriptor
+#ifdef WIN32
+	int fd = _open(filename, _O_RDWR | _O_BINARY);
+	bool ok = (fd >= 0 && _commit(fd) == 0);
+	if(fd >= 0) _close(fd);
+#else
+	int fd = open(filename, O_RDONLY);
+	bool ok = (fd >= 0 && fsync(fd) == 0);
+	if(fd >= 0) close(fd);
+#endif
+
+	if(!ok) throw DUtils::DException("Cannot sync file");
+}
+
+void EntryLog::SyncDirectory(const char *filename)
+{
+#ifndef WIN32
+	string dir = filename;
+	string::size_type i = dir.find_last_of('/');
+	if(i == string::npos) dir = ".";
+	else if(i == 0) dir = "/";
+	else dir = dir.substr(0, i);
+
+	int fd = open(dir.c_str(), O_RDONLY);
+	bool ok = (fd >= 0 && fsync(fd) == 0);
+	if(fd >= 0) close(fd);
+
+	if(!ok) throw DUtils::DException("Cannot sync directory");
+#endif
+}
+
+// ---------------------------------------------------------------------------
+
+void EntryLog::Append(EntryId id, const BowVector &v, const vector<float> &tf,
+	const FeatureVector *fv)
+{
+	if(!m_file) throw DUtils::DException("The log is not open");
+
+	DUtils::BinaryFile &f = *m_file;
+
+	f << (int)LOG_RECORD_MARK << (int)id << (int)v.size();
+	for(unsigned int i = 0; i < v.size(); i++){
+		f << (int)v[i].id << (double)v[i].value << tf[i];
+	}
+
+	if(fv){
+		f << (int)fv->size();
+
+		FeatureVector::const_iterator fit;
+		for(fit = fv->begin(); fit != fv->end(); ++fit){
+			f << (int)fit->first << (int)fit->second.size();
+			for(unsigned int i = 0; i < fit->second.size(); i++)
+				f << (int)fit->second[i];
+		}
+	}else{
+		f << 0;
+	}
+
+	// a record is complete only if it ends with its id
+	f << (int)id;
+}
+
+bool EntryLog::ReadRecord(DUtils::BinaryFile &f, EntryId &id,
+	BowVector &v, vector<float> &tf, FeatureVector &fv)
+{
+	int mark, n, end;
+
+	f >> mark;
+	if(f.Eof() || mark != LOG_RECORD_MARK) return false;
+
+	int iid;
+	f >> iid >> n;
+	if(f.Eof() || n < 0 || n > LOG_MAX_ITEMS) return false;
+	id = (EntryId)iid;
+
+	v.resize(n);
+	tf.resize(n);
+	for(int i = 0; i < n; i++){
+		int wid;
+		double value;
+		f >> wid >> value >> tf[i];
+		v[i].id = (WordId)wid;
+		v[i].value = value;
+	}
+
+	fv.clear();
+	int nnodes;
+	f >> nnodes;
+	if(f.Eof() || nnodes < 0 || nnodes > LOG_MAX_ITEMS) return false;
+
+	for(int i = 0; i < nnodes && !f.Eof(); i++){
+		int node, k;
+		f >> node >> k;
+		if(f.Eof() || k < 0 || k > LOG_MAX_ITEMS) return false;
+
+		vector<unsigned int> &features = fv[(NodeId)node];
+		features.resize(k);
+		for(int j = 0; j < k; j++){
+			int idx;
+			f >> idx;
+			features[j] = (unsigned int)idx;
+		}
+	}
+
+	f >> end;
+	return !f.Eof() && end == iid;
+}
+
@@ -0,0 +1,156 @@
+/**
+ * File: EntryLog.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: append-only log of the entries added to a database
+ *
+ * Note: each record keeps what a database needs to add an entry again:
+ *   its id, its bow vector, the term frequency of its words and, if
+ *   available, its feature vector. Records are written in network byte
+ *   order. A record cut by a crash is detected and ignored when the log is
+ *   read, and removed when the log is opened to append more records.
+ *   Flush syncs the file to disk, so that the records written survive a
+ *   crash of the machine too.
+ */
+
+#pragma once
+#ifndef __D_ENTRY_LOG__
+#define __D_ENTRY_LOG__
+
+#include "DatabaseTypes.h"
+#include "BowVector.h"
+#include "FeatureVector.h"
+#include "DUtils.h"
+#include <vector>
+#include <string>
+using namespace std;
+
+namespace DBow {
+
+	class EntryLog
+	{
+	public:
+
+		/**
+		 * Creates a closed log
+		 */
+		EntryLog(void);
+
+		/**
+		 * Creates a closed log. Logs are not copied: only one object can
+		 * append to a file
+		 * @param log
+		 */
+		EntryLog(const EntryLog &log);
+
+		/**
+		 * Destructor. Closes the log, writing the pending records
+		 */
+		~EntryLog(void);
+
+		/**
+		 * Closes this log. The log given is not copied
+		 * @param log
+		 * @return this log
+		 */
+		EntryLog& operator=(const EntryLog &log);
+
+		/**
+		 * Exchanges two logs
+		 * @param log
+		 */
+		void swap(EntryLog &log);
+
+		/**
+		 * Opens a log file to append records, creating it if it does not
+		 * exist. An incomplete record at the end of the file is removed
+		 * @param filename
+		 * @return id of the last entry in the file plus one, or 0 if there
+		 *   are no records
+		 * @throws DException if the file cannot be opened
+		 */
+		EntryId Open(const char *filename);
+
+		/**
+		 * Closes the log, writing the pending records
+		 */
+		void Close();
+
+		/**
+		 * Says whether the log is open
+		 * @return true iif the log is open
+		 */
+		inline bool isOpen() const { return m_file != NULL; }
+
+		/**
+		 * Returns the file of the log
+		 * @return file name, or empty if the log is closed
+		 */
+		inline const string& Filename() const { return m_filename; }
+
+		/**
+		 * Appends a record. It may be buffered until Flush is called
+		 * @param id entry id
+		 * @param v bow vector of the entry
+		 * @param tf term frequency of each word of v
+		 * @param fv (default: NULL) feature vector of the entry, if any
+		 * @throws DException if the log is closed
+		 */
+		void Append(EntryId id, const BowVector &v, const vector<float> &tf,
+			const FeatureVector *fv = NULL);
+
+		/**
+		 * Writes the buffered records to the file and syncs it to disk
+		 * @throws DException if the log is closed or cannot be synced
+		 */
+		void Flush();
+
+		/**
+		 * Removes all the records of the file
+		 * @throws DException if the log is closed or cannot be synced
+		 */
+		void Clear();
+
+		/**
+		 * Makes the system write the data of a closed (or flushed) file to 
+		 * the disk (fsync, or _commit in Windows)
+		 * @param filename
+		 * @throws DException if the file cannot be synced
+		 */
+		static void SyncFile(const char *filename);
+
+		/**
+		 * Makes the system write to the disk the directory that contains a
+		 * file, so that a new or renamed file is not lost. It does nothing
+		 * in Windows
+		 * @param filename file in the directory
+		 * @throws DException if the directory cannot be synced
+		 */
+		static void SyncDirectory(const char *filename);
+
+		/**
+		 * Reads the next record of a log file
+		 * @param f log file opened for reading
+		 * @param id (out) entry id
+		 * @param v (out) bow vector
+		 * @param tf (out) term frequencies
+		 * @param fv (out) feature vector, empty if it was not logged
+		 * @return false if there are no more complete records
+		 */
+		static bool ReadRecord(DUtils::BinaryFile &f, EntryId &id,
+			BowVector &v, vector<float> &tf, FeatureVector &fv);
+
+	protected:
+
+		// File records are appended to, or NULL
+		DUtils::BinaryFile *m_file;
+
+		// Name of the file
+		string m_filename;
+
+	};
+
+}
+
+#endif
+
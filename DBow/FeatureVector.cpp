@@ -0,0 +1,30 @@
+/**
+ * File: FeatureVector.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: groups of the features of an image by vocabulary node
+ * Notes: see FeatureVector.h
+ */
+
+#include "FeatureVector.h"
+#include <map>
+#include <vector>
+using namespace std;
+
+using namespace DBow;
+
+FeatureVector::FeatureVector(void)
+{
+}
+
+FeatureVector::~FeatureVector(void)
+{
+}
+
+void FeatureVector::AddFeature(NodeId id, unsigned int i_feature)
+{
+	// features are added in ascending order of index, so that
+	// every vector remains sorted
+	(*this)[id].push_back(i_feature);
+}
+
@@ -0,0 +1,53 @@
+/**
+ * File: FeatureVector.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: groups of the features of an image by vocabulary node
+ * Defines: NodeId, FeatureVector
+ *
+ * Note: a FeatureVector maps the id of a node of a hierarchical vocabulary
+ *   to the indices of the features of an image that went through that
+ *   node when they were transformed. Only features that are close in the
+ *   descriptor space share a node, so that correspondences between two 
+ *   images can be searched only among the features of the same node.
+ */
+
+#pragma once
+#ifndef __D_FEATURE_VECTOR__
+#define __D_FEATURE_VECTOR__
+
+#include <map>
+#include <vector>
+using namespace std;
+
+namespace DBow {
+
+	typedef unsigned int NodeId;
+
+	class FeatureVector: 
+		public map<NodeId, vector<unsigned int> >
+	{
+	public:
+
+		/** 
+		 * Constructor
+		 */
+		FeatureVector(void);
+
+		/**
+		 * Destructor
+		 */
+		~FeatureVector(void);
+
+		/**
+		 * Adds a feature to the group of a node
+		 * @param id node id
+		 * @param i_feature index of the feature in its image
+		 */
+		void AddFeature(NodeId id, unsigned int i_feature);
+	};
+
+}
+
+#endif
+
@@ -20,6 +20,12 @@ HVocParams::HVocParams(int k, int L, int desc_length,
 {
 	this->k = k;
 	this->L = L;
+	this->MaxIterations = 0;
+	this->ConvergenceTolerance = 0;
+	this->MiniBatchSize = 0;
+	this->ScalableSeedingSize = 0;
+	this->AcceleratedKMeans = true;
+	this->RandomSeed = 0;
 }
 
 HVocParams::~HVocParams(void)
@@ -31,6 +37,18 @@ string HVocParams::toString() const
 	stringstream ss;
 	ss << VocParams::toString();
 	ss << "k: " << k << ", L: " << L << endl;
+	if(MiniBatchSize > 0)
+		ss << "Mini-batch kmeans, batch size: " << MiniBatchSize << endl;
+	if(RandomSeed != 0)
+		ss << "Random seed: " << RandomSeed << endl;
+	if(!AcceleratedKMeans)
+		ss << "Accelerated kmeans disabled" << endl;
+	if(ScalableSeedingSize > 0)
+		ss << "Kmeans|| seeding from " << ScalableSeedingSize << " features" << endl;
+	if(MaxIterations > 0)
+		ss << "Max kmeans iterations: " << MaxIterations << endl;
+	if(ConvergenceTolerance > 0)
+		ss << "Kmeans convergence tolerance: " << ConvergenceTolerance << endl;
 	return ss.str();
 }
 
@@ -23,6 +23,36 @@ namespace DBow {
 		int k;
 		int L;
 
+		// Max number of kmeans iterations in each node
+		// (default: 0: iterate until convergence)
+		int MaxIterations;
+
+		// Kmeans stops when no cluster centre moves between two iterations
+		// a squared distance greater than this value
+		// (default: 0: stop when the features do not change of cluster)
+		double ConvergenceTolerance;
+
+		// If > 0, nodes with more features than this value are clustered with
+		// mini-batch kmeans, using batches of this size. If MaxIterations is
+		// 0, as many iterations as needed to visit every feature once on 
+		// average are run (default: 0: use standard kmeans)
+		int MiniBatchSize;
+
+		// If > 0, nodes with more features than this value are seeded with
+		// kmeans|| instead of kmeans++ (default: 0: always use kmeans++)
+		int ScalableSeedingSize;
+
+		// Skips distance computations of kmeans by keeping bounds of the 
+		// distances between features and clusters. The result is the same
+		// as that of plain kmeans (default: true)
+		bool AcceleratedKMeans;
+
+		// Seed of the random numbers used to create the vocabulary. The 
+		// same seed gives the same vocabulary, no matter the number of 
+		// threads (default: 0: take the seed from DUtils::Random, so that it
+		// depends on DUtils::Random::SeedRand)
+		unsigned int RandomSeed;
+
 	public:
 		/**
 		 * Constructor
@@ -7,6 +7,7 @@
 
 #include "HVocabulary.h"
 #include "HVocParams.h"
+#include "DescriptorFile.h"
 
 #include "DUtils.h"
 
@@ -15,7 +16,23 @@
 #include <numeric>
 #include <vector>
 #include <cmath>
+#include <cstdio>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 using namespace std;
 
 using namespace DBow;
@@ -24,73 +41,91 @@ using namespace DBow;
 // (no other method supported currently)
 #define KMEANS_PLUS_PLUS
 
+// Min number of iterations of mini-batch kmeans when no max is given
+#define MINI_BATCH_MIN_ITERATIONS 10
+
+// Number of rounds and oversampling factor (times k) of kmeans||
+#define KMEANS_PARALLEL_ROUNDS 5
+#define KMEANS_PARALLEL_OVERSAMPLING 2
+
+// Relative margin applied to the bounds of accelerated kmeans to absorb
+// rounding errors, so that it gives the same result as plain kmeans
+#define KMEANS_BOUND_MARGIN (1. + 1e-9)
+
+// Loops over fewer features than this are not run in parallel
+#define PARALLEL_MIN_FEATURES 1000
+
 HVocabulary::HVocabulary(const HVocParams &params):
-	Vocabulary(params), m_params(params)
+	Vocabulary(params), m_params(params), m_beam_width(1)
 {
 	assert(params.k > 1 && params.L > 0);
 }
 
 HVocabulary::HVocabulary(const char *filename) :
-	Vocabulary(HVocParams(0,0)), m_params(HVocParams(0,0))
+	Vocabulary(HVocParams(0,0)), m_params(HVocParams(0,0)), m_beam_width(1)
 {
 	Load(filename);
 }
 
 HVocabulary::HVocabulary(const HVocabulary &voc) :
-	Vocabulary(voc), m_params(voc.m_params)
+	Vocabulary(voc), m_params(voc.m_params), m_beam_width(voc.m_beam_width),
+	m_nodes(voc.m_nodes), m_words(voc.m_words)
 {
-	m_nodes = voc.m_nodes;
-	
-	m_words.clear();
-	m_words.resize(voc.m_words.size());
-
-	vector<Node*>::const_iterator it;
-	for(it = voc.m_words.begin(); it != voc.m_words.end(); it++){
-		const Node *p = *it;
-		m_words[it - voc.m_words.begin()] = &m_nodes[p->Id];
-	}
-
 }
 
 HVocabulary::~HVocabulary(void)
 {
 }
 
-void HVocabulary::Create(const vector<vector<float> >& training_features)
+void HVocabulary::swap(HVocabulary &voc)
+{
+	Vocabulary::swap(voc);
+	std::swap(m_params, voc.m_params);
+	std::swap(m_beam_width, voc.m_beam_width);
+	m_nodes.swap(voc.m_nodes);
+	m_words.swap(voc.m_words);
+}
+
+void HVocabulary::Create(const vector<DescriptorView>& training_features)
 {
 	// expected_nodes = Sum_{i=0..L} ( k^i )
 	int expected_nodes = 
 		(int)((pow((double)m_params.k, (double)m_params.L + 1) - 1)/(m_params.k - 1));
 	
 	// remove previous tree, allocate memory and insert root node
-	m_nodes.resize(0);
-	m_nodes.reserve(expected_nodes); // prevents allocations when creating the tree
-	m_nodes.push_back(Node(0)); // root
+	m_nodes.Reset(m_params.DescriptorLength);
+	m_nodes.Reserve(expected_nodes); // prevents allocations when creating the tree
 
 	// prepare data
 	int nfeatures = 0;	
 	for(unsigned int i = 0; i < training_features.size(); i++){
-		assert(training_features[i].size() % m_params.DescriptorLength == 0);
-		nfeatures += training_features[i].size() / m_params.DescriptorLength; 
+		assert(training_features[i].empty() || 
+			training_features[i].Cols() == m_params.DescriptorLength);
+		nfeatures += training_features[i].Rows(); 
 	}
 
-	vector<pFeature> pfeatures;
-	pfeatures.reserve(nfeatures);
+	// all the features are copied to a single buffer, which is partitioned
+	// in place while descending the tree
+	const int D = m_params.DescriptorLength;
+	vector<float> arena(nfeatures * D);
 
-	vector<vector<float> >::const_iterator it;
-	vector<float>::const_iterator jt;
+	vector<float>::iterator ait = arena.begin();
+	vector<DescriptorView>::const_iterator it;
 
 	for(it = training_features.begin(); it != training_features.end(); it++){
-		for(jt = it->begin(); jt < it->end(); jt += m_params.DescriptorLength){
-			pfeatures.push_back( jt );
+		for(int i = 0; i < it->Rows(); i++, ait += D){
+			copy((*it)[i], (*it)[i] + D, ait);
 		}
 	}
 
 	vector<float> buffer;
 	buffer.reserve( m_params.k * m_params.DescriptorLength );
 
+	DUtils::RandomGenerator rng(TrainingSeed());
+
 	// start hierarchical kmeans
-	HKMeansStep(0, pfeatures, 1, buffer);
+	if(nfeatures > 0)
+		HKMeansStep(m_nodes, 0, &arena[0], nfeatures, 1, buffer, m_params.L, rng);
 
 	// create word nodes
 	CreateWords();
@@ -103,10 +138,415 @@ void HVocabulary::Create(const vector<vector<float> >& training_features)
 
 }
 
-void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures, 
-							  int level, vector<float>& clusters)
+void HVocabulary::CreateFromFile(const char *filename, int max_features,
+	const char *tmp_path)
+{
+	assert(max_features > m_params.k);
+
+	// remove previous tree and insert root node
+	m_created = false;
+	m_words.clear();
+	m_nodes.Reset(m_params.DescriptorLength);
+
+	vector<float> buffer;
+	buffer.reserve( m_params.k * m_params.DescriptorLength );
+
+	DUtils::RandomGenerator rng(TrainingSeed());
+
+	// temporary files of this run are not mixed with those of others
+	const string spill_prefix = SpillPrefix(tmp_path);
+
+	// start hierarchical kmeans
+	HKMeansStepFromFile(0, filename, 1, max_features, spill_prefix.c_str(), 
+		buffer, rng);
+
+	// create word nodes
+	CreateWords();
+
+	// set the flag
+	m_created = true;
+
+	// set node weigths
+	SetNodeWeights(filename);
+}
+
+int HVocabulary::SplitWords(const vector<DescriptorView> &documents, 
+	float max_frequency, map<WordId, vector<WordId> > &splits)
+{
+	splits.clear();
+	if(isEmpty()) return 0;
+
+	const int D = m_params.DescriptorLength;
+
+	// 1. Find the overloaded words
+	vector<vector<WordId> > words(documents.size());
+	vector<unsigned int> occurrences(m_words.size(), 0);
+	unsigned int total = 0;
+
+	for(unsigned int i = 0; i < documents.size(); i++){
+		const DescriptorView &document = documents[i];
+		assert(document.empty() || document.Cols() == D);
+
+		transformFeatures(document, words[i]);
+
+		for(int j = 0; j < document.Rows(); j++){
+			occurrences[ words[i][j] ]++;
+		}
+
+		total += document.Rows();
+	}
+
+	// ids of split words -> their features
+	map<WordId, vector<float> > overloaded;
+
+	for(unsigned int id = 0; id < occurrences.size(); id++){
+		if(occurrences[id] > 1 && occurrences[id] > max_frequency * total)
+			overloaded[id].reserve(occurrences[id] * D);
+	}
+
+	if(overloaded.empty()) return 0;
+
+	for(unsigned int i = 0; i < documents.size(); i++){
+		for(int j = 0; j < documents[i].Rows(); j++){
+			map<WordId, vector<float> >::iterator oit = overloaded.find(words[i][j]);
+			if(oit != overloaded.end())
+				oit->second.insert(oit->second.end(), documents[i][j], 
+					documents[i][j] + D);
+		}
+	}
+	
+	// 2. Split the words with one level of kmeans
+	DUtils::RandomGenerator rng(TrainingSeed());
+	vector<float> clusters;
+	WordId next_id = m_words.size();
+
+	map<WordId, vector<float> >::iterator oit;
+	for(oit = overloaded.begin(); oit != overloaded.end(); oit++){
+		const WordId wid = oit->first;
+		const NodeId nid = m_words[wid];
+		const WordValue weight = m_nodes[nid].Weight;
+
+		HKMeansStep(m_nodes, nid, &oit->second[0], oit->second.size() / D,
+			1, clusters, 1, rng);
+
+		if(m_nodes[nid].NChildren < 2){
+			// all the features were the same, the word cannot be split
+			m_nodes.RemoveLastChildren(nid);
+			continue;
+		}
+
+		vector<WordId> &new_words = splits[wid];
+		
+		const NodeId *cit = m_nodes.Children(nid);
+		const NodeId *cend = cit + m_nodes[nid].NChildren;
+		for(; cit != cend; cit++)
+		{
+			Node &child = m_nodes[*cit];
+			child.WId = (new_words.empty() ? wid : next_id++);
+			child.Weight = weight;
+			new_words.push_back(child.WId);
+		}
+
+		m_nodes[nid].WId = (WordId)-1;
+		m_nodes[nid].Weight = 0;
+
+		vector<float>().swap(oit->second); // release memory
+	}
+
+	// 3. Link the words to the nodes again
+	m_words.resize(next_id);
+
+	vector<Node>::const_iterator nit;
+	for(nit = m_nodes.nodes.begin(); nit != m_nodes.nodes.end(); nit++){
+		if(nit->isLeaf()) m_words[nit->WId] = nit->Id;
+	}
+
+	// 4. Set the weights and frequencies of the new words
+	if(!splits.empty()) SetSplitWordWeights(documents, words, splits);
+
+	return splits.size();
+}
+
+void HVocabulary::SetSplitWordWeights(const vector<DescriptorView> &documents,
+	const vector<vector<WordId> > &words, 
+	const map<WordId, vector<WordId> > &splits)
 {
-	if(pfeatures.empty()) return;
+	// the statistics of the training set are not available, so that the 
+	// new words take those of the split word, in the proportion of its 
+	// features (frequency) and of its documents (idf) that each new word 
+	// receives in the given documents. The other words are not changed
+	const WordId nwords = m_words.size();
+
+	vector<bool> split(m_word_frequency.size(), false);
+	map<WordId, vector<WordId> >::const_iterator sit;
+	for(sit = splits.begin(); sit != splits.end(); sit++) 
+		split[sit->first] = true;
+
+	// occurrences and documents of the split words (before splitting) and
+	// of the new words
+	vector<unsigned int> old_occurrences(split.size(), 0), old_Ni(split.size(), 0);
+	vector<unsigned int> new_occurrences(nwords, 0), new_Ni(nwords, 0);
+	vector<WordId> old_words, new_words;
+	vector<BeamEntry> leaves, buffer;
+
+	for(unsigned int i = 0; i < documents.size(); i++){
+		old_words.resize(0);
+		new_words.resize(0);
+
+		for(int j = 0; j < documents[i].Rows(); j++){
+			const WordId old_id = words[i][j];
+			if(split[old_id]){
+				const WordId new_id = Transform(documents[i][j], leaves, buffer);
+				old_occurrences[old_id]++;
+				new_occurrences[new_id]++;
+				old_words.push_back(old_id);
+				new_words.push_back(new_id);
+			}
+		}
+
+		sort(old_words.begin(), old_words.end());
+		vector<WordId>::const_iterator wit, wend;
+		wend = unique(old_words.begin(), old_words.end());
+		for(wit = old_words.begin(); wit != wend; wit++) old_Ni[*wit]++;
+
+		sort(new_words.begin(), new_words.end());
+		wend = unique(new_words.begin(), new_words.end());
+		for(wit = new_words.begin(); wit != wend; wit++) new_Ni[*wit]++;
+	}
+
+	const bool idf = (m_params.Weighting == VocParams::IDF || 
+		m_params.Weighting == VocParams::TF_IDF);
+
+	m_word_frequency.resize(nwords, 0);
+
+	for(sit = splits.begin(); sit != splits.end(); sit++){
+		const WordId old_id = sit->first;
+		const float frequency = m_word_frequency[old_id];
+
+		vector<WordId>::const_iterator wit;
+		for(wit = sit->second.begin(); wit != sit->second.end(); wit++){
+			Node &node = m_nodes[m_words[*wit]];
+
+			// node.Weight is still the weight of the split word
+			if(idf && new_Ni[*wit] > 0)
+				node.Weight += log((double)old_Ni[old_id] / new_Ni[*wit]);
+
+			m_word_frequency[*wit] = (old_occurrences[old_id] > 0 ?
+				frequency * new_occurrences[*wit] / old_occurrences[old_id] : 0);
+		}
+	}
+
+	// the same number of words is stopped
+	int nfreq = m_frequent_words_stopped;
+	int ninfreq = m_infrequent_words_stopped;
+
+	CreateStopList();
+	StopWords(nfreq, ninfreq);
+}
+
+void HVocabulary::UpdateWeights(const vector<DescriptorView> &documents)
+{
+	if(isEmpty()) return;
+
+	// the same number of words is stopped
+	int nfreq = m_frequent_words_stopped;
+	int ninfreq = m_infrequent_words_stopped;
+
+	SetNodeWeights(documents);
+	StopWords(nfreq, ninfreq);
+}
+
+void HVocabulary::HKMeansStepFromFile(NodeId parentId, const char *filename, 
+	int level, int max_features, const char *spill_prefix, 
+	vector<float>& clusters, DUtils::RandomGenerator &rng)
+{
+	const int D = m_params.DescriptorLength;
+
+	// 1. Take a uniform sample of at most max_features features of the file
+	//    (reservoir sampling)
+	vector<float> sample;
+	double nfeatures = 0; // may not fit in an int
+
+	{
+		DescriptorFile f(filename);
+		if(f.DescriptorLength() != D)
+			throw DUtils::DException("Wrong descriptor length in training file");
+
+		vector<float> document;
+		while(f.Read(document)){
+			for(unsigned int i = 0; i < document.size(); i += D, nfeatures += 1){
+				if(nfeatures < max_features){
+					sample.insert(sample.end(), document.begin() + i, 
+						document.begin() + i + D);
+				}else{
+					// this is the item nfeatures + 1 of the file, so it 
+					// replaces a sample with probability 
+					// max_features / (nfeatures + 1) (Algorithm R)
+					double j = floor(rng.RandomValue<double>() * (nfeatures + 1));
+					if(j < max_features){
+						copy(document.begin() + i, document.begin() + i + D, 
+							sample.begin() + (int)j * D);
+					}
+				}
+			}
+		}
+	}
+
+	if(sample.empty()) return;
+
+	const int nsample = sample.size() / D;
+
+	if(nfeatures <= max_features){
+		// all the features are in memory
+		HKMeansStep(m_nodes, parentId, &sample[0], nsample, level, clusters, 
+			m_params.L, rng);
+		return;
+	}
+
+	// 2. Create the levels whose nodes are expected to have more than
+	//    max_features features with the sample
+	int last_level = level;
+	double expected = nfeatures / m_params.k;
+	while(last_level < m_params.L && expected > max_features){
+		expected /= m_params.k;
+		last_level++;
+	}
+
+	HKMeansStep(m_nodes, parentId, &sample[0], nsample, level, clusters, 
+		last_level, rng);
+
+	if(last_level == m_params.L) return;
+
+	vector<float>().swap(sample); // release memory
+
+	// 3. Partition all the features of the file among the leaves created
+	//    at last_level, by storing them in a spill file per leaf. 
+	//    Spilled features are buffered to write them in blocks
+	vector<NodeId> spilled_nodes;
+	{
+		map<NodeId, vector<float> > spill_buffers;
+		unsigned int buffered = 0;
+
+		DescriptorFile f(filename);
+		vector<float> document;
+		bool more = true;
+
+		while(more){
+			more = f.Read(document);
+
+			for(unsigned int i = 0; i < document.size(); i += D){
+				const float *pfeature = &document[i];
+
+				// propagate the feature down the new subtree
+				NodeId id = parentId;
+				int id_level = level - 1;
+				do{
+					const NodeId *nodes = m_nodes.Children(id);
+					const unsigned int nchildren = m_nodes[id].NChildren;
+					id = nodes[0];
+					double best_sqd = DescriptorSqDistance(pfeature, 
+						m_nodes.Descriptor(id));
+
+					for(unsigned int j = 1; j < nchildren; j++){
+						double sqd = DescriptorSqDistance(pfeature, 
+							m_nodes.Descriptor(nodes[j]));
+						if(sqd < best_sqd){
+							best_sqd = sqd;
+							id = nodes[j];
+						}
+					}
+					id_level++;
+				}while(!m_nodes[id].isLeaf());
+
+				// leaves above last_level have already been completed
+				if(id_level == last_level){
+					vector<float> &b = spill_buffers[id];
+					b.insert(b.end(), pfeature, pfeature + D);
+					buffered++;
+				}
+			}
+
+			if(buffered >= (unsigned int)max_features || 
+				(!more && buffered > 0)){
+				// flush buffers
+				map<NodeId, vector<float> >::iterator bit;
+				for(bit = spill_buffers.begin(); bit != spill_buffers.end(); bit++){
+					if(bit->second.empty()) continue;
+
+					const string spill_filename = 
+						SpillFilename(spill_prefix, bit->first);
+					DescriptorFile spill;
+
+					// the file is created again on its first flush, so that
+					// no old data are kept
+					if(find(spilled_nodes.begin(), spilled_nodes.end(), bit->first)
+						== spilled_nodes.end()){
+						spill.OpenForWriting(spill_filename.c_str(), D);
+						spilled_nodes.push_back(bit->first);
+					}else{
+						spill.OpenForAppending(spill_filename.c_str(), D);
+					}
+					spill.Write(bit->second);
+
+					vector<float>().swap(bit->second); // release memory
+				}
+				buffered = 0;
+			}
+		}
+	}
+
+	// 4. Create the subtrees of the leaves at last_level from their files
+	sort(spilled_nodes.begin(), spilled_nodes.end());
+
+	vector<NodeId>::const_iterator nit;
+	for(nit = spilled_nodes.begin(); nit != spilled_nodes.end(); nit++){
+		string spill = SpillFilename(spill_prefix, *nit);
+
+		DUtils::RandomGenerator child_rng = rng.Split();
+
+		HKMeansStepFromFile(*nit, spill.c_str(), last_level + 1, max_features, 
+			spill_prefix, clusters, child_rng);
+
+		remove(spill.c_str());
+	}
+}
+
+unsigned long long HVocabulary::TrainingSeed() const
+{
+	if(m_params.RandomSeed != 0)
+		return m_params.RandomSeed;
+	else // take it from the global generator, seeded by the user
+		return DUtils::Random::RandomInt(0, 1 << 30);
+}
+
+string HVocabulary::SpillPrefix(const char *tmp_path) const
+{
+	// process, vocabulary and time of the run
+	DUtils::Timestamp t;
+	t.setToCurrentTime();
+
+	stringstream ss;
+	ss << tmp_path << "/dbow_" << getpid() << "_" << (const void*)this << "_"
+		<< t.getStringTime() << "_";
+	return ss.str();
+}
+
+string HVocabulary::SpillFilename(const char *spill_prefix, NodeId id) const
+{
+	stringstream ss;
+	ss << spill_prefix << "node_" << id << ".tmp";
+	return ss.str();
+}
+
+void HVocabulary::HKMeansStep(NodeStore &nodes, NodeId parentId, 
+							  float *features, int nfeatures, int level, 
+							  vector<float>& clusters, int last_level,
+							  DUtils::RandomGenerator &rng)
+{
+	if(nfeatures == 0) return;
+
+	const int D = m_params.DescriptorLength;
+	const DescriptorView pfeatures(features, nfeatures, D);
 
 	// features associated to each cluster
 	vector<vector<unsigned int> > groups; // indices from pfeatures
@@ -115,27 +555,57 @@ void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures
 	// number of final clusters
 	int nclusters = 0;
 
-	if((int)pfeatures.size() <= m_params.k){
+	if(nfeatures <= m_params.k){
 		
 		// trivial case: if there is a few features, each feature is a cluster
-		nclusters = pfeatures.size();
-		clusters.resize(pfeatures.size() * m_params.DescriptorLength);
-		groups.resize(pfeatures.size());
+		nclusters = nfeatures;
+		clusters.assign(features, features + nfeatures * D);
+		groups.resize(nfeatures);
 
-		for(unsigned int i = 0; i < pfeatures.size(); i++){
-			copy(pfeatures[i], pfeatures[i] + m_params.DescriptorLength, 
-				clusters.begin() + i * m_params.DescriptorLength);
+		for(int i = 0; i < nfeatures; i++){
 			groups[i].push_back(i);
 		}
 	
+	}else if(m_params.MiniBatchSize > 0 && nfeatures > m_params.MiniBatchSize){
+
+		// too many features: choose clusters with mini-batch kmeans
+		MiniBatchKMeans(clusters, pfeatures, rng);
+		nclusters = clusters.size() / D;
+
+		// associate all the features with the final clusters
+		groups.resize(nclusters);
+
+		for(int i = 0; i < nfeatures; i++){
+			groups[ NearestCluster(pfeatures[i], clusters) ].push_back(i);
+		}
+
+		// some clusters may have lost all their features
+		RemoveEmptyClusters(clusters, groups);
+		nclusters = groups.size();
+
 	}else{ // choose clusters with kmeans++
 
 		bool first_time = true;
 		bool goon = true;
-		vector<pFeature>::const_iterator fit;
+		int iterations = 0;
+
+		// sum of the features of each cluster, updated with the features
+		// that change of cluster only
+		vector<double> sums;
+		vector<int> sum_association;
+		bool sums_ok = false;
 
 		// to check if clusters move after iterations
 		vector<int> last_association, current_association;
+		vector<float> last_clusters;
+
+		// accelerated kmeans (Hamerly, Making k-means even faster, 2010):
+		// bounds of the distance from each feature to its cluster (upper) and
+		// to its second nearest cluster (lower), and half the distance from
+		// each cluster to its nearest one
+		const bool accelerated = m_params.AcceleratedKMeans;
+		bool bounds_ok = false;
+		vector<double> upper, lower, half_separation;
 
 		while(goon){
 			// 1. Calculate clusters
@@ -144,7 +614,13 @@ void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures
 				// random sample 
 
 #ifdef KMEANS_PLUS_PLUS
-				RandomClustersPlusPlus(clusters, pfeatures);
+				if(m_params.ScalableSeedingSize > 0 &&
+					nfeatures > m_params.ScalableSeedingSize)
+				{
+					RandomClustersScalable(clusters, pfeatures, rng);
+				}else{
+					RandomClustersPlusPlus(clusters, pfeatures, rng);
+				}
 #else
 #error No initial clustering method
 #endif			
@@ -153,24 +629,37 @@ void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures
 			}else{
 				// calculate cluster centres
 				
-				vector<float>::iterator pfirst, pend, cit;
-				vector<unsigned int>::const_iterator vit;
-				
+				if(m_params.ConvergenceTolerance > 0 || accelerated) 
+					last_clusters = clusters;
+
 				for(int i = 0; i < nclusters; i++){
-					pfirst = clusters.begin() + i * m_params.DescriptorLength;
-					pend = clusters.begin() + (i+1) * m_params.DescriptorLength;
+					const double n = groups[i].size();
+					for(int d = 0; d < D; d++){
+						clusters[i * D + d] = (float)(sums[i * D + d] / n);
+					}
+				}
 
-					fill(pfirst, pend, 0.f);
+				if(bounds_ok){
+					// loosen the bounds according to how much clusters moved
+					vector<double> shift(nclusters);
+					double max_shift = 0;
+					for(int i = 0; i < nclusters; i++){
+						shift[i] = sqrt(DescriptorSqDistance(
+							&last_clusters[i * D], &clusters[i * D]));
+						if(shift[i] > max_shift) max_shift = shift[i];
+					}
 
-					for(vit = groups[i].begin(); vit != groups[i].end(); vit++){
-						fit = pfeatures.begin() + *vit;
-						// Possible improvement: divide this into chunks of 4 operations
-						for(cit = pfirst; cit != pend; cit++){
-							*cit += *((*fit) + (cit - pfirst));
-						}
+					for(int i = 0; i < nfeatures; i++){
+						upper[i] += shift[ current_association[i] ];
+						lower[i] -= max_shift;
 					}
+				}
 
-					for(cit = pfirst; cit != pend; cit++) *cit /= groups[i].size();
+				// stop after this iteration if clusters hardly moved
+				if(m_params.ConvergenceTolerance > 0 && 
+					MaxClusterShift(last_clusters, clusters) <= 
+						m_params.ConvergenceTolerance){
+					goon = false;
 				}
 				
 			} // if(first_time)
@@ -178,44 +667,114 @@ void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures
 			// 2. Associate features with clusters
 			
 			// calculate distances to cluster centers
-			groups.clear();
-			groups.resize(nclusters, vector<unsigned int>());
-			current_association.resize(pfeatures.size());
+			current_association.resize(nfeatures);
+
+			if(accelerated){
+				if(bounds_ok){
+					ClusterSeparations(clusters, half_separation);
+				}else{
+					upper.resize(nfeatures);
+					lower.resize(nfeatures);
+				}
 
-			for(fit = pfeatures.begin(); fit != pfeatures.end(); fit++){
-				double best_sqd = DescriptorSqDistance(*fit, clusters.begin());
-				int icluster = 0;
+				#pragma omp parallel for schedule(static) if(nfeatures > PARALLEL_MIN_FEATURES)
+				for(int i = 0; i < nfeatures; i++){
+					if(bounds_ok){
+						// the cluster cannot change if the feature is closer to it 
+						// than to any other one
+						const int icluster = current_association[i];
+						const double bound = 
+							max(half_separation[icluster], lower[i]) / KMEANS_BOUND_MARGIN;
+						
+						if(upper[i] < bound) continue;
+
+						upper[i] = sqrt(DescriptorSqDistance(pfeatures[i], 
+							&clusters[icluster * D]));
+
+						if(upper[i] < bound) continue;
+					}
 
-				for(int i = 1; i < nclusters; i++){
-					double sqd = DescriptorSqDistance(*fit,
-						clusters.begin() + i * m_params.DescriptorLength);
+					double best_sqd, second_sqd;
+					current_association[i] = NearestCluster(pfeatures[i], clusters, 
+						best_sqd, second_sqd);
+					upper[i] = sqrt(best_sqd);
+					lower[i] = sqrt(second_sqd);
+				}
 
-					if(sqd < best_sqd){
-						best_sqd = sqd;
-						icluster = i;
-					}
+				bounds_ok = true;
+
+			}else{
+				#pragma omp parallel for schedule(static) if(nfeatures > PARALLEL_MIN_FEATURES)
+				for(int i = 0; i < nfeatures; i++){
+					current_association[i] = NearestCluster(pfeatures[i], clusters);
 				}
-				groups[icluster].push_back(fit - pfeatures.begin());
-				current_association[ fit - pfeatures.begin() ] = icluster;
+			}
+
+			groups.clear();
+			groups.resize(nclusters, vector<unsigned int>());
+
+			for(int i = 0; i < nfeatures; i++){
+				groups[ current_association[i] ].push_back(i);
 			}
 
 			// remove clusters with no features
-			// (this is not necessary with kmeans++)
-#ifndef KMEANS_PLUS_PLUS
-			for(int i = nclusters-1; i >= 0; i--){
-				if(groups[i].empty()){
-					groups.erase(groups.begin() + i);
-					clusters.erase(clusters.begin() + i * m_params.DescriptorLength, 
-						clusters.begin() + (i+1) * m_params.DescriptorLength);
+			// (this does not happen in the first iteration with kmeans++,
+			// but a cluster may lose all its features later)
+			if(RemoveEmptyClusters(clusters, groups)){
+				nclusters = groups.size();
+
+				// bounds and sums refer to old cluster indices
+				bounds_ok = false;
+				sums_ok = false;
+
+				// associations refer to old cluster indices
+				for(int c = 0; c < nclusters; c++){
+					vector<unsigned int>::const_iterator vit;
+					for(vit = groups[c].begin(); vit != groups[c].end(); vit++)
+						current_association[*vit] = c;
 				}
+				last_association.clear();
+			}
+
+			// update the sums of the clusters
+			if(sums_ok){
+				for(int i = 0; i < nfeatures; i++){
+					const int from = sum_association[i];
+					const int to = current_association[i];
+					if(from != to){
+						const float *f = pfeatures[i];
+						double *from_sum = &sums[from * D];
+						double *to_sum = &sums[to * D];
+						for(int d = 0; d < D; d++){
+							from_sum[d] -= f[d];
+							to_sum[d] += f[d];
+						}
+						sum_association[i] = to;
+					}
+				}
+			}else{
+				sums.resize(nclusters * D);
+				fill(sums.begin(), sums.end(), 0.);
+				sum_association.resize(nfeatures);
+
+				for(int c = 0; c < nclusters; c++){
+					double *sum = &sums[c * D];
+					vector<unsigned int>::const_iterator vit;
+					for(vit = groups[c].begin(); vit != groups[c].end(); vit++){
+						const float *f = pfeatures[*vit];
+						for(int d = 0; d < D; d++) sum[d] += f[d];
+						sum_association[*vit] = c;
+					}
+				}
+				sums_ok = true;
 			}
-			nclusters = groups.size();
-#endif
 
 			// 3. check convergence
+			iterations++;
+
 			if(first_time){
 				first_time = false;
-			}else{
+			}else if(goon && last_association.size() == current_association.size()){
 				goon = false;
 				for(unsigned int i = 0; i < current_association.size(); i++){
 					if(current_association[i] != last_association[i]){
@@ -225,6 +784,9 @@ void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures
 				}
 			}
 
+			if(m_params.MaxIterations > 0 && iterations >= m_params.MaxIterations)
+				goon = false;
+
 			if(goon){
 				// copy last feature-cluster association
 				last_association = current_association;
@@ -237,35 +799,376 @@ void HVocabulary::HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures
 	// Kmeans done, create nodes
 	
 	// create child nodes
-	for(int i = 0; i < nclusters; i++){
-		NodeId id = m_nodes.size();
-		m_nodes.push_back(Node(id));
-		m_nodes.back().Descriptor.resize(m_params.DescriptorLength);
-		copy(clusters.begin() + i * m_params.DescriptorLength, 
-			clusters.begin() + (i+1) * m_params.DescriptorLength,
-			m_nodes.back().Descriptor.begin());
-		
-		m_nodes[parentId].Children.push_back(id);
+	nodes.AddChildren(parentId, &clusters[0], nclusters);
+
+	if(level < last_level){
+		// move the features of each cluster together
+		vector<int> offsets;
+		PartitionFeatures(features, groups, offsets);
+		vector<vector<unsigned int> >().swap(groups); // release memory
+
+		// each child uses its own random stream, so that the result does 
+		// not depend on the order the subtrees are created in
+		vector<DUtils::RandomGenerator> child_rng;
+		child_rng.reserve(nclusters);
+		for(int i = 0; i < nclusters; i++) child_rng.push_back(rng.Split());
+
+		bool parallel = false;
+#ifdef _OPENMP
+		parallel = !omp_in_parallel() && nfeatures > PARALLEL_MIN_FEATURES;
+#endif
+
+		if(parallel){
+			// create the subtrees in parallel, each one in its own node list,
+			// and append them afterwards in the same order as if they were
+			// created sequentially
+			vector<NodeStore> subtrees(nclusters);
+
+			#pragma omp parallel for schedule(dynamic)
+			for(int i = 0; i < nclusters; i++){
+				const int nchild = offsets[i+1] - offsets[i];
+
+				if(nchild > 1){
+					vector<float> child_clusters;
+					child_clusters.reserve(m_params.k * D);
+
+					subtrees[i].Reset(D); // root of the subtree
+					HKMeansStep(subtrees[i], 0, features + offsets[i] * D, nchild, 
+						level + 1, child_clusters, last_level, child_rng[i]);
+				}
+			}
+
+			for(int i = 0; i < nclusters; i++){
+				if(!subtrees[i].empty()){
+					nodes.Append(nodes.Children(parentId)[i], subtrees[i]);
+					subtrees[i].Clear();
+				}
+			}
+
+		}else{
+			// iterate again with the resulting clusters
+			for(int i = 0; i < nclusters; i++){
+				NodeId id = nodes.Children(parentId)[i];
+				const int nchild = offsets[i+1] - offsets[i];
+
+				if(nchild > 1){
+					// (clusters variable can be safely reused now)
+					HKMeansStep(nodes, id, features + offsets[i] * D, nchild, 
+						level + 1, clusters, last_level, child_rng[i]);
+				}
+			}
+		}
 	}
+}
 
-	if(level < m_params.L){
-		// iterate again with the resulting clusters
-		for(int i = 0; i < nclusters; i++){
-			NodeId id = m_nodes[m_nodes[parentId].Children[i]].Id;
-			
-			vector<pFeature> child_features;
-			child_features.reserve(groups[i].size());
+void HVocabulary::NodeStore::Clear()
+{
+	vector<Node>().swap(nodes);
+	vector<NodeId>().swap(children);
+	vector<float>().swap(descriptors);
+}
+
+void HVocabulary::NodeStore::swap(NodeStore &store)
+{
+	nodes.swap(store.nodes);
+	children.swap(store.children);
+	descriptors.swap(store.descriptors);
+	std::swap(D, store.D);
+}
+
+void HVocabulary::NodeStore::Reset(int descriptor_length)
+{
+	D = descriptor_length;
+
+	nodes.resize(0);
+	children.resize(0);
+	descriptors.resize(0);
+
+	nodes.push_back(Node(0)); // root
+	descriptors.resize(D, 0); // unused descriptor of the root
+}
+
+void HVocabulary::NodeStore::Reserve(unsigned int nnodes)
+{
+	nodes.reserve(nnodes);
+	children.reserve(nnodes);
+	descriptors.reserve(nnodes * D);
+}
+
+void HVocabulary::NodeStore::AddChildren(NodeId parent, 
+	const float *pdescriptors, int n)
+{
+	assert(nodes[parent].isLeaf());
+
+	nodes[parent].FirstChild = children.size();
+	nodes[parent].NChildren = n;
+
+	for(int i = 0; i < n; i++){
+		NodeId id = nodes.size();
+		nodes.push_back(Node(id));
+		children.push_back(id);
+	}
+
+	descriptors.insert(descriptors.end(), pdescriptors, pdescriptors + n * D);
+}
+
+void HVocabulary::NodeStore::RemoveLastChildren(NodeId parent)
+{
+	Node &node = nodes[parent];
+	if(node.isLeaf()) return;
+
+	const NodeId first = children[node.FirstChild];
+	assert(node.FirstChild + node.NChildren == children.size());
+	assert(first + node.NChildren == nodes.size());
+
+	nodes.resize(first);
+	descriptors.resize(first * D);
+	children.resize(node.FirstChild);
+	
+	node.FirstChild = 0;
+	node.NChildren = 0;
+}
+
+void HVocabulary::NodeStore::Append(NodeId id, const NodeStore &subtree)
+{
+	assert(subtree.D == D && nodes[id].isLeaf());
+
+	// node i of the subtree (i > 0) becomes node base + i - 1, and its
+	// children are moved offset places
+	const NodeId base = nodes.size();
+	const unsigned int offset = children.size();
 
-			vector<unsigned int>::const_iterator vit;
-			for(vit = groups[i].begin(); vit != groups[i].end(); vit++){
-				child_features.push_back(pfeatures[*vit]);
+	nodes.reserve(nodes.size() + subtree.nodes.size() - 1);
+	
+	vector<Node>::const_iterator nit = subtree.nodes.begin();
+	
+	nodes[id].FirstChild = nit->FirstChild + offset;
+	nodes[id].NChildren = nit->NChildren;
+
+	for(++nit; nit != subtree.nodes.end(); nit++){
+		nodes.push_back(*nit);
+		nodes.back().Id = base + nit->Id - 1;
+		nodes.back().FirstChild += offset;
+	}
+
+	vector<NodeId>::const_iterator cit;
+	children.reserve(children.size() + subtree.children.size());
+	for(cit = subtree.children.begin(); cit != subtree.children.end(); cit++){
+		children.push_back(base + *cit - 1);
+	}
+
+	// the descriptor of the subtree root is not copied
+	descriptors.insert(descriptors.end(), subtree.descriptors.begin() + D,
+		subtree.descriptors.end());
+}
+
+void HVocabulary::PartitionFeatures(float *features, 
+	const vector<vector<unsigned int> > &groups, vector<int> &offsets) const
+{
+	// The features are permuted in place by swapping each misplaced feature 
+	// with the next free position of the region of its cluster, like in the
+	// partition step of quicksort (the order within a cluster is not kept)
+
+	const int D = m_params.DescriptorLength;
+	const int nclusters = groups.size();
+
+	offsets.resize(nclusters + 1);
+	offsets[0] = 0;
+	for(int c = 0; c < nclusters; c++){
+		offsets[c+1] = offsets[c] + groups[c].size();
+	}
+
+	vector<int> cluster(offsets[nclusters]);
+	for(int c = 0; c < nclusters; c++){
+		vector<unsigned int>::const_iterator vit;
+		for(vit = groups[c].begin(); vit != groups[c].end(); vit++){
+			cluster[*vit] = c;
+		}
+	}
+
+	// next position to fill in the region of each cluster
+	vector<int> next(offsets.begin(), offsets.end() - 1);
+
+	for(int c = 0; c < nclusters; c++){
+		while(next[c] < offsets[c+1]){
+			const int i = next[c];
+			const int ci = cluster[i];
+
+			if(ci == c){
+				next[c]++;
+			}else{
+				const int j = next[ci]++;
+				swap_ranges(features + i * D, features + (i+1) * D, features + j * D);
+				std::swap(cluster[i], cluster[j]);
 			}
+		}
+	}
+}
+
+int HVocabulary::NearestCluster(const pFeature &feature, 
+	const vector<float> &clusters) const
+{
+	const int nclusters = clusters.size() / m_params.DescriptorLength;
+
+	double best_sqd = DescriptorSqDistance(feature, &clusters[0]);
+	int icluster = 0;
+
+	for(int i = 1; i < nclusters; i++){
+		double sqd = DescriptorSqDistance(feature,
+			&clusters[i * m_params.DescriptorLength]);
+
+		if(sqd < best_sqd){
+			best_sqd = sqd;
+			icluster = i;
+		}
+	}
 
-			if(child_features.size() > 1){
-				// (clusters variable can be safely reused now)
-				HKMeansStep(id, child_features, level + 1, clusters);
+	return icluster;
+}
+
+int HVocabulary::NearestCluster(const pFeature &feature, 
+	const vector<float> &clusters, double &best_sqd, double &second_sqd) const
+{
+	const int nclusters = clusters.size() / m_params.DescriptorLength;
+
+	best_sqd = DescriptorSqDistance(feature, &clusters[0]);
+	second_sqd = numeric_limits<double>::max();
+	int icluster = 0;
+
+	for(int i = 1; i < nclusters; i++){
+		double sqd = DescriptorSqDistance(feature,
+			&clusters[i * m_params.DescriptorLength]);
+
+		if(sqd < best_sqd){
+			second_sqd = best_sqd;
+			best_sqd = sqd;
+			icluster = i;
+		}else if(sqd < second_sqd){
+			second_sqd = sqd;
+		}
+	}
+
+	return icluster;
+}
+
+void HVocabulary::ClusterSeparations(const vector<float> &clusters,
+	vector<double> &half_separation) const
+{
+	const int D = m_params.DescriptorLength;
+	const int nclusters = clusters.size() / D;
+
+	half_separation.resize(nclusters);
+	fill(half_separation.begin(), half_separation.end(), 
+		numeric_limits<double>::max());
+
+	for(int i = 0; i < nclusters; i++){
+		for(int j = i+1; j < nclusters; j++){
+			double d = sqrt(DescriptorSqDistance(&clusters[i * D], 
+				&clusters[j * D])) / 2;
+
+			if(d < half_separation[i]) half_separation[i] = d;
+			if(d < half_separation[j]) half_separation[j] = d;
+		}
+	}
+}
+
+bool HVocabulary::RemoveEmptyClusters(vector<float> &clusters, 
+	vector<vector<unsigned int> > &groups) const
+{
+	bool removed = false;
+
+	for(int i = (int)groups.size()-1; i >= 0; i--){
+		if(groups[i].empty()){
+			groups.erase(groups.begin() + i);
+			clusters.erase(clusters.begin() + i * m_params.DescriptorLength, 
+				clusters.begin() + (i+1) * m_params.DescriptorLength);
+			removed = true;
+		}
+	}
+
+	return removed;
+}
+
+double HVocabulary::MaxClusterShift(const vector<float> &a, 
+	const vector<float> &b) const
+{
+	assert(a.size() == b.size());
+
+	double max_sqd = 0;
+	for(unsigned int i = 0; i < a.size(); i += m_params.DescriptorLength){
+		double sqd = DescriptorSqDistance(&a[i], &b[i]);
+		if(sqd > max_sqd) max_sqd = sqd;
+	}
+	return max_sqd;
+}
+
+void HVocabulary::MiniBatchKMeans(vector<float> &clusters, 
+	const DescriptorView &pfeatures, DUtils::RandomGenerator &rng) const
+{
+	// Implements mini-batch kmeans (Sculley, 2010)
+	// Algorithm:
+	// 1. Choose the initial centers with kmeans++ on a random sample.
+	// 2. Take a random batch of b features and find their nearest centers.
+	// 3. Move each center towards each of its batch features x with a 
+	//    learning rate 1/n, where n is the number of features the center 
+	//    has been given so far: c = (1 - 1/n) c + (1/n) x.
+	// 4. Repeat 2 and 3 until centers do not move more than the tolerance
+	//    or the max number of iterations is reached.
+
+	const int D = m_params.DescriptorLength;
+	const int b = m_params.MiniBatchSize;
+	const int nfeatures = pfeatures.Rows();
+
+	// 1.
+	{
+		vector<float> sample(b * D);
+		for(int i = 0; i < b; i++){
+			pFeature f = pfeatures[ rng.RandomInt(0, nfeatures-1) ];
+			copy(f, f + D, sample.begin() + i * D);
+		}
+
+		RandomClustersPlusPlus(clusters, DescriptorView(sample, D), rng);
+	}
+
+	vector<pFeature> batch(b);
+	
+	const int nclusters = clusters.size() / D;
+
+	int max_iterations = m_params.MaxIterations;
+	if(max_iterations <= 0){
+		// by default, look at each feature once on average
+		max_iterations = max(MINI_BATCH_MIN_ITERATIONS, nfeatures / b);
+	}
+
+	vector<unsigned int> counts(nclusters, 0);
+	vector<int> nearest(b);
+	vector<float> last_clusters;
+
+	for(int it = 0; it < max_iterations; it++){
+		// 2.
+		for(int i = 0; i < b; i++){
+			batch[i] = pfeatures[ rng.RandomInt(0, nfeatures-1) ];
+			nearest[i] = NearestCluster(batch[i], clusters);
+		}
+
+		if(m_params.ConvergenceTolerance > 0) last_clusters = clusters;
+
+		// 3.
+		for(int i = 0; i < b; i++){
+			const int c = nearest[i];
+			const float eta = 1.f / (float)(++counts[c]);
+
+			float *pc = &clusters[c * D];
+			const float *px = batch[i];
+			for(int d = 0; d < D; d++){
+				pc[d] += eta * (px[d] - pc[d]);
 			}
 		}
+
+		// 4.
+		if(m_params.ConvergenceTolerance > 0 && 
+			MaxClusterShift(last_clusters, clusters) <= m_params.ConvergenceTolerance)
+			break;
 	}
 }
 
@@ -309,8 +1212,7 @@ void HVocabulary::SaveBinary(const char *filename) const
 	f << m_params.k << m_params.L << N;
 
 	// tree
-	vector<NodeId> parents, children;
-	vector<NodeId>::const_iterator pit;
+	vector<NodeId> parents;
 
 	parents.push_back(0); // root
 
@@ -318,16 +1220,17 @@ void HVocabulary::SaveBinary(const char *filename) const
 		NodeId pid = parents.back();
 		parents.pop_back();
 
-		const Node& parent = m_nodes[pid];
-		children = parent.Children;
+		const NodeId *pit = m_nodes.Children(pid);
+		const NodeId *pend = pit + m_nodes[pid].NChildren;
 
-		for(pit = children.begin(); pit != children.end(); pit++){
+		for(; pit != pend; pit++){
 			const Node& child = m_nodes[*pit];
+			const float *descriptor = m_nodes.Descriptor(*pit);
 
 			// save node data
 			f << (int)child.Id << (int)pid << (double)child.Weight;
 			for(int i = 0; i < m_params.DescriptorLength; i++){
-				f << child.Descriptor[i];
+				f << descriptor[i];
 			}
 
 			// add to parent list
@@ -338,10 +1241,10 @@ void HVocabulary::SaveBinary(const char *filename) const
 	}
 
 	// vocabulary
-	vector<Node*>::const_iterator wit;
+	vector<NodeId>::const_iterator wit;
 	for(wit = m_words.begin(); wit != m_words.end(); wit++){
 		WordId id = wit - m_words.begin();
-		f << (int)id << GetWordFrequency(id) << (int)(*wit)->Id;
+		f << (int)id << GetWordFrequency(id) << (int)*wit;
 	}
 
 	f.Close();
@@ -359,22 +1262,20 @@ void HVocabulary::SaveText(const char *filename) const
 	// ...
 	// WordId_(N-1) frequency NodeId
 
-	fstream f(filename, ios::out);
-	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+	DUtils::TextFile f(filename, DUtils::WRITE);
 
 	// magic word is not necessary in the text file
 
-	f.precision(10);
+	f.SetPrecision(10);
 
 	const int N = m_nodes.size();
 
 	// header
 	SaveTextHeader(f);
-	f << m_params.k << " " << m_params.L << " " << N << endl;
+	f << m_params.k << " " << m_params.L << " " << N << '\n';
 	
 	// tree
-	vector<NodeId> parents, children;
-	vector<NodeId>::const_iterator pit;
+	vector<NodeId> parents;
 
 	parents.push_back(0); // root
 
@@ -382,20 +1283,21 @@ void HVocabulary::SaveText(const char *filename) const
 		NodeId pid = parents.back();
 		parents.pop_back();
 
-		const Node& parent = m_nodes[pid];
-		children = parent.Children;
+		const NodeId *pit = m_nodes.Children(pid);
+		const NodeId *pend = pit + m_nodes[pid].NChildren;
 
-		for(pit = children.begin(); pit != children.end(); pit++){
+		for(; pit != pend; pit++){
 			const Node& child = m_nodes[*pit];
+			const float *descriptor = m_nodes.Descriptor(*pit);
 
 			// save node data
 			f << child.Id << " "
 				<< pid << " "
 				<< child.Weight << " ";
 			for(int i = 0; i < m_params.DescriptorLength; i++){
-				f << child.Descriptor[i] << " ";
+				f << descriptor[i] << " ";
 			}
-			f << endl;
+			f << '\n';
 
 			// add to parent list
 			if(!child.isLeaf()){
@@ -405,16 +1307,16 @@ void HVocabulary::SaveText(const char *filename) const
 	}
 
 	// vocabulary
-	vector<Node*>::const_iterator wit;
+	vector<NodeId>::const_iterator wit;
 	for(wit = m_words.begin(); wit != m_words.end(); wit++){
 		WordId id = wit - m_words.begin();
 		f << (int)id << " "
 			<< GetWordFrequency(id) << " "
-			<< (int)(*wit)->Id
-			<< endl;
+			<< (int)*wit
+			<< '\n';
 	}
 
-	f.close();
+	f.Close();
 }
 
 unsigned int HVocabulary::LoadBinary(const char *filename)
@@ -442,6 +1344,32 @@ unsigned int HVocabulary::LoadBinary(const char *filename)
 	return ret;
 }
 
+void HVocabulary::hashContent(ContentHash &h) const
+{
+	// nodes are hashed in order of id with the id of their parent, so that
+	// the order in which children are stored does not matter
+	const int N = m_nodes.size();
+
+	vector<NodeId> parents(N, 0);
+	for(NodeId pid = 0; pid < (NodeId)N; pid++){
+		const NodeId *pit = m_nodes.Children(pid);
+		const NodeId *pend = pit + m_nodes[pid].NChildren;
+		for(; pit != pend; pit++) parents[*pit] = pid;
+	}
+
+	h << m_params.k << m_params.L << N;
+
+	for(NodeId id = 1; id < (NodeId)N; id++){
+		const Node &node = m_nodes[id];
+		const float *descriptor = m_nodes.Descriptor(id);
+
+		h << (int)parents[id] << (double)node.Weight << (int)node.WId;
+		for(int i = 0; i < m_params.DescriptorLength; i++){
+			h << descriptor[i];
+		}
+	}
+}
+
 unsigned int HVocabulary::LoadText(const char *filename)
 {
 	// Format (text)
@@ -454,21 +1382,188 @@ unsigned int HVocabulary::LoadText(const char *filename)
 	// ...
 	// WordId_(N-1) frequency NodeId
 
-	fstream f(filename, ios::in);
-	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+	DUtils::TextFile f(filename, DUtils::READ);
 
 	int nwords = LoadTextHeader(f);
 
-	_load<fstream>(f, nwords);
+	_load<DUtils::TextFile>(f, nwords);
 
-	unsigned int ret = (unsigned int)f.tellg();
+	unsigned int ret = f.Position();
 
-	f.close();
+	f.Close();
 
 	return ret;
 }
 
 
+template<class T>
+void HVocabulary::readNodes(T &f, int nnodes, vector<NodeId> &order,
+	vector<NodeId> &parents)
+{
+	const int D = m_params.DescriptorLength;
+
+	for(int i = 1; i < nnodes; i++){
+		int nodeid, parentid;
+		double weight;
+		f >> nodeid >> parentid >> weight;
+
+		m_nodes[nodeid].Id = nodeid;
+		m_nodes[nodeid].Weight = weight;
+		m_nodes[parentid].NChildren++;
+		
+		order[i-1] = nodeid;
+		parents[i-1] = parentid;
+
+		float *descriptor = m_nodes.Descriptor(nodeid);
+		for(int j = 0; j < D; j++){
+			f >> descriptor[j];
+		}
+	}
+}
+
+void HVocabulary::readNodes(DUtils::TextFile &f, int nnodes, 
+	vector<NodeId> &order, vector<NodeId> &parents)
+{
+	const int D = m_params.DescriptorLength;
+	const int n = nnodes - 1;
+	const unsigned int start = f.Position();
+	const char *data = f.Data();
+
+	vector<unsigned int> lines;
+	bool ok = f.FindLines(n, lines);
+
+	// the ids are read first, so that each line writes a different node
+	if(ok){
+		vector<bool> found(nnodes, false);
+
+		for(int i = 0; ok && i < n; i++){
+			int nodeid;
+			ok = DUtils::TextFile::Parse(data + lines[i], data + lines[i+1], 
+				nodeid) && nodeid > 0 && nodeid < nnodes && !found[nodeid];
+
+			if(ok){
+				found[nodeid] = true;
+				order[i] = nodeid;
+			}
+		}
+	}
+
+	if(ok){
+		int wrong = 0;
+
+		#pragma omp parallel for reduction(+:wrong) schedule(static)
+		for(int i = 0; i < n; i++){
+			const char *end = data + lines[i+1];
+			const char *p;
+			int nodeid, parentid = -1;
+			double weight = 0;
+			
+			p = DUtils::TextFile::Parse(data + lines[i], end, nodeid);
+			if(p) p = DUtils::TextFile::Parse(p, end, parentid);
+			if(p) p = DUtils::TextFile::Parse(p, end, weight);
+
+			float *descriptor = m_nodes.Descriptor(order[i]);
+			for(int j = 0; p && j < D; j++){
+				p = DUtils::TextFile::Parse(p, end, descriptor[j]);
+			}
+
+			if(p && DUtils::TextFile::isBlank(p, end) && 
+				parentid >= 0 && parentid < nnodes)
+			{
+				m_nodes[nodeid].Id = nodeid;
+				m_nodes[nodeid].Weight = weight;
+				parents[i] = parentid;
+			}else{
+				wrong++;
+			}
+		}
+
+		ok = (wrong == 0);
+	}
+
+	if(ok){
+		for(int i = 0; i < n; i++) m_nodes[parents[i]].NChildren++;
+		f.Seek(lines[n]);
+	}else{
+		f.Seek(start);
+		readNodes<DUtils::TextFile>(f, nnodes, order, parents);
+	}
+}
+
+template<class T>
+void HVocabulary::readWords(T &f, int nwords)
+{
+	for(int i = 0; i < nwords; i++){
+		int wordid, nodeid;
+		float frequency;
+		f >> wordid >> frequency >> nodeid;
+		
+		m_nodes[nodeid].WId = wordid;
+		m_words[wordid] = nodeid;
+		m_word_frequency[wordid] = frequency;
+	}
+}
+
+void HVocabulary::readWords(DUtils::TextFile &f, int nwords)
+{
+	const int nnodes = m_nodes.size();
+	const unsigned int start = f.Position();
+	const char *data = f.Data();
+
+	vector<unsigned int> lines;
+	bool ok = f.FindLines(nwords, lines);
+
+	vector<int> wids(nwords);
+
+	// the ids are read first, so that each line writes a different word
+	if(ok){
+		vector<bool> found(nwords, false);
+
+		for(int i = 0; ok && i < nwords; i++){
+			ok = DUtils::TextFile::Parse(data + lines[i], data + lines[i+1], 
+				wids[i]) && wids[i] >= 0 && wids[i] < nwords && !found[wids[i]];
+
+			if(ok) found[wids[i]] = true;
+		}
+	}
+
+	if(ok){
+		int wrong = 0;
+
+		#pragma omp parallel for reduction(+:wrong) schedule(static)
+		for(int i = 0; i < nwords; i++){
+			const char *end = data + lines[i+1];
+			const char *p;
+			int wordid, nodeid = -1;
+			float frequency = 0;
+
+			p = DUtils::TextFile::Parse(data + lines[i], end, wordid);
+			if(p) p = DUtils::TextFile::Parse(p, end, frequency);
+			if(p) p = DUtils::TextFile::Parse(p, end, nodeid);
+
+			if(p && DUtils::TextFile::isBlank(p, end) && 
+				nodeid >= 0 && nodeid < nnodes)
+			{
+				m_words[wordid] = nodeid;
+				m_word_frequency[wordid] = frequency;
+			}else{
+				wrong++;
+			}
+		}
+
+		ok = (wrong == 0);
+	}
+
+	if(ok){
+		// several words could be given the same node in a wrong file
+		for(int i = 0; i < nwords; i++) m_nodes[m_words[i]].WId = i;
+		f.Seek(lines[nwords]);
+	}else{
+		f.Seek(start);
+		readWords<DUtils::TextFile>(f, nwords);
+	}
+}
+
 template<class T>
 void HVocabulary::_load(T &f, int nwords)
 {
@@ -480,44 +1575,51 @@ void HVocabulary::_load(T &f, int nwords)
 	// removes nodes, words and frequencies
 	m_created = false;
 	m_words.clear();
-	m_nodes.clear();
+	m_nodes.Clear();
 	m_word_frequency.clear();
 
+	// the generic header sets the parameters of the base class only
+	m_params.Weighting = Weighting();
+	m_params.Scoring = Scoring();
+	m_params.ScaleScore = ScaleScore();
+	m_params.DescriptorLength = DescriptorLength();
+
 	// h header
 	int nnodes;
 	f >> m_params.k >> m_params.L >> nnodes;
 
-	// creates all the nodes at a time
-	m_nodes.resize(nnodes);
-	m_nodes[0].Id = 0; // root node
-
-	for(int i = 1; i < nnodes; i++){
-		int nodeid, parentid;
-		double weight;
-		f >> nodeid >> parentid >> weight;
+	if(nnodes < 1) throw DUtils::DException("Wrong number of nodes");
 
-		m_nodes[nodeid].Id = nodeid;
-		m_nodes[nodeid].Weight = weight;
-		m_nodes[parentid].Children.push_back(nodeid);
+	// creates all the nodes at a time
+	const int D = m_params.DescriptorLength;
+	m_nodes.D = D;
+	m_nodes.nodes.resize(nnodes);
+	m_nodes.descriptors.resize(nnodes * D, 0);
+
+	// nodes are not in order. The children of each node are placed 
+	// together afterwards, in the order they are read
+	vector<NodeId> order(nnodes - 1), parents(nnodes - 1);
+
+	readNodes(f, nnodes, order, parents);
+
+	unsigned int offset = 0;
+	vector<Node>::iterator nit;
+	for(nit = m_nodes.nodes.begin(); nit != m_nodes.nodes.end(); nit++){
+		nit->FirstChild = offset;
+		offset += nit->NChildren;
+		nit->NChildren = 0;
+	}
 
-		m_nodes[nodeid].Descriptor.resize(m_params.DescriptorLength);
-		for(int j = 0; j < m_params.DescriptorLength; j++){
-			f >> m_nodes[nodeid].Descriptor[j];
-		}
+	m_nodes.children.resize(nnodes - 1);
+	for(int i = 0; i < nnodes - 1; i++){
+		Node &parent = m_nodes[parents[i]];
+		m_nodes.children[parent.FirstChild + parent.NChildren++] = order[i];
 	}
 
 	m_words.resize(nwords);
 	m_word_frequency.resize(nwords);
 
-	for(int i = 0; i < nwords; i++){
-		int wordid, nodeid;
-		float frequency;
-		f >> wordid >> frequency >> nodeid;
-		
-		m_nodes[nodeid].WId = wordid;
-		m_words[wordid] = &m_nodes[nodeid];
-		m_word_frequency[wordid] = frequency;
-	}
+	readWords(f, nwords);
 
 	// all was ok
 	m_created = true;
@@ -531,7 +1633,9 @@ void HVocabulary::_load(T &f, int nwords)
 
 
 void HVocabulary::RandomClustersPlusPlus(vector<float>& clusters, 
-										 const vector<pFeature> &pfeatures) const
+										 const DescriptorView &pfeatures,
+										 DUtils::RandomGenerator &rng,
+										 const vector<double> *weights) const
 {
 	// Implements kmeans++ seeding algorithm
 	// Algorithm:
@@ -543,88 +1647,165 @@ void HVocabulary::RandomClustersPlusPlus(vector<float>& clusters,
 	// 4. Repeat Steps 2 and 3 until k centers have been chosen.
 	// 5. Now that the initial centers have been chosen, proceed using standard k-means 
 	//    clustering.
+	//
+	// D(x)^2 is kept for every point and updated only with the last chosen 
+	// center. Chosen points have D(x) = 0, so they cannot be chosen again.
+	// If weights are given, the probabilities are multiplied by them.
 
-	clusters.resize(m_params.k * m_params.DescriptorLength);
+	const int D = m_params.DescriptorLength;
+	const int nfeatures = pfeatures.Rows();
 
-	vector<bool> feature_used(pfeatures.size(), false);
+	assert(weights == NULL || (int)weights->size() == nfeatures);
+
+	clusters.resize(m_params.k * D);
 
 	// 1.
-	int ifeature = DUtils::Random::RandomInt(0, pfeatures.size()-1);
-	feature_used[ifeature] = true;
+	int ifeature;
+	if(weights == NULL){
+		ifeature = rng.RandomInt(0, nfeatures-1);
+	}else{
+		ifeature = RandomWeightedIndex(*weights, rng);
+	}
 	
 	// create first cluster
-	copy(pfeatures[ifeature], pfeatures[ifeature] + m_params.DescriptorLength, 
-		clusters.begin());
+	copy(pfeatures[ifeature], pfeatures[ifeature] + D, clusters.begin());
 	int used_clusters = 1;
+
+	vector<double> sqdistances(nfeatures, numeric_limits<double>::max());
+	vector<double> probs; // D(x)^2 * weight
 	
+	while(used_clusters < m_params.k){
+		// 2.
+		UpdateMinSqDistances(pfeatures, &clusters[(used_clusters-1) * D], 
+			sqdistances);
 
-	vector<double> sqdistances; 
-	vector<int> ifeatures;
+		// 3.
+		if(weights == NULL){
+			ifeature = RandomWeightedIndex(sqdistances, rng);
+		}else{
+			probs.resize(nfeatures);
+			for(int i = 0; i < nfeatures; i++) 
+				probs[i] = sqdistances[i] * (*weights)[i];
+			ifeature = RandomWeightedIndex(probs, rng);
+		}
 
-	sqdistances.reserve(pfeatures.size());
-	ifeatures.reserve(pfeatures.size());
+		if(ifeature < 0) break; // all the points are already centers
 
-	vector<pFeature>::const_iterator fit;
+		copy(pfeatures[ifeature], pfeatures[ifeature] + D, 
+			clusters.begin() + used_clusters * D);
+		used_clusters++;
+	}
 
-	while(used_clusters < m_params.k){
-		// 2.
-		sqdistances.resize(0);
-		ifeatures.resize(0);
-		
-		for(fit = pfeatures.begin(); fit != pfeatures.end(); fit++){
-			ifeature = fit - pfeatures.begin();
-			if(!feature_used[ifeature]){
-				
-				double min_sqd = DescriptorSqDistance(*fit, clusters.begin());
-				for(int i = 1; i < used_clusters; i++){
-					double sqd = DescriptorSqDistance(*fit, 
-						clusters.begin() + i * m_params.DescriptorLength);
+	if(used_clusters < m_params.k)
+		clusters.resize(used_clusters * D);
 
-					if(sqd < min_sqd){
-						min_sqd = sqd;
-					}
-				}
+}
 
-				sqdistances.push_back(min_sqd);
-				ifeatures.push_back(ifeature);
-			}
-		}
+void HVocabulary::RandomClustersScalable(vector<float>& clusters, 
+	const DescriptorView &pfeatures, DUtils::RandomGenerator &rng) const
+{
+	// Implements kmeans|| (Bahmani et al., Scalable K-Means++, 2012)
+	// Algorithm:
+	// 1. Choose one candidate uniformly at random from among the data points.
+	// 2. For some rounds, sample each data point x independently with
+	//    probability l * D(x)^2 / sum(D^2), where l is an oversampling factor,
+	//    and add them to the candidates. D(x) is updated only with the new 
+	//    candidates.
+	// 3. Weight each candidate with the number of points closest to it.
+	// 4. Choose k centers from the candidates with weighted kmeans++.
+
+	const int D = m_params.DescriptorLength;
+	const int nfeatures = pfeatures.Rows();
+	const double l = KMEANS_PARALLEL_OVERSAMPLING * m_params.k;
 
-		// 3.
+	// 1.
+	vector<pFeature> candidates;
+	candidates.push_back(pfeatures[ rng.RandomInt(0, nfeatures-1) ]);
+
+	vector<double> sqdistances(nfeatures, numeric_limits<double>::max());
+	UpdateMinSqDistances(pfeatures, candidates[0], sqdistances);
+
+	// 2.
+	for(int round = 0; round < KMEANS_PARALLEL_ROUNDS; round++){
 		double sqd_sum = accumulate(sqdistances.begin(), sqdistances.end(), 0.0);
+		if(sqd_sum <= 0) break;
 
-		if(sqd_sum > 0){
-			double cut_d;
-			do{
-				cut_d = DUtils::Random::RandomValue<double>(0, sqd_sum);
-			}while(cut_d == 0.0);
-
-			double d_up_now = 0;
-			vector<double>::iterator dit;
-			for(dit = sqdistances.begin(); dit != sqdistances.end(); dit++){
-				d_up_now += *dit;
-				if(d_up_now >= cut_d) break;
+		unsigned int first_new = candidates.size();
+
+		for(int i = 0; i < nfeatures; i++){
+			if(sqdistances[i] > 0 && 
+				rng.RandomValue<double>() * sqd_sum < l * sqdistances[i])
+			{
+				candidates.push_back(pfeatures[i]);
 			}
-			if(dit == sqdistances.end()) dit = sqdistances.begin() + sqdistances.size()-1;
+		}
+
+		for(unsigned int c = first_new; c < candidates.size(); c++){
+			UpdateMinSqDistances(pfeatures, candidates[c], sqdistances);
+		}
+	}
 
-			ifeature = ifeatures[dit - sqdistances.begin()];
+	// 3.
+	const int ncandidates = candidates.size();
 
-			assert(!feature_used[ifeature]);
+	vector<float> candidate_clusters(ncandidates * D);
+	for(int c = 0; c < ncandidates; c++){
+		copy(candidates[c], candidates[c] + D, candidate_clusters.begin() + c * D);
+	}
 
-			copy(pfeatures[ifeature], pfeatures[ifeature] + m_params.DescriptorLength, 
-				clusters.begin() + used_clusters * m_params.DescriptorLength);
-			feature_used[ifeature] = true;
-			used_clusters++;
-			
-		}else
-			break;
+	vector<int> nearest(nfeatures);
+
+	#pragma omp parallel for schedule(static)
+	for(int i = 0; i < nfeatures; i++){
+		nearest[i] = NearestCluster(pfeatures[i], candidate_clusters);
 	}
 
-	if(used_clusters < m_params.k)
-		clusters.resize(used_clusters * m_params.DescriptorLength);
+	vector<double> weights(ncandidates, 0);
+	for(int i = 0; i < nfeatures; i++) weights[ nearest[i] ] += 1;
+
+	// 4.
+	RandomClustersPlusPlus(clusters, DescriptorView(candidate_clusters, D), 
+		rng, &weights);
+}
 
+void HVocabulary::UpdateMinSqDistances(const DescriptorView &pfeatures,
+	const float *center, vector<double> &sqdistances) const
+{
+	const int nfeatures = pfeatures.Rows();
+
+	#pragma omp parallel for schedule(static) if(nfeatures > PARALLEL_MIN_FEATURES)
+	for(int i = 0; i < nfeatures; i++){
+		if(sqdistances[i] > 0){
+			double sqd = DescriptorSqDistance(pfeatures[i], center);
+			if(sqd < sqdistances[i]) sqdistances[i] = sqd;
+		}
+	}
 }
 
+int HVocabulary::RandomWeightedIndex(const vector<double> &weights,
+	DUtils::RandomGenerator &rng) const
+{
+	// sum in order so that the result does not depend on the number of threads
+	double sum = accumulate(weights.begin(), weights.end(), 0.0);
+	if(sum <= 0) return -1;
+
+	double cut;
+	do{
+		cut = rng.RandomValue<double>(0, sum);
+	}while(cut == 0.0);
+
+	double up_now = 0;
+	int last_positive = -1;
+	for(unsigned int i = 0; i < weights.size(); i++){
+		if(weights[i] > 0){
+			up_now += weights[i];
+			last_positive = i;
+			if(up_now >= cut) break;
+		}
+	}
+	
+	return last_positive;
+}
 
 double HVocabulary::DescriptorSqDistance(const pFeature &v, 
 			const pFeature &w) const
@@ -634,20 +1815,20 @@ double HVocabulary::DescriptorSqDistance(const pFeature &v,
 	const int rest = m_params.DescriptorLength % 4;
 
 	for(int i = 0; i < m_params.DescriptorLength - rest; i += 4){
-		sqd += (*(v + i) - *(w + i)) * (*(v + i) - *(w + i));
-		sqd += (*(v + i + 1) - *(w + i + 1)) * (*(v + i + 1) - *(w + i + 1));
-		sqd += (*(v + i + 2) - *(w + i + 2)) * (*(v + i + 2) - *(w + i + 2));
-		sqd += (*(v + i + 3) - *(w + i + 3)) * (*(v + i + 3) - *(w + i + 3));
+		sqd += (v[i] - w[i]) * (v[i] - w[i]);
+		sqd += (v[i + 1] - w[i + 1]) * (v[i + 1] - w[i + 1]);
+		sqd += (v[i + 2] - w[i + 2]) * (v[i + 2] - w[i + 2]);
+		sqd += (v[i + 3] - w[i + 3]) * (v[i + 3] - w[i + 3]);
 	}
 
 	for(int i = m_params.DescriptorLength - rest; i < m_params.DescriptorLength; i++){
-		sqd += (*(v + i) - *(w + i)) * (*(v + i) - *(w + i));
+		sqd += (v[i] - w[i]) * (v[i] - w[i]);
 	}
 
 	return sqd;
 }
 
-void HVocabulary::SetNodeWeights(const vector<vector<float> >& training_features)
+void HVocabulary::SetNodeWeights(const vector<DescriptorView>& training_features)
 {
 	vector<WordValue> weights;
 	GetWordWeightsAndCreateStopList(training_features, weights);
@@ -655,30 +1836,66 @@ void HVocabulary::SetNodeWeights(const vector<vector<float> >& training_features
 	assert(weights.size() == m_words.size());
 
 	for(unsigned int i = 0; i < m_words.size(); i++){
-		m_words[i]->Weight = weights[i];
+		m_nodes[m_words[i]].Weight = weights[i];
+	}
+}
+
+void HVocabulary::SetNodeWeights(const char *filename)
+{
+	vector<unsigned int> Ni;
+	InitWordStatistics(Ni);
+
+	DescriptorFile f(filename);
+	vector<float> document;
+	int ndocs = 0;
+
+	while(f.Read(document)){
+		AddToWordStatistics(DescriptorView(document, m_params.DescriptorLength), Ni);
+		ndocs++;
+	}
+
+	vector<WordValue> weights;
+	SetWordWeightsAndCreateStopList(Ni, ndocs, weights);
+
+	assert(weights.size() == m_words.size());
+
+	for(unsigned int i = 0; i < m_words.size(); i++){
+		m_nodes[m_words[i]].Weight = weights[i];
 	}
 }
 
-WordId HVocabulary::Transform(const vector<float>::const_iterator &pfeature) const
+WordId HVocabulary::Transform(const float *pfeature) const
+{
+	vector<BeamEntry> leaves, buffer;
+	return Transform(pfeature, leaves, buffer);
+}
+
+WordId HVocabulary::Transform(const float *pfeature, 
+	vector<BeamEntry> &leaves, vector<BeamEntry> &buffer) const
 {
 	if(isEmpty()) return 0;
 
 	assert(!m_nodes[0].isLeaf());
 
+	if(m_beam_width > 1){
+		BeamSearch(pfeature, m_beam_width, leaves, buffer);
+		return m_nodes[leaves[0].Id].WId;
+	}
+
 	// propagate the feature down the tree
-	vector<NodeId> nodes;
-	vector<NodeId>::const_iterator it;
+	const NodeId *it;
 	
 	NodeId final_id = 0; // root
 
 	do{
-		nodes = m_nodes[final_id].Children;
+		const NodeId *nodes = m_nodes.Children(final_id);
+		const NodeId *nend = nodes + m_nodes[final_id].NChildren;
 		final_id = nodes[0];
-		double best_sqd = DescriptorSqDistance(pfeature, m_nodes[final_id].Descriptor.begin());
+		double best_sqd = DescriptorSqDistance(pfeature, m_nodes.Descriptor(final_id));
 
-		for(it = nodes.begin() + 1; it != nodes.end(); it++){
+		for(it = nodes + 1; it != nend; it++){
 			NodeId id = *it;
-			double sqd = DescriptorSqDistance(pfeature, m_nodes[id].Descriptor.begin());
+			double sqd = DescriptorSqDistance(pfeature, m_nodes.Descriptor(id));
 			if(sqd < best_sqd){
 				best_sqd = sqd;
 				final_id = id;
@@ -690,6 +1907,218 @@ WordId HVocabulary::Transform(const vector<float>::const_iterator &pfeature) con
 	return m_nodes[final_id].WId;
 }
 
+void HVocabulary::Transform(const float *pfeature, WordId &wid, NodeId &nid,
+							int level) const
+{
+	vector<BeamEntry> leaves, buffer;
+	Transform(pfeature, wid, nid, level, leaves, buffer);
+}
+
+void HVocabulary::Transform(const float *pfeature, WordId &wid, NodeId &nid,
+	int level, vector<BeamEntry> &leaves, vector<BeamEntry> &buffer) const
+{
+	wid = 0;
+	nid = 0;
+
+	if(isEmpty()) return;
+
+	assert(!m_nodes[0].isLeaf());
+
+	if(m_beam_width > 1){
+		BeamSearch(pfeature, m_beam_width, leaves, buffer, level);
+		wid = m_nodes[leaves[0].Id].WId;
+		nid = leaves[0].LevelId;
+		return;
+	}
+
+	// same descent as Transform(pfeature), but keeping the node at level
+	const NodeId *it;
+	
+	NodeId final_id = 0; // root
+	int current_level = 0;
+
+	do{
+		const NodeId *nodes = m_nodes.Children(final_id);
+		const NodeId *nend = nodes + m_nodes[final_id].NChildren;
+		final_id = nodes[0];
+		double best_sqd = DescriptorSqDistance(pfeature, m_nodes.Descriptor(final_id));
+
+		for(it = nodes + 1; it != nend; it++){
+			NodeId id = *it;
+			double sqd = DescriptorSqDistance(pfeature, m_nodes.Descriptor(id));
+			if(sqd < best_sqd){
+				best_sqd = sqd;
+				final_id = id;
+			}
+		}
+
+		if(++current_level <= level) nid = final_id;
+
+	} while( !m_nodes[final_id].isLeaf() );
+	
+	// turn node id into word id
+	wid = m_nodes[final_id].WId;
+}
+
+void HVocabulary::Transform(const DescriptorView& features, BowVector &v,
+							FeatureVector &fv, int level, bool arrange) const
+{
+	vector<WordId> words;
+	Transform(features, v, words, fv, level, arrange);
+}
+
+void HVocabulary::Transform(const DescriptorView& features, BowVector &v,
+							vector<WordId> &words, FeatureVector &fv, int level, 
+							bool arrange) const
+{
+	assert(features.empty() || features.Cols() == m_params.DescriptorLength);
+	assert(level > 0);
+
+	const int nfeatures = features.Rows();
+
+	words.resize(nfeatures);
+	fv.clear();
+
+	vector<BeamEntry> leaves, buffer;
+
+	for(int i = 0; i < nfeatures; i++){
+		NodeId nid;
+		Transform(features[i], words[i], nid, level, leaves, buffer);
+		
+		if(!isWordStopped(words[i])) fv.AddFeature(nid, i);
+	}
+
+	ComputeBowVector(words, v, arrange);
+}
+
+void HVocabulary::Transform(const DescriptorView& features, BowVector &v,
+							vector<WordId> &words, vector<BeamEntry> &leaves, 
+							vector<BeamEntry> &buffer, bool arrange) const
+{
+	assert(features.empty() || features.Cols() == m_params.DescriptorLength);
+
+	const int nfeatures = features.Rows();
+
+	words.resize(nfeatures);
+
+	for(int i = 0; i < nfeatures; i++){
+		words[i] = Transform(features[i], leaves, buffer);
+	}
+
+	ComputeBowVector(words, v, arrange);
+}
+
+void HVocabulary::transformFeatures(const DescriptorView &features,
+									vector<WordId> &words) const
+{
+	vector<BeamEntry> leaves, buffer;
+	const int nfeatures = features.Rows();
+
+	words.resize(nfeatures);
+
+	for(int i = 0; i < nfeatures; i++){
+		words[i] = Transform(features[i], leaves, buffer);
+	}
+}
+
+void HVocabulary::SetBeamWidth(int beam_width)
+{
+	assert(beam_width > 0);
+	m_beam_width = (beam_width > 0 ? beam_width : 1);
+}
+
+void HVocabulary::BeamSearch(const float *pfeature, int beam_width, 
+	vector<BeamEntry> &leaves, vector<BeamEntry> &buffer, int level) const
+{
+	// leaves is used as the current beam and buffer as the next one
+	leaves.resize(0);
+	leaves.push_back(BeamEntry(0, 0, 0, 0)); // root
+
+	bool expanded;
+	do{
+		expanded = false;
+		buffer.resize(0);
+
+		vector<BeamEntry>::const_iterator bit;
+		for(bit = leaves.begin(); bit != leaves.end(); bit++){
+			const Node &node = m_nodes[bit->Id];
+
+			if(node.isLeaf()){
+				// finished paths compete with the expanded ones
+				buffer.push_back(*bit);
+			}else{
+				expanded = true;
+
+				const NodeId *cit = m_nodes.Children(bit->Id);
+				const NodeId *cend = cit + node.NChildren;
+				for(; cit != cend; cit++){
+					double sqd = DescriptorSqDistance(pfeature, 
+						m_nodes.Descriptor(*cit));
+					
+					NodeId level_id = (bit->Level < level ? *cit : bit->LevelId);
+
+					buffer.push_back(BeamEntry(sqd, *cit, level_id, bit->Level + 1));
+				}
+			}
+		}
+
+		// keep the closest paths
+		if((int)buffer.size() > beam_width){
+			nth_element(buffer.begin(), buffer.begin() + beam_width, buffer.end());
+			buffer.resize(beam_width);
+		}
+
+		leaves.swap(buffer);
+
+	}while(expanded);
+
+	sort(leaves.begin(), leaves.end());
+}
+
+void HVocabulary::SoftTransform(const DescriptorView& features, BowVector &v,
+	int nwords, double sigma, bool arrange) const
+{
+	assert(features.empty() || features.Cols() == m_params.DescriptorLength);
+	assert(nwords > 0 && sigma > 0);
+
+	v.resize(0);
+	if(isEmpty()) return;
+
+	const int nfeatures = features.Rows();
+	const int beam_width = max(nwords, m_beam_width);
+	const double k = -1. / (2. * sigma * sigma);
+
+	vector<WordId> words;
+	vector<WordValue> contributions;
+	words.reserve(nfeatures * nwords);
+	contributions.reserve(nfeatures * nwords);
+
+	vector<BeamEntry> leaves, buffer;
+	leaves.reserve(beam_width * m_params.k);
+	buffer.reserve(beam_width * m_params.k);
+
+	for(int i = 0; i < nfeatures; i++){
+		BeamSearch(features[i], beam_width, leaves, buffer);
+
+		const int n = min(nwords, (int)leaves.size());
+
+		// weights are relative to the closest word to avoid underflows
+		double sum = 0;
+		for(int j = 0; j < n; j++){
+			double w = exp(k * (leaves[j].sqd - leaves[0].sqd));
+			words.push_back(m_nodes[leaves[j].Id].WId);
+			contributions.push_back(w);
+			sum += w;
+		}
+
+		// each feature counts as one occurrence in total
+		for(unsigned int j = contributions.size() - n; j < contributions.size(); j++)
+			contributions[j] /= sum;
+	}
+
+	ComputeBowVector(words, v, arrange, &contributions);
+}
+
 void HVocabulary::CreateWords()
 {
 	m_words.resize(0);
@@ -697,10 +2126,10 @@ void HVocabulary::CreateWords()
 
 	// the actual order of the words is not important
 	vector<Node>::iterator it;
-	for(it = m_nodes.begin(); it != m_nodes.end(); it++){
+	for(it = m_nodes.nodes.begin(); it != m_nodes.nodes.end(); it++){
 		if(it->isLeaf()){
 			it->WId = m_words.size();
-			m_words.push_back( &(*it) );
+			m_words.push_back(it->Id);
 		}
 	}
 }
@@ -711,5 +2140,5 @@ WordValue HVocabulary::GetWordWeight(WordId id) const
 
 	assert(id < m_words.size());
 
-	return m_words[id]->Weight;
+	return m_nodes[m_words[id]].Weight;
 }
@@ -11,9 +11,13 @@
 
 #include "Vocabulary.h"
 #include "BowVector.h"
+#include "FeatureVector.h"
 #include "HVocParams.h"
+#include "RandomGenerator.h"
 
 #include <vector>
+#include <string>
+#include <map>
 using namespace std;
 
 namespace DBow {
@@ -30,7 +34,8 @@ namespace DBow {
 		HVocabulary(const HVocParams &params);
 
 		/**
-		 * Copy constructor. Allocates new data
+		 * Copy constructor. Allocates new data. The tree is copied as a few
+		 * blocks of memory
 		 * @param voc vocabulary to copy
 		 */
 		HVocabulary(const HVocabulary &voc);
@@ -46,13 +51,78 @@ namespace DBow {
 		 */
 		~HVocabulary(void);
 
+		/**
+		 * Exchanges the content of two vocabularies without copying them.
+		 * This moves a vocabulary into another one:
+		 *   HVocabulary voc(params); voc.swap(other);
+		 * @param voc vocabulary
+		 */
+		void swap(HVocabulary &voc);
+
 		/** 
 		 * Creates the vocabulary from some training data. 
 		 * The current content of the vocabulary is cleared
 		 * @see Vocabulary::Create
-		 * @param training_features vector of groups of features in the OpenCV format.
+		 * @param training_features vector of views of groups of features
+		 */
+		void Create(const vector<DescriptorView>& training_features);
+
+		/**
+		 * Creates the vocabulary from features in the OpenCV format
+		 * @see Vocabulary::Create
+		 */
+		using Vocabulary::Create;
+
+		/** 
+		 * Creates the vocabulary from the training features stored in a file,
+		 * keeping at most max_features features in memory at a time.
+		 * The upper levels of the tree are created with a random sample of
+		 * the features. Then, all the features are partitioned among the
+		 * nodes of the last level created by storing them in temporary files,
+		 * which are used to create the lower levels of each subtree.
+		 * The current content of the vocabulary is cleared
+		 * @param filename file with the features of each training image
+		 *    @see DescriptorFile
+		 * @param max_features max number of features held in memory
+		 * @param tmp_path directory to store temporary files in
+		 * @throws DException if the files cannot be read or written
 		 */
-		void Create(const vector<vector<float> >& training_features);
+		void CreateFromFile(const char *filename, int max_features, 
+			const char *tmp_path);
+
+		/**
+		 * Adapts the vocabulary to new data without creating it again.
+		 * The words that receive more than max_frequency of the features of 
+		 * the given documents are split into up to k new words by running 
+		 * kmeans with their features, so that the leaves become internal 
+		 * nodes. The first new word keeps the id of the split word, and the
+		 * others are given new ids after the last word. The new words take
+		 * the weight and frequency of the split word, adjusted by the share
+		 * of its features and documents that each one receives. The other 
+		 * words keep their weights and frequencies, and the same number of
+		 * words is stopped
+		 * @see UpdateWeights
+		 * @param documents features of some new images
+		 * @param max_frequency frequency in per one units above which a word
+		 *    is split
+		 * @param splits (out) splits[old word id] = ids of the words it was
+		 *    split into (including the old id). Databases using the old 
+		 *    vocabulary must be updated with this (@see Database::RemapWords)
+		 * @return number of words split
+		 */
+		int SplitWords(const vector<DescriptorView> &documents, 
+			float max_frequency, map<WordId, vector<WordId> > &splits);
+
+		/**
+		 * Computes the weights and frequencies of all the words with the 
+		 * given documents, instead of the ones used to create the vocabulary.
+		 * Words that do not appear in the documents get a null idf, so that 
+		 * the documents must be the whole training set (plus any new data).
+		 * The same number of words is stopped.
+		 * Bow vectors created before calling this are not updated
+		 * @param documents features of all the training images
+		 */
+		void UpdateWeights(const vector<DescriptorView> &documents);
 
 		/**
 		 * Transforms a set of features into a bag-of-words vector
@@ -60,6 +130,108 @@ namespace DBow {
 		 */
 		using Vocabulary::Transform;
 
+		/**
+		 * Transforms a set of features into a bag-of-words vector and groups
+		 * the features by the node they went through at the given level of
+		 * the tree. Both are computed in the same descent of the tree.
+		 * Features of stopped words are not added to fv.
+		 * @see Vocabulary::Transform
+		 * @param features view of the image features
+		 * @param v (out) bow vector
+		 * @param fv (out) feature vector: node id -> indices of features
+		 * @param level level of the nodes stored in fv (1 is the level of the 
+		 *    children of the root, L the deepest one). Features that reach a
+		 *    leaf above this level are stored with that leaf
+		 * @param arrange (default: true) deprecated, not used: entries in v
+		 *    are always put in order
+		 */
+		void Transform(const DescriptorView& features, BowVector &v,
+			FeatureVector &fv, int level, bool arrange = true) const;
+
+		/**
+		 * Transforms a set of features into a bag-of-words vector, and returns
+		 * both the word of each feature and the features grouped by node.
+		 * @see HVocabulary::Transform(const DescriptorView&, BowVector&, 
+		 *   FeatureVector&, int, bool)
+		 * @param words (out) words[i] is the word id of the i-th feature
+		 */
+		void Transform(const DescriptorView& features, BowVector &v,
+			vector<WordId> &words, FeatureVector &fv, int level, 
+			bool arrange = true) const;
+
+		/**
+		 * Transforms a set of features into a bag-of-words vector by assigning
+		 * each feature to its nwords closest words, found with a beam search.
+		 * The occurrence of a feature is shared among its words according to
+		 * exp(-d^2 / (2 sigma^2)), where d is the distance between the feature
+		 * and the word (Philbin et al, 2008).
+		 * @param features view of the image features
+		 * @param v (out) bow vector
+		 * @param nwords max number of words each feature is assigned to. 
+		 *    The beam used is at least this wide
+		 * @param sigma spread of the weights in the descriptor space
+		 * @param arrange (default: true) deprecated, not used: entries in v
+		 *    are always put in order
+		 */
+		void SoftTransform(const DescriptorView& features, BowVector &v,
+			int nwords, double sigma, bool arrange = true) const;
+
+		/**
+		 * Sets the number of paths kept at each level of the tree when a 
+		 * feature is transformed. With 1 (default), only the closest child 
+		 * is followed at each level (greedy descent). With B > 1, the B 
+		 * closest nodes are kept at each level, which reduces quantization
+		 * errors at the top of the tree at the cost of B times more 
+		 * distance computations. This value is not saved with the vocabulary
+		 * @param beam_width number of paths (>= 1)
+		 */
+		void SetBeamWidth(int beam_width);
+
+		/**
+		 * Returns the current beam width
+		 * @return beam width
+		 */
+		inline int BeamWidth() const { return m_beam_width; }
+
+		/**
+		 * Candidate path in a beam search
+		 */
+		struct BeamEntry {
+			double sqd; // squared distance from the feature to the node
+			NodeId Id; // last node of the path
+			NodeId LevelId; // node of the path at the level requested
+			int Level; // level of Id
+
+			BeamEntry(){}
+			BeamEntry(double _sqd, NodeId _id, NodeId _level_id, int _level):
+				sqd(_sqd), Id(_id), LevelId(_level_id), Level(_level){}
+
+			/**
+			 * Compares the distances of two entries
+			 * @return true iif this.sqd < e.sqd
+			 */
+			inline bool operator<(const BeamEntry &e) const {
+				return sqd < e.sqd;
+			}
+		};
+
+		/**
+		 * Transforms a set of features into a bag-of-words vector with the
+		 * given auxiliar vectors for the beam search, so that they can be
+		 * reused between images
+		 * @see Vocabulary::Transform
+		 * @param features view of the image features
+		 * @param v (out) bow vector
+		 * @param words (out) words[i] is the word id of the i-th feature
+		 * @param leaves auxiliar vector to reuse between calls
+		 * @param buffer auxiliar vector to reuse between calls
+		 * @param arrange (default: true) deprecated, not used: entries in v
+		 *    are always put in order
+		 */
+		void Transform(const DescriptorView& features, BowVector &v,
+			vector<WordId> &words, vector<BeamEntry> &leaves, 
+			vector<BeamEntry> &buffer, bool arrange = true) const;
+
 	protected:
 		
 		/** 
@@ -86,6 +258,12 @@ namespace DBow {
 		 */
 		unsigned int LoadText(const char *filename);
 
+		/**
+		 * Adds the tree to a hash
+		 * @param h (in/out) hash
+		 */
+		void hashContent(ContentHash &h) const;
+
 		/**
 		 * Returns the weight of a word
 		 * @see Vocabulary::GetWordWeight
@@ -108,70 +286,407 @@ namespace DBow {
 		 *     size vector containing the feature descriptor
 		 * @return word id
 		 */
-		WordId Transform(const vector<float>::const_iterator &pfeature) const;
+		WordId Transform(const float *pfeature) const;
+
+		/**
+		 * Transforms a feature into its word id and returns the node it went
+		 * through at the given level
+		 * @param pfeature feature descriptor
+		 * @param wid (out) word id
+		 * @param nid (out) id of the node at the given level, or of the leaf 
+		 *    reached if it is above that level
+		 * @param level level of nid (1..L)
+		 */
+		void Transform(const float *pfeature, WordId &wid, NodeId &nid, 
+			int level) const;
+
+		/**
+		 * Transforms a feature into its word id reusing the vectors of 
+		 * the beam search
+		 * @see HVocabulary::Transform(const float*)
+		 * @param leaves auxiliar vector to reuse between calls
+		 * @param buffer auxiliar vector to reuse between calls
+		 */
+		WordId Transform(const float *pfeature, vector<BeamEntry> &leaves,
+			vector<BeamEntry> &buffer) const;
+
+		/**
+		 * Transforms a feature into its word id and the node at the given
+		 * level reusing the vectors of the beam search
+		 * @see HVocabulary::Transform(const float*, WordId&, NodeId&, int)
+		 * @param leaves auxiliar vector to reuse between calls
+		 * @param buffer auxiliar vector to reuse between calls
+		 */
+		void Transform(const float *pfeature, WordId &wid, NodeId &nid, 
+			int level, vector<BeamEntry> &leaves, 
+			vector<BeamEntry> &buffer) const;
+
+		/**
+		 * Transforms the features of an image into their word ids with
+		 * the same vectors for the beam search of all the features
+		 * @see Vocabulary::transformFeatures
+		 */
+		void transformFeatures(const DescriptorView &features,
+			vector<WordId> &words) const;
+
+	protected:
+
+		/**
+		 * Propagates a feature down the tree keeping the beam_width closest
+		 * nodes at each level, until all of them are leaves
+		 * @param pfeature feature descriptor
+		 * @param beam_width number of paths kept
+		 * @param leaves (out) leaves reached, in ascending order of distance
+		 * @param buffer auxiliar vector to reuse between calls
+		 * @param level (default: 0) level whose nodes are kept in 
+		 *    BeamEntry::LevelId
+		 */
+		void BeamSearch(const float *pfeature, int beam_width, 
+			vector<BeamEntry> &leaves, vector<BeamEntry> &buffer, 
+			int level = 0) const;
 
 	protected:
 
 		// Voc parameters
 		HVocParams m_params;
 
-		typedef unsigned int NodeId;
+		// Number of paths kept when transforming features
+		int m_beam_width;
+
 		typedef unsigned int DocId;
 
 		struct Node {
 			NodeId Id;
-			vector<NodeId> Children;
 			WordValue Weight;
-			vector<float> Descriptor;
-			
 			WordId WId; // if this node is a leaf, it will have a word id
+			
+			// the ids of the children are NodeStore::children[FirstChild ..
+			// FirstChild + NChildren - 1]
+			unsigned int FirstChild;
+			unsigned int NChildren;
 
 			/**
 			 * Constructor
 			 */
-			Node(): Id(0), Weight(0), WId(-1){}
-			Node(NodeId _id): Id(_id), Weight(0), WId(-1){}
+			Node(): Id(0), Weight(0), WId(-1), FirstChild(0), NChildren(0){}
+			Node(NodeId _id): Id(_id), Weight(0), WId(-1), FirstChild(0), 
+				NChildren(0){}
 
 			/**
 			 * Returns if the node is a leaf node
 			 * @return true iif the node is a leaf
 			 */
-			inline bool isLeaf() const { return Children.empty(); }
+			inline bool isLeaf() const { return NChildren == 0; }
+		};
+
+		/**
+		 * Nodes of a tree. The ids of the children and the descriptors of all
+		 * the nodes are kept in two blocks of memory, which nodes refer to
+		 * by offset, so that a tree of any size needs only three allocations
+		 * and can be copied or freed at once
+		 */
+		class NodeStore
+		{
+		public:
+
+			// Nodes of the tree, including root [0]
+			vector<Node> nodes;
+
+			// Ids of the children of all the nodes. The children of a node
+			// are together
+			vector<NodeId> children;
+
+			// Descriptors of all the nodes. The descriptor of node i starts at 
+			// i * D (the one of the root is not used)
+			vector<float> descriptors;
+
+			// Descriptor length
+			int D;
+
+			/**
+			 * Creates an empty store
+			 */
+			NodeStore(): D(0){}
+
+			/**
+			 * Removes all the nodes and frees the memory
+			 */
+			void Clear();
+
+			/**
+			 * Exchanges the nodes of two stores
+			 * @param store
+			 */
+			void swap(NodeStore &store);
+
+			/**
+			 * Removes all the nodes and creates the root
+			 * @param descriptor_length descriptor length
+			 */
+			void Reset(int descriptor_length);
+
+			/**
+			 * Allocates memory for some nodes
+			 * @param nnodes total number of nodes expected
+			 */
+			void Reserve(unsigned int nnodes);
+
+			/**
+			 * Creates the children of a leaf
+			 * @param parent id of the leaf
+			 * @param pdescriptors descriptors of the new nodes, one after other
+			 * @param n number of children to create
+			 */
+			void AddChildren(NodeId parent, const float *pdescriptors, int n);
+
+			/**
+			 * Removes the children of a node, which must be the last nodes
+			 * created and must be leaves
+			 * @param parent id of the node
+			 */
+			void RemoveLastChildren(NodeId parent);
+
+			/**
+			 * Appends the nodes of a tree created apart. Node i of the subtree
+			 * (i > 0) becomes node size() + i - 1
+			 * @param id leaf where the subtree hangs from
+			 * @param subtree nodes of the subtree, whose root (0) stands for id
+			 */
+			void Append(NodeId id, const NodeStore &subtree);
+
+			/**
+			 * Returns the number of nodes
+			 * @return number of nodes
+			 */
+			inline unsigned int size() const { return nodes.size(); }
+
+			/**
+			 * Says whether there are no nodes, not even the root
+			 * @return true iif there are no nodes
+			 */
+			inline bool empty() const { return nodes.empty(); }
+
+			/**
+			 * Returns a node
+			 * @param id node id
+			 * @return node
+			 */
+			inline Node& operator[](NodeId id) { return nodes[id]; }
+			inline const Node& operator[](NodeId id) const { return nodes[id]; }
+
+			/**
+			 * Returns the ids of the children of a node
+			 * @param id node id
+			 * @return pointer to the id of the first child. There are
+			 *   nodes[id].NChildren of them
+			 */
+			inline const NodeId* Children(NodeId id) const {
+				return &children[0] + nodes[id].FirstChild;
+			}
+
+			/**
+			 * Returns the descriptor of a node
+			 * @param id node id
+			 * @return pointer to the first float of the descriptor
+			 */
+			inline const float* Descriptor(NodeId id) const {
+				return &descriptors[0] + id * D;
+			}
+			inline float* Descriptor(NodeId id) {
+				return &descriptors[0] + id * D;
+			}
 		};
 
 		// Nodes in the tree, including root [0] with no descriptor
-		vector<Node> m_nodes;
+		NodeStore m_nodes;
 
-		// The words of the vocabulary are the tree leaves
-		vector<Node*> m_words;
+		// The words of the vocabulary are the tree leaves.
+		// m_words[word id] = node id
+		vector<NodeId> m_words;
 
 		// Pointer to a feature (only used when Creating the vocabulary)
-		typedef vector<float>::const_iterator pFeature;
+		typedef const float* pFeature;
 
 	protected:
 
 		/**
 		 * Performs kmeans recursively and created the vocabulary tree.
 		 * Nodes are created without weights
+		 * The features are reordered in place so that the features of each
+		 * child node are contiguous, and the child nodes are created with
+		 * their own range of the buffer
+		 * @param nodes node list where the nodes are created
 		 * @param parentId created nodes will be children of parentId
-		 * @param pfeatures data to perform the kmeans
+		 * @param features contiguous buffer of descriptors to perform the
+		 *    kmeans. It is modified
+		 * @param nfeatures number of descriptors in the buffer
 		 * @param level current tree level (starting in 1)
 		 * @param clusters a buffer to reuse in all the HKMeansStep calls.
 		 *    It should be a vector with memory allocated for k * DescriptorLength
 		 *    floats
+		 * @param last_level nodes created at this level are not split again
+		 *    (it is usually L)
+		 * @param rng random number generator
 		 */
-		void HKMeansStep(NodeId parentId, const vector<pFeature> &pfeatures, 
-			int level,  vector<float>& clusters);
+		void HKMeansStep(NodeStore &nodes, NodeId parentId, 
+			float *features, int nfeatures, int level, vector<float>& clusters, 
+			int last_level, DUtils::RandomGenerator &rng);
+
+		/**
+		 * Returns the seed to create the vocabulary with
+		 * @return HVocParams::RandomSeed, or a seed taken from DUtils::Random
+		 *    if it is 0
+		 */
+		unsigned long long TrainingSeed() const;
+
+		/**
+		 * Reorders a buffer of descriptors so that the descriptors of each
+		 * group are contiguous, in the same order as the groups
+		 * @param features buffer of descriptors
+		 * @param groups indices of the descriptors of each group
+		 * @param offsets (out) position of the first descriptor of each group
+		 *    in the buffer. It contains one more item with the number of
+		 *    descriptors
+		 */
+		void PartitionFeatures(float *features, 
+			const vector<vector<unsigned int> > &groups, 
+			vector<int> &offsets) const;
+
+		/**
+		 * Performs kmeans recursively with the features stored in a file
+		 * @see CreateFromFile
+		 * @param parentId created nodes will be children of parentId
+		 * @param filename file with the features of the subtree
+		 * @param level current tree level (starting in 1)
+		 * @param max_features max number of features held in memory
+		 * @param spill_prefix prefix of the temporary files of this run
+		 * @param clusters a buffer to reuse in all the HKMeansStep calls
+		 * @param rng random number generator
+		 */
+		void HKMeansStepFromFile(NodeId parentId, const char *filename, 
+			int level, int max_features, const char *spill_prefix, 
+			vector<float>& clusters, DUtils::RandomGenerator &rng);
+
+		/**
+		 * Returns a prefix for the temporary files of a run of 
+		 * CreateFromFile, unique for the process, the vocabulary and the time
+		 * @param tmp_path directory of temporary files
+		 * @return path and prefix of the file names
+		 */
+		string SpillPrefix(const char *tmp_path) const;
+
+		/**
+		 * Returns the name of the temporary file of a node
+		 * @param spill_prefix prefix returned by SpillPrefix
+		 * @param id node id
+		 * @return file name
+		 */
+		string SpillFilename(const char *spill_prefix, NodeId id) const;
 
 		/**
 		 * Initiates clusters by using the algorithm of kmeans++
 		 * @param clusters (out) clusters created. Its size is multiple of
 		 *    DescriptoLength
 		 * @param pfeatures features in the data space to create the clusters
+		 * @param rng random number generator
+		 * @param weights (default: NULL) if given, weight of each feature
 		 */
 		void RandomClustersPlusPlus(vector<float>& clusters, 
-									const vector<pFeature> &pfeatures) const;
+									const DescriptorView &pfeatures,
+									DUtils::RandomGenerator &rng,
+									const vector<double> *weights = NULL) const;
+
+		/**
+		 * Initiates clusters by using the algorithm of kmeans|| (scalable
+		 * kmeans++), which needs a few passes over the features only
+		 * @param clusters (out) clusters created. Its size is multiple of
+		 *    DescriptoLength
+		 * @param pfeatures features in the data space to create the clusters
+		 * @param rng random number generator
+		 */
+		void RandomClustersScalable(vector<float>& clusters, 
+			const DescriptorView &pfeatures, DUtils::RandomGenerator &rng) const;
+
+		/**
+		 * Updates the squared distance from each feature to its nearest 
+		 * cluster with a new cluster
+		 * @param pfeatures features
+		 * @param center new cluster
+		 * @param sqdistances (in/out) squared distance of each feature
+		 */
+		void UpdateMinSqDistances(const DescriptorView &pfeatures,
+			const float *center, vector<double> &sqdistances) const;
+
+		/**
+		 * Chooses a random index with probability proportional to its weight
+		 * @param weights non-negative weights
+		 * @param rng random number generator
+		 * @return chosen index, or -1 if all the weights are 0
+		 */
+		int RandomWeightedIndex(const vector<double> &weights, 
+			DUtils::RandomGenerator &rng) const;
 		
+		/**
+		 * Chooses clusters with mini-batch kmeans. Each iteration uses only
+		 * m_params.MiniBatchSize random features, so that the cost of an 
+		 * iteration does not depend on the number of features
+		 * @param clusters (out) clusters created. Its size is multiple of
+		 *    DescriptoLength
+		 * @param pfeatures features in the data space to create the clusters
+		 * @param rng random number generator
+		 */
+		void MiniBatchKMeans(vector<float>& clusters, 
+			const DescriptorView &pfeatures, DUtils::RandomGenerator &rng) const;
+
+		/**
+		 * Returns the index of the cluster closest to a feature
+		 * @param feature
+		 * @param clusters clusters (size multiple of DescriptorLength)
+		 * @return index of the nearest cluster
+		 */
+		int NearestCluster(const pFeature &feature, 
+			const vector<float> &clusters) const;
+
+		/**
+		 * Returns the index of the cluster closest to a feature, and the
+		 * distances to the two nearest clusters
+		 * @param feature
+		 * @param clusters clusters (size multiple of DescriptorLength)
+		 * @param best_sqd (out) squared distance to the nearest cluster
+		 * @param second_sqd (out) squared distance to the second nearest
+		 *    cluster (max double if there is only one cluster)
+		 * @return index of the nearest cluster
+		 */
+		int NearestCluster(const pFeature &feature, 
+			const vector<float> &clusters, double &best_sqd, 
+			double &second_sqd) const;
+
+		/**
+		 * Calculates half the distance from each cluster to its nearest one
+		 * @param clusters clusters (size multiple of DescriptorLength)
+		 * @param half_separation (out) half distance of each cluster
+		 */
+		void ClusterSeparations(const vector<float> &clusters,
+			vector<double> &half_separation) const;
+
+		/**
+		 * Removes the clusters that have no features associated
+		 * @param clusters (in/out) clusters
+		 * @param groups (in/out) indices of the features of each cluster
+		 * @return true iif some cluster was removed
+		 */
+		bool RemoveEmptyClusters(vector<float> &clusters, 
+			vector<vector<unsigned int> > &groups) const;
+
+		/**
+		 * Returns the max squared distance between the clusters of two sets
+		 * @param a first set of clusters
+		 * @param b second set, with the same size as a
+		 * @return max distance between a cluster in a and the same one in b
+		 */
+		double MaxClusterShift(const vector<float> &a, 
+			const vector<float> &b) const;
+
 		/**
 		 * Calculates the Euclidean squared distance between two features
 		 * @param v
@@ -185,7 +700,26 @@ namespace DBow {
 		 * the data used
 		 * @param training_features features used to create the vocabulary
 		 */
-		void SetNodeWeights(const vector<vector<float> >& training_features);
+		void SetNodeWeights(const vector<DescriptorView>& training_features);
+
+		/**
+		 * Sets the node weights once the tree has been created from a file
+		 * @param filename file with the training features
+		 */
+		void SetNodeWeights(const char *filename);
+
+		/**
+		 * Sets the weights and frequencies of the words created by 
+		 * SplitWords from those of the words they were split from, and 
+		 * creates the stop list again
+		 * @param documents features given to SplitWords
+		 * @param words words[i][j] = word of the j-th feature of the i-th
+		 *    document before splitting
+		 * @param splits split words, as returned by SplitWords
+		 */
+		void SetSplitWordWeights(const vector<DescriptorView> &documents,
+			const vector<vector<WordId> > &words, 
+			const map<WordId, vector<WordId> > &splits);
 
 		/**
 		 * Creates the words of the vocabulary once the tree is built
@@ -202,6 +736,40 @@ namespace DBow {
 		 */
 		template<class T> void _load(T &f, int nwords);
 
+		/**
+		 * Reads the nodes of the tree, one by one
+		 * @param f file stream opened in reading mode, after the number of
+		 *   nodes
+		 * @param nnodes number of nodes, including the root
+		 * @param order (out) order[i] is the id of the i-th node read
+		 * @param parents (out) parents[i] is the parent of the i-th node read
+		 */
+		template<class T> void readNodes(T &f, int nnodes, 
+			vector<NodeId> &order, vector<NodeId> &parents);
+
+		/**
+		 * Reads the nodes of the tree from a text file. Each node is in a
+		 * line, so that lines are parsed by several threads. If the nodes
+		 * are not one per line, they are read one by one
+		 * @see readNodes(T&, int, vector<NodeId>&, vector<NodeId>&)
+		 */
+		void readNodes(DUtils::TextFile &f, int nnodes, 
+			vector<NodeId> &order, vector<NodeId> &parents);
+
+		/**
+		 * Reads the words of the vocabulary, one by one
+		 * @param f file stream opened in reading mode, after the nodes
+		 * @param nwords number of words
+		 */
+		template<class T> void readWords(T &f, int nwords);
+
+		/**
+		 * Reads the words of the vocabulary from a text file, parsing the
+		 * lines by several threads
+		 * @see readWords(T&, int)
+		 */
+		void readWords(DUtils::TextFile &f, int nwords);
+
 	};
 
 }
@@ -0,0 +1,91 @@
+/**
+ * File: QueryClient.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: client of a QueryServer
+ */
+
+#include "QueryClient.h"
+#include "QueryProtocol.h"
+#include "BowVector.h"
+#include "DescriptorView.h"
+#include "QueryResults.h"
+#include "DUtils.h"
+
+#include <string>
+using namespace std;
+
+using namespace DBow;
+
+QueryClient::QueryClient(void): m_fd(-1)
+{
+}
+
+QueryClient::~QueryClient(void)
+{
+	Close();
+}
+
+void QueryClient::ConnectUnix(const char *path)
+{
+	Close();
+	m_fd = QueryProtocol::ConnectUnix(path);
+}
+
+void QueryClient::ConnectTcp(int port)
+{
+	Close();
+	m_fd = QueryProtocol::ConnectTcp(port);
+}
+
+void QueryClient::Close()
+{
+	QueryProtocol::Close(m_fd);
+	m_fd = -1;
+}
+
+void QueryClient::Query(QueryResults &ret, const BowVector &v,
+	int max_results)
+{
+	if(m_fd < 0) throw DUtils::DException("Not connected");
+
+	try{
+		QueryProtocol::SendRequest(m_fd, v, max_results);
+	}catch(DUtils::DException &){
+		Close();
+		throw;
+	}
+
+	readResponse(ret);
+}
+
+void QueryClient::Query(QueryResults &ret, const DescriptorView &features,
+	int max_results)
+{
+	if(m_fd < 0) throw DUtils::DException("Not connected");
+
+	try{
+		QueryProtocol::SendRequest(m_fd, features, max_results);
+	}catch(DUtils::DException &){
+		Close();
+		throw;
+	}
+
+	readResponse(ret);
+}
+
+void QueryClient::readResponse(QueryResults &ret)
+{
+	// errors of the server come in a response and keep the connection
+	string error;
+
+	try{
+		QueryProtocol::ReadResponse(m_fd, ret);
+		return;
+	}catch(DUtils::DException &ex){
+		error = ex.what();
+	}
+
+	throw DUtils::DException(error);
+}
+
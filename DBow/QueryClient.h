@@ -0,0 +1,115 @@
+/**
+ * File: QueryClient.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: client of a QueryServer
+ *
+ * Note: a client keeps a connection to a server and sends one query at a
+ *   time. Threads querying at the same time need a client each:
+ *
+ *     QueryClient client;
+ *     client.ConnectUnix("/tmp/map.sock");
+ *     client.Query(ret, DescriptorView(features, 64), 10);
+ *
+ *   The client uses POSIX sockets and is not available in Windows.
+ */
+
+#pragma once
+#ifndef __D_QUERY_CLIENT__
+#define __D_QUERY_CLIENT__
+
+#include "BowVector.h"
+#include "DescriptorView.h"
+#include "QueryResults.h"
+
+namespace DBow {
+
+class QueryClient
+{
+public:
+
+	/**
+	 * Creates a client with no connection
+	 */
+	QueryClient(void);
+
+	/**
+	 * Destructor. Closes the connection
+	 */
+	virtual ~QueryClient(void);
+
+	/**
+	 * Connects to a server listening on a Unix domain socket
+	 * @param path socket file
+	 * @throws DException if the connection fails
+	 */
+	void ConnectUnix(const char *path);
+
+	/**
+	 * Connects to a server listening on a TCP port of this machine
+	 * @param port
+	 * @throws DException if the connection fails
+	 */
+	void ConnectTcp(int port);
+
+	/**
+	 * Closes the connection
+	 */
+	void Close();
+
+	/**
+	 * Says whether the client is connected
+	 * @return true iif there is a connection
+	 */
+	inline bool isConnected() const { return m_fd >= 0; }
+
+	/**
+	 * Queries the database of the server with a bow vector
+	 * @param ret (out) results
+	 * @param v bow vector of the query, with its entries in order (as 
+	 *   returned by Vocabulary::Transform)
+	 * @param max_results (default: 1) number of results to return. If <= 0,
+	 *   all of them are returned
+	 * @throws DException if the server returns an error or the connection
+	 *   fails. In the last case the connection is closed
+	 */
+	void Query(QueryResults &ret, const BowVector &v, int max_results = 1);
+
+	/**
+	 * Queries the database of the server with descriptors, which are
+	 * transformed by the server
+	 * @param ret (out) results
+	 * @param features view of the query descriptors
+	 * @param max_results (default: 1) number of results to return
+	 * @see Query(QueryResults&, const BowVector&, int)
+	 */
+	void Query(QueryResults &ret, const DescriptorView &features,
+		int max_results = 1);
+
+protected:
+
+	/**
+	 * Reads the response of the last query
+	 * @param ret (out) results
+	 */
+	void readResponse(QueryResults &ret);
+
+protected:
+
+	// Socket of the connection, or -1
+	int m_fd;
+
+private:
+
+	/**
+	 * Copying is not allowed
+	 */
+	QueryClient(const QueryClient &client);
+	QueryClient& operator=(const QueryClient &client);
+
+};
+
+}
+
+#endif
+
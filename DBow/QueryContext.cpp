@@ -0,0 +1,35 @@
+/**
+ * File: QueryContext.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: reusable working memory of database queries
+ */
+
+#include "QueryContext.h"
+#include <vector>
+using namespace std;
+
+using namespace DBow;
+
+QueryContext::QueryContext(void)
+{
+}
+
+QueryContext::~QueryContext(void)
+{
+}
+
+void QueryContext::Clear()
+{
+	BowVector().swap(m_v);
+	vector<float>().swap(m_tf);
+	vector<WordId>().swap(m_words);
+	vector<HVocabulary::BeamEntry>().swap(m_leaves);
+	vector<HVocabulary::BeamEntry>().swap(m_beam);
+	vector<pair<double, int> >().swap(m_bounds);
+	vector<double>().swap(m_remaining);
+	vector<int>().swap(m_position);
+	vector<double>().swap(m_scores);
+	vector<double>().swap(m_common);
+}
+
@@ -0,0 +1,94 @@
+/**
+ * File: QueryContext.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: reusable working memory of database queries
+ *
+ * Note: a query needs some vectors to accumulate the scores of the
+ *   entries. If a context is given to Database::Query, these vectors are
+ *   kept in it between queries, so that once they have grown enough,
+ *   queries do not allocate memory:
+ *
+ *     QueryContext context;
+ *     QueryResults ret;
+ *     while(...){
+ *       db.Query(ret, features, 10, context);
+ *     }
+ *
+ *   A context can be used with any database, but only by one query at a
+ *   time. Threads querying at the same time need a context each.
+ */
+
+#pragma once
+#ifndef __D_QUERY_CONTEXT__
+#define __D_QUERY_CONTEXT__
+
+#include "DatabaseTypes.h"
+#include "BowVector.h"
+#include "HVocabulary.h"
+#include <vector>
+#include <utility>
+using namespace std;
+
+namespace DBow {
+
+	class Database;
+
+	class QueryContext
+	{
+	public:
+
+		/**
+		 * Creates an empty context
+		 */
+		QueryContext(void);
+
+		/**
+		 * Destructor
+		 */
+		~QueryContext(void);
+
+		/**
+		 * Frees the memory kept by the context
+		 */
+		void Clear();
+
+	protected:
+
+		friend class Database;
+
+		// Query vector
+		BowVector m_v;
+
+		// Term frequency of each word of m_v
+		vector<float> m_tf;
+
+		// Words of the query features
+		vector<WordId> m_words;
+
+		// Paths of the beam search of hierarchical vocabularies
+		vector<HVocabulary::BeamEntry> m_leaves, m_beam;
+
+		// Upper bound of the contribution of each query word, and its
+		// index in m_v
+		vector<pair<double, int> > m_bounds;
+
+		// Maximum score an entry can get from the words left
+		vector<double> m_remaining;
+
+		// Index of each entry in the results, or -1. All the items are -1
+		// between queries
+		vector<int> m_position;
+
+		// Copy of the scores of the results to find thresholds
+		vector<double> m_scores;
+
+		// Accumulated values of the KL scoring
+		vector<double> m_common;
+
+	};
+
+}
+
+#endif
+
@@ -0,0 +1,366 @@
+/**
+ * File: QueryProtocol.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: messages between QueryServer and QueryClient
+ */
+
+#include "QueryProtocol.h"
+#include "BowVector.h"
+#include "DescriptorView.h"
+#include "QueryResults.h"
+#include "DUtils.h"
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+using namespace std;
+
+using namespace DBow;
+
+// Maximum number of items of a message, to reject corrupted headers
+#define MAX_MESSAGE_ITEMS (1 << 26)
+
+// Number of pending connections of listening sockets
+#define LISTEN_BACKLOG 64
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+	/**
+	 * Fills the address of a Unix domain socket
+	 * @param path socket file
+	 * @param addr (out) address
+	 * @throws DException if the path is too long
+	 */
+	void UnixAddress(const char *path, struct sockaddr_un &addr)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(strlen(path) >= sizeof(addr.sun_path))
+			throw DUtils::DException("Socket path too long");
+		strcpy(addr.sun_path, path);
+	}
+
+	/**
+	 * Fills the address of a TCP port of the loopback interface
+	 * @param port
+	 * @param addr (out) address
+	 */
+	void TcpAddress(int port, struct sockaddr_in &addr)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((unsigned short)port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+
+	/**
+	 * Appends the bytes of a value to a buffer
+	 * @param buf buffer
+	 * @param value
+	 */
+	template<class T>
+	inline void Put(vector<char> &buf, const T &value)
+	{
+		const char *p = (const char*)&value;
+		buf.insert(buf.end(), p, p + sizeof(T));
+	}
+
+	/**
+	 * Reads a value from a buffer
+	 * @param p pointer to the buffer, moved after the value
+	 * @return value
+	 */
+	template<class T>
+	inline T Get(const char *&p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return value;
+	}
+
+}
+
+// ---------------------------------------------------------------------------
+
+int QueryProtocol::ListenUnix(const char *path)
+{
+	struct sockaddr_un addr;
+	UnixAddress(path, addr);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) throw DUtils::DException("Cannot create socket");
+
+	unlink(path);
+
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+		listen(fd, LISTEN_BACKLOG) != 0)
+	{
+		close(fd);
+		throw DUtils::DException("Cannot listen on socket");
+	}
+
+	return fd;
+}
+
+int QueryProtocol::ListenTcp(int port)
+{
+	struct sockaddr_in addr;
+	TcpAddress(port, addr);
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0) throw DUtils::DException("Cannot create socket");
+
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+		listen(fd, LISTEN_BACKLOG) != 0)
+	{
+		close(fd);
+		throw DUtils::DException("Cannot listen on socket");
+	}
+
+	return fd;
+}
+
+int QueryProtocol::ConnectUnix(const char *path)
+{
+	struct sockaddr_un addr;
+	UnixAddress(path, addr);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) throw DUtils::DException("Cannot create socket");
+
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+		close(fd);
+		throw DUtils::DException("Cannot connect to server");
+	}
+
+	return fd;
+}
+
+int QueryProtocol::ConnectTcp(int port)
+{
+	struct sockaddr_in addr;
+	TcpAddress(port, addr);
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0) throw DUtils::DException("Cannot create socket");
+
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+		close(fd);
+		throw DUtils::DException("Cannot connect to server");
+	}
+
+	// requests are small and the client waits for each response
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	return fd;
+}
+
+void QueryProtocol::Close(int fd)
+{
+	if(fd >= 0) close(fd);
+}
+
+// ---------------------------------------------------------------------------
+
+void QueryProtocol::writeAll(int fd, const void *data, size_t size)
+{
+	const char *p = (const char*)data;
+
+	while(size > 0){
+		// MSG_NOSIGNAL: a closed peer must not kill the process
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			throw DUtils::DException("Connection error");
+		}
+		p += n;
+		size -= n;
+	}
+}
+
+bool QueryProtocol::readAll(int fd, void *data, size_t size)
+{
+	char *p = (char*)data;
+	size_t done = 0;
+
+	while(done < size){
+		ssize_t n = recv(fd, p + done, size - done, 0);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			throw DUtils::DException("Connection error");
+		}else if(n == 0){
+			if(done == 0) return false;
+			throw DUtils::DException("Connection closed");
+		}
+		done += n;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+
+void QueryProtocol::SendRequest(int fd, const BowVector &v, int max_results)
+{
+	vector<char> buf;
+	buf.reserve(4 * sizeof(int) + 
+		v.size() * (sizeof(WordId) + sizeof(WordValue)));
+
+	Put<int>(buf, BOW_REQUEST);
+	Put<int>(buf, max_results);
+	Put<int>(buf, (int)v.size());
+	Put<int>(buf, 0);
+
+	BowVector::const_iterator it;
+	for(it = v.begin(); it != v.end(); ++it) Put<WordId>(buf, it->id);
+	for(it = v.begin(); it != v.end(); ++it) Put<WordValue>(buf, it->value);
+
+	writeAll(fd, &buf[0], buf.size());
+}
+
+void QueryProtocol::SendRequest(int fd, const DescriptorView &features,
+	int max_results)
+{
+	int header[4] =
+		{ DESCRIPTOR_REQUEST, max_results, features.Rows(), features.Cols() };
+	writeAll(fd, header, sizeof(header));
+
+	if(features.Stride() == features.Cols()){
+		// rows are contiguous
+		writeAll(fd, features.Row(0),
+			sizeof(float) * features.Rows() * features.Cols());
+	}else{
+		for(int i = 0; i < features.Rows(); i++){
+			writeAll(fd, features.Row(i), sizeof(float) * features.Cols());
+		}
+	}
+}
+
+bool QueryProtocol::ReadRequest(int fd, Request &req)
+{
+	int header[4];
+	if(!readAll(fd, header, sizeof(header))) return false;
+
+	const int n = header[2];
+	const int cols = header[3];
+
+	if(n < 0 || cols < 0 || n > MAX_MESSAGE_ITEMS || cols > MAX_MESSAGE_ITEMS)
+		throw DUtils::DException("Wrong request");
+
+	req.MaxResults = header[1];
+
+	if(header[0] == BOW_REQUEST){
+		req.Type = BOW_REQUEST;
+
+		vector<char> buf(n * (sizeof(WordId) + sizeof(WordValue)));
+		if(n > 0 && !readAll(fd, &buf[0], buf.size()))
+			throw DUtils::DException("Connection closed");
+
+		const char *pid = buf.empty() ? NULL : &buf[0];
+		const char *pvalue = pid + n * sizeof(WordId);
+
+		req.V.resize(n);
+		for(int i = 0; i < n; i++){
+			req.V[i].id = Get<WordId>(pid);
+			req.V[i].value = Get<WordValue>(pvalue);
+		}
+
+	}else if(header[0] == DESCRIPTOR_REQUEST){
+		req.Type = DESCRIPTOR_REQUEST;
+		if(cols > 0 && n > MAX_MESSAGE_ITEMS / cols)
+			throw DUtils::DException("Wrong request");
+
+		req.Rows = n;
+		req.Cols = cols;
+		req.Descriptors.resize(n * cols);
+		if(n * cols > 0 &&
+			!readAll(fd, &req.Descriptors[0], sizeof(float) * n * cols))
+			throw DUtils::DException("Connection closed");
+
+	}else{
+		throw DUtils::DException("Wrong request");
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+
+void QueryProtocol::SendResults(int fd, const QueryResults &ret)
+{
+	vector<char> buf;
+	buf.reserve(2 * sizeof(int) + 
+		ret.size() * (sizeof(EntryId) + sizeof(double)));
+
+	Put<int>(buf, OK_RESPONSE);
+	Put<int>(buf, (int)ret.size());
+
+	QueryResults::const_iterator it;
+	for(it = ret.begin(); it != ret.end(); ++it) Put<EntryId>(buf, it->Id);
+	for(it = ret.begin(); it != ret.end(); ++it) Put<double>(buf, it->Score);
+
+	writeAll(fd, &buf[0], buf.size());
+}
+
+void QueryProtocol::SendError(int fd, const string &msg)
+{
+	vector<char> buf;
+	Put<int>(buf, ERROR_RESPONSE);
+	Put<int>(buf, (int)msg.length());
+	buf.insert(buf.end(), msg.begin(), msg.end());
+
+	writeAll(fd, &buf[0], buf.size());
+}
+
+void QueryProtocol::ReadResponse(int fd, QueryResults &ret)
+{
+	int header[2];
+	if(!readAll(fd, header, sizeof(header)))
+		throw DUtils::DException("Connection closed");
+
+	const int n = header[1];
+	if(n < 0 || n > MAX_MESSAGE_ITEMS)
+		throw DUtils::DException("Wrong response");
+
+	if(header[0] == OK_RESPONSE){
+		vector<char> buf(n * (sizeof(EntryId) + sizeof(double)));
+		if(n > 0 && !readAll(fd, &buf[0], buf.size()))
+			throw DUtils::DException("Connection closed");
+
+		const char *pid = buf.empty() ? NULL : &buf[0];
+		const char *pscore = pid + n * sizeof(EntryId);
+
+		ret.resize(n);
+		for(int i = 0; i < n; i++){
+			ret[i].Id = Get<EntryId>(pid);
+			ret[i].Score = Get<double>(pscore);
+		}
+
+	}else if(header[0] == ERROR_RESPONSE){
+		string msg(n, ' ');
+		if(n > 0 && !readAll(fd, &msg[0], n))
+			throw DUtils::DException("Connection closed");
+
+		throw DUtils::DException(msg);
+
+	}else{
+		throw DUtils::DException("Wrong response");
+	}
+}
+
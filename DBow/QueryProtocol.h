@@ -0,0 +1,186 @@
+/**
+ * File: QueryProtocol.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: messages between QueryServer and QueryClient
+ *
+ * Note: messages are sent through local sockets only, so numbers are
+ *   written in the byte order of the machine.
+ *
+ *   Request:  int type, int max_results, int n, int cols
+ *             BOW_REQUEST:        n word ids, n word values (double).
+ *                                 Ids must be in ascending order, once each
+ *             DESCRIPTOR_REQUEST: n rows of cols floats
+ *   Response: int status, int n
+ *             OK_RESPONSE:    n entry ids, n scores (double)
+ *             ERROR_RESPONSE: n chars of error message
+ *
+ *   These functions use POSIX sockets and are not available in Windows.
+ */
+
+#pragma once
+#ifndef __D_QUERY_PROTOCOL__
+#define __D_QUERY_PROTOCOL__
+
+#include "BowVector.h"
+#include "DescriptorView.h"
+#include "QueryResults.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+using namespace std;
+
+namespace DBow {
+
+	class QueryProtocol
+	{
+	public:
+
+		// Types of request
+		enum RequestType
+		{
+			BOW_REQUEST = 1,
+			DESCRIPTOR_REQUEST = 2
+		};
+
+		// Status of responses
+		enum ResponseStatus
+		{
+			OK_RESPONSE = 0,
+			ERROR_RESPONSE = 1
+		};
+
+		// Request received by a server
+		struct Request
+		{
+			RequestType Type;
+			int MaxResults;
+
+			// Bow vector of BOW_REQUEST
+			BowVector V;
+
+			// Descriptors of DESCRIPTOR_REQUEST, as a Rows x Cols matrix
+			vector<float> Descriptors;
+			int Rows;
+			int Cols;
+		};
+
+		/**
+		 * Creates a socket listening on a Unix domain socket file. The file
+		 * is replaced if it already exists
+		 * @param path socket file
+		 * @return socket descriptor
+		 * @throws DException if the socket cannot be created
+		 */
+		static int ListenUnix(const char *path);
+
+		/**
+		 * Creates a socket listening on a TCP port of the loopback interface
+		 * @param port
+		 * @return socket descriptor
+		 * @throws DException if the socket cannot be created
+		 */
+		static int ListenTcp(int port);
+
+		/**
+		 * Connects to a server on a Unix domain socket
+		 * @param path socket file
+		 * @return socket descriptor
+		 * @throws DException if the connection fails
+		 */
+		static int ConnectUnix(const char *path);
+
+		/**
+		 * Connects to a server on a TCP port of the loopback interface
+		 * @param port
+		 * @return socket descriptor
+		 * @throws DException if the connection fails
+		 */
+		static int ConnectTcp(int port);
+
+		/**
+		 * Sends a query with a bow vector
+		 * @param fd socket
+		 * @param v bow vector
+		 * @param max_results
+		 * @throws DException if the message cannot be sent
+		 */
+		static void SendRequest(int fd, const BowVector &v, int max_results);
+
+		/**
+		 * Sends a query with descriptors
+		 * @param fd socket
+		 * @param features descriptors
+		 * @param max_results
+		 * @throws DException if the message cannot be sent
+		 */
+		static void SendRequest(int fd, const DescriptorView &features,
+			int max_results);
+
+		/**
+		 * Reads a request
+		 * @param fd socket
+		 * @param req (out) request. Its buffers are reused
+		 * @return false if the connection was closed before the request
+		 * @throws DException if the request is wrong or incomplete
+		 */
+		static bool ReadRequest(int fd, Request &req);
+
+		/**
+		 * Sends the results of a query
+		 * @param fd socket
+		 * @param ret results
+		 * @throws DException if the message cannot be sent
+		 */
+		static void SendResults(int fd, const QueryResults &ret);
+
+		/**
+		 * Sends an error message as response
+		 * @param fd socket
+		 * @param msg message
+		 * @throws DException if the message cannot be sent
+		 */
+		static void SendError(int fd, const string &msg);
+
+		/**
+		 * Reads the response to a query
+		 * @param fd socket
+		 * @param ret (out) results
+		 * @throws DException with the message of the server if it sent an
+		 *   error, or if the response cannot be read
+		 */
+		static void ReadResponse(int fd, QueryResults &ret);
+
+		/**
+		 * Closes a socket
+		 * @param fd socket
+		 */
+		static void Close(int fd);
+
+	protected:
+
+		/**
+		 * Writes a whole buffer
+		 * @param fd socket
+		 * @param data
+		 * @param size bytes
+		 * @throws DException on error
+		 */
+		static void writeAll(int fd, const void *data, size_t size);
+
+		/**
+		 * Reads a whole buffer
+		 * @param fd socket
+		 * @param data
+		 * @param size bytes
+		 * @return false if the connection was closed before reading anything
+		 * @throws DException on error or if the buffer is read partially
+		 */
+		static bool readAll(int fd, void *data, size_t size);
+
+	};
+
+}
+
+#endif
+
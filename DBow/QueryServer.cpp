@@ -0,0 +1,372 @@
+/**
+ * File: QueryServer.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: server that answers queries to a database through a local
+ *   socket
+ */
+
+#include "QueryServer.h"
+#include "QueryProtocol.h"
+#include "Database.h"
+#include "Vocabulary.h"
+#include "DescriptorView.h"
+#include "DUtils.h"
+
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <utility>
+#include <cerrno>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+using namespace std;
+
+using namespace DBow;
+
+// ---------------------------------------------------------------------------
+
+QueryServer::QueryServer(const Database &db, int max_batch, int max_wait):
+	m_db(db), m_listen_fd(-1), m_max_batch(max(1, max_batch)),
+	m_max_wait(max(0, max_wait)), m_nthreads(0), m_stop(false),
+	m_stop_batches(false), m_nrequests(0), m_nbatches(0)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_queue_cond, NULL);
+	pthread_cond_init(&m_done_cond, NULL);
+}
+
+QueryServer::~QueryServer(void)
+{
+	if(m_listen_fd >= 0){
+		QueryProtocol::Close(m_listen_fd);
+		if(!m_unix_path.empty()) unlink(m_unix_path.c_str());
+	}
+
+	pthread_cond_destroy(&m_done_cond);
+	pthread_cond_destroy(&m_queue_cond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void QueryServer::ListenUnix(const char *path)
+{
+	int fd = QueryProtocol::ListenUnix(path);
+	if(m_listen_fd >= 0) QueryProtocol::Close(m_listen_fd);
+	m_listen_fd = fd;
+	m_unix_path = path;
+}
+
+void QueryServer::ListenTcp(int port)
+{
+	int fd = QueryProtocol::ListenTcp(port);
+	if(m_listen_fd >= 0) QueryProtocol::Close(m_listen_fd);
+	m_listen_fd = fd;
+	m_unix_path.clear();
+}
+
+void QueryServer::SetBatching(int max_batch, int max_wait)
+{
+	pthread_mutex_lock(&m_mutex);
+	m_max_batch = max(1, max_batch);
+	m_max_wait = max(0, max_wait);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+unsigned long QueryServer::NumberOfRequests() const
+{
+	pthread_mutex_lock(&m_mutex);
+	unsigned long n = m_nrequests;
+	pthread_mutex_unlock(&m_mutex);
+	return n;
+}
+
+unsigned long QueryServer::NumberOfBatches() const
+{
+	pthread_mutex_lock(&m_mutex);
+	unsigned long n = m_nbatches;
+	pthread_mutex_unlock(&m_mutex);
+	return n;
+}
+
+// ---------------------------------------------------------------------------
+
+void QueryServer::Run()
+{
+	if(m_listen_fd < 0) throw DUtils::DException("No socket to listen on");
+
+	pthread_t batch_thread;
+	if(pthread_create(&batch_thread, NULL, batchThread, this) != 0)
+		throw DUtils::DException("Cannot create thread");
+
+	bool failed = false;
+
+	while(true){
+		int fd = accept(m_listen_fd, NULL, NULL);
+		const int accept_errno = (fd < 0 ? errno : 0);
+
+		pthread_mutex_lock(&m_mutex);
+		if(m_stop){
+			pthread_mutex_unlock(&m_mutex);
+			if(fd >= 0) QueryProtocol::Close(fd);
+			break;
+		}
+		if(fd >= 0){
+			m_connections.insert(fd);
+			m_nthreads++;
+		}
+		pthread_mutex_unlock(&m_mutex);
+
+		if(fd < 0){
+			if(accept_errno == EINTR || accept_errno == ECONNABORTED){
+				// interrupted or aborted connection
+				continue;
+			}else if(accept_errno == EMFILE || accept_errno == ENFILE ||
+				accept_errno == ENOBUFS || accept_errno == ENOMEM){
+				// out of resources: wait for other connections to close
+				usleep(100000);
+				continue;
+			}else{
+				// the socket cannot accept connections anymore
+				failed = true;
+				Stop();
+				break;
+			}
+		}
+
+		pair<QueryServer*, int> *arg = new pair<QueryServer*, int>(this, fd);
+		pthread_t thread;
+
+		if(pthread_create(&thread, NULL, connectionThread, arg) == 0){
+			pthread_detach(thread);
+		}else{
+			delete arg;
+			pthread_mutex_lock(&m_mutex);
+			m_connections.erase(fd);
+			QueryProtocol::Close(fd);
+			m_nthreads--;
+			pthread_mutex_unlock(&m_mutex);
+		}
+	}
+
+	// connections are closed by Stop, but their last queries are answered
+	pthread_mutex_lock(&m_mutex);
+	while(m_nthreads > 0) pthread_cond_wait(&m_done_cond, &m_mutex);
+	m_stop_batches = true;
+	pthread_cond_signal(&m_queue_cond);
+	pthread_mutex_unlock(&m_mutex);
+
+	pthread_join(batch_thread, NULL);
+
+	QueryProtocol::Close(m_listen_fd);
+	m_listen_fd = -1;
+	if(!m_unix_path.empty()){
+		unlink(m_unix_path.c_str());
+		m_unix_path.clear();
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_stop = false;
+	m_stop_batches = false;
+	pthread_mutex_unlock(&m_mutex);
+
+	if(failed) throw DUtils::DException("Cannot accept connections");
+}
+
+void QueryServer::Stop()
+{
+	pthread_mutex_lock(&m_mutex);
+	if(!m_stop){
+		m_stop = true;
+
+		// this makes accept and recv return
+		if(m_listen_fd >= 0) shutdown(m_listen_fd, SHUT_RDWR);
+
+		set<int>::const_iterator it;
+		for(it = m_connections.begin(); it != m_connections.end(); ++it)
+			shutdown(*it, SHUT_RDWR);
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+// ---------------------------------------------------------------------------
+
+void* QueryServer::connectionThread(void *arg)
+{
+	pair<QueryServer*, int> *p = (pair<QueryServer*, int>*)arg;
+	QueryServer *server = p->first;
+	int fd = p->second;
+	delete p;
+
+	server->serveConnection(fd);
+	return NULL;
+}
+
+void* QueryServer::batchThread(void *arg)
+{
+	((QueryServer*)arg)->runBatches();
+	return NULL;
+}
+
+void QueryServer::serveConnection(int fd)
+{
+	const Vocabulary &voc = m_db.Voc();
+	const WordId nwords = voc.NumberOfWords();
+
+	QueryProtocol::Request req;
+	BowVector v;
+	QueryResults ret;
+
+	try{
+		while(QueryProtocol::ReadRequest(fd, req)){
+			PendingQuery q;
+			q.max_results = req.MaxResults;
+			q.ret = &ret;
+
+			if(req.Type == QueryProtocol::DESCRIPTOR_REQUEST){
+				if(req.Cols != voc.DescriptorLength()){
+					q.error = "Wrong descriptor length";
+				}else{
+					const float *data =
+						(req.Descriptors.empty() ? NULL : &req.Descriptors[0]);
+					voc.Transform(DescriptorView(data, req.Rows, req.Cols), v, 
+						false);
+					q.v = &v;
+				}
+			}else{
+				// queries need the words sorted and without repetitions
+				BowVector::const_iterator it;
+				for(it = req.V.begin(); it != req.V.end(); ++it){
+					if(it->id >= nwords) break;
+					if(it != req.V.begin() && it->id <= (it-1)->id) break;
+				}
+				if(it == req.V.end()){
+					q.v = &req.V;
+				}else if(it->id >= nwords){
+					q.error = "Wrong word id";
+				}else{
+					q.error = "Word ids not in ascending order";
+				}
+			}
+
+			if(q.error.empty()) query(q);
+
+			if(q.error.empty())
+				QueryProtocol::SendResults(fd, ret);
+			else
+				QueryProtocol::SendError(fd, q.error);
+		}
+	}catch(DUtils::DException &){
+		// broken connection or wrong message: the connection is closed
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_connections.erase(fd);
+	QueryProtocol::Close(fd);
+	m_nthreads--;
+	pthread_cond_broadcast(&m_done_cond);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void QueryServer::query(PendingQuery &q)
+{
+	q.done = false;
+
+	pthread_mutex_lock(&m_mutex);
+	m_queue.push_back(&q);
+	pthread_cond_signal(&m_queue_cond);
+	while(!q.done) pthread_cond_wait(&m_done_cond, &m_mutex);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+// ---------------------------------------------------------------------------
+
+void QueryServer::runBatches()
+{
+	QueryContext context;
+	vector<PendingQuery*> batch;
+
+	pthread_mutex_lock(&m_mutex);
+
+	while(true){
+		while(m_queue.empty() && !m_stop_batches)
+			pthread_cond_wait(&m_queue_cond, &m_mutex);
+
+		if(m_queue.empty()) break; // and m_stop_batches
+
+		if((int)m_queue.size() < m_max_batch && m_max_wait > 0){
+			// wait a little for other requests
+			struct timeval now;
+			gettimeofday(&now, NULL);
+
+			long usecs = now.tv_usec + m_max_wait % 1000000;
+			struct timespec deadline;
+			deadline.tv_sec = now.tv_sec + m_max_wait / 1000000 + usecs / 1000000;
+			deadline.tv_nsec = (usecs % 1000000) * 1000;
+
+			while((int)m_queue.size() < m_max_batch && !m_stop_batches){
+				if(pthread_cond_timedwait(&m_queue_cond, &m_mutex, &deadline)
+					== ETIMEDOUT) break;
+			}
+		}
+
+		const int n = min((int)m_queue.size(), m_max_batch);
+		batch.assign(m_queue.begin(), m_queue.begin() + n);
+		m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+
+		pthread_mutex_unlock(&m_mutex);
+
+		runBatch(batch, context);
+
+		pthread_mutex_lock(&m_mutex);
+
+		for(int i = 0; i < n; i++) batch[i]->done = true;
+		m_nrequests += n;
+		m_nbatches++;
+		pthread_cond_broadcast(&m_done_cond);
+	}
+
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void QueryServer::runBatch(const vector<PendingQuery*> &batch,
+	QueryContext &context)
+{
+	try{
+		if(batch.size() == 1){
+			// single queries can be pruned
+			PendingQuery &q = *batch[0];
+			m_db.Query(*q.ret, *q.v, q.max_results, context);
+
+		}else{
+			// all the queries return the largest number of results asked
+			int max_results = batch[0]->max_results;
+			vector<BowVector> queries(batch.size());
+
+			for(unsigned int i = 0; i < batch.size(); i++){
+				queries[i] = *batch[i]->v;
+				const int m = batch[i]->max_results;
+				if(max_results > 0 && (m <= 0 || m > max_results))
+					max_results = m;
+			}
+
+			vector<QueryResults> ret;
+			m_db.QueryBatch(queries, ret, max_results, context);
+
+			for(unsigned int i = 0; i < batch.size(); i++){
+				PendingQuery &q = *batch[i];
+				if(q.max_results > 0 && (int)ret[i].size() > q.max_results)
+					ret[i].resize(q.max_results);
+				q.ret->swap(ret[i]);
+			}
+		}
+	}catch(DUtils::DException &ex){
+		for(unsigned int i = 0; i < batch.size(); i++)
+			batch[i]->error = ex.what();
+	}
+}
+
@@ -0,0 +1,213 @@
+/**
+ * File: QueryServer.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: server that answers queries to a database through a local
+ *   socket
+ *
+ * Note: several processes can query the same database through a server
+ *   instead of loading a copy each. The server listens on a Unix domain
+ *   socket or on a TCP port of the loopback interface, and receives bow
+ *   vectors or descriptors from QueryClient objects:
+ *
+ *     Database db("map.db");
+ *     QueryServer server(db);
+ *     server.ListenUnix("/tmp/map.sock");
+ *     server.Run(); // until Stop is called from another thread
+ *
+ *   Each connection is served by a thread that reads the requests and
+ *   transforms descriptors into bow vectors. Requests that arrive at the
+ *   same time are grouped into micro-batches and run together with
+ *   Database::QueryBatch. A batch is started when it has max_batch
+ *   requests or when the first one has waited for max_wait microseconds.
+ *
+ *   The server uses POSIX sockets and threads, and is not available in
+ *   Windows.
+ */
+
+#pragma once
+#ifndef __D_QUERY_SERVER__
+#define __D_QUERY_SERVER__
+
+#include "Database.h"
+#include "BowVector.h"
+#include "QueryResults.h"
+#include "QueryContext.h"
+#include "QueryProtocol.h"
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+#include <pthread.h>
+using namespace std;
+
+namespace DBow {
+
+class QueryServer
+{
+public:
+
+	/**
+	 * Creates a server for a database
+	 * @param db database. It must not be destroyed nor modified while the
+	 *   server is running
+	 * @param max_batch (default: 32) maximum number of requests per batch
+	 * @param max_wait (default: 200) microseconds a request can wait for
+	 *   others to form a batch. If 0, requests are never delayed
+	 */
+	QueryServer(const Database &db, int max_batch = 32, int max_wait = 200);
+
+	/**
+	 * Destructor. The server must not be running
+	 */
+	virtual ~QueryServer(void);
+
+	/**
+	 * Sets the socket to listen on to a Unix domain socket
+	 * @param path socket file. It is removed when the server stops
+	 * @throws DException if the socket cannot be created
+	 */
+	void ListenUnix(const char *path);
+
+	/**
+	 * Sets the socket to listen on to a TCP port of the loopback interface
+	 * @param port
+	 * @throws DException if the socket cannot be created
+	 */
+	void ListenTcp(int port);
+
+	/**
+	 * Serves requests until Stop is called. The listening socket is closed
+	 * when it returns. Connections that fail to be accepted because of
+	 * a lack of resources are retried after a while
+	 * @throws DException if there is no socket to listen on, or if it 
+	 *   cannot accept connections anymore (the server is stopped then)
+	 */
+	void Run();
+
+	/**
+	 * Makes Run return after closing the connections and answering the
+	 * pending requests. It can be called from any thread, but not from
+	 * signal handlers
+	 */
+	void Stop();
+
+	/**
+	 * Changes the batching parameters. They are used from the next batch on
+	 * @param max_batch maximum number of requests per batch
+	 * @param max_wait microseconds a request can wait for others
+	 */
+	void SetBatching(int max_batch, int max_wait);
+
+	/**
+	 * Returns the number of requests answered
+	 * @return number of requests
+	 */
+	unsigned long NumberOfRequests() const;
+
+	/**
+	 * Returns the number of batches run
+	 * @return number of batches
+	 */
+	unsigned long NumberOfBatches() const;
+
+protected:
+
+	// Request waiting for its results
+	struct PendingQuery
+	{
+		const BowVector *v;
+		int max_results;
+		QueryResults *ret;
+		string error;
+		bool done;
+	};
+
+	/**
+	 * Serves a connection until it is closed
+	 * @param fd socket of the connection
+	 */
+	void serveConnection(int fd);
+
+	/**
+	 * Runs batches of pending queries until the server stops
+	 */
+	void runBatches();
+
+	/**
+	 * Runs the queries of a batch
+	 * @param batch queries
+	 * @param context working memory for single queries
+	 */
+	void runBatch(const vector<PendingQuery*> &batch, QueryContext &context);
+
+	/**
+	 * Queues a query and waits for its results
+	 * @param q query
+	 */
+	void query(PendingQuery &q);
+
+	/**
+	 * Thread functions
+	 * @param arg pointer to the arguments
+	 */
+	static void* connectionThread(void *arg);
+	static void* batchThread(void *arg);
+
+protected:
+
+	// Database to query
+	const Database &m_db;
+
+	// Listening socket, or -1
+	int m_listen_fd;
+
+	// Socket file to remove at the end, if any
+	string m_unix_path;
+
+	// Protects all the following members
+	mutable pthread_mutex_t m_mutex;
+
+	// Batching parameters
+	int m_max_batch;
+	int m_max_wait;
+
+	// Signaled when queries are queued or the server stops
+	pthread_cond_t m_queue_cond;
+
+	// Signaled when queries are answered or connections end
+	pthread_cond_t m_done_cond;
+
+	// Queries waiting for a batch
+	deque<PendingQuery*> m_queue;
+
+	// Sockets of the open connections
+	set<int> m_connections;
+
+	// Number of connection threads running
+	int m_nthreads;
+
+	// The server is stopping
+	bool m_stop;
+
+	// The batch thread must finish when the queue is empty
+	bool m_stop_batches;
+
+	// Statistics
+	unsigned long m_nrequests;
+	unsigned long m_nbatches;
+
+private:
+
+	/**
+	 * Copying is not allowed
+	 */
+	QueryServer(const QueryServer &server);
+	QueryServer& operator=(const QueryServer &server);
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,348 @@
+/**
+ * File: ShardedDatabase.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: database split into several databases with the same
+ *   vocabulary
+ */
+
+#include "ShardedDatabase.h"
+#include "Database.h"
+#include "Vocabulary.h"
+#include "QueryResults.h"
+#include "DUtils.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+using namespace DBow;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+	/**
+	 * Compares results by score, the best first. Ties are broken by id so
+	 * that the results do not depend on the order the shards finish in
+	 */
+	class BetterResult
+	{
+	public:
+		/**
+		 * @param lower_is_better true iif lower scores are better
+		 */
+		BetterResult(bool lower_is_better): m_lower(lower_is_better){}
+
+		inline bool operator()(const Result &a, const Result &b) const
+		{
+			if(a.Score != b.Score)
+				return (m_lower ? a.Score < b.Score : a.Score > b.Score);
+			return a.Id < b.Id;
+		}
+
+	protected:
+		bool m_lower;
+	};
+
+	/**
+	 * Says whether the scores returned by a database are distances
+	 * @param scoring scoring type
+	 * @param scale_score true if scores are scaled
+	 * @return true iif lower scores are better
+	 */
+	bool LowerIsBetter(VocParams::ScoringType scoring, bool scale_score)
+	{
+		switch(scoring){
+			case VocParams::L1_NORM:
+			case VocParams::L2_NORM:
+			case VocParams::CHI_SQUARE:
+				return !scale_score;
+
+			case VocParams::KL:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+}
+
+// ---------------------------------------------------------------------------
+
+ShardedDatabase::ShardedDatabase(const SharedVocabulary &voc, int nshards):
+	m_voc(voc)
+{
+	if(voc.empty()) throw DUtils::DException("Empty vocabulary handle");
+	if(nshards < 1) throw DUtils::DException("Wrong number of shards");
+
+	m_shards.resize(nshards, NULL);
+	m_entries.resize(nshards, 0);
+	m_modified.resize(nshards, false);
+
+	for(int i = 0; i < nshards; i++){
+		m_shards[i] = new Database(m_voc);
+	}
+}
+
+ShardedDatabase::ShardedDatabase(const char *filename)
+{
+	Load(filename);
+}
+
+ShardedDatabase::~ShardedDatabase(void)
+{
+	clear();
+}
+
+void ShardedDatabase::clear()
+{
+	for(unsigned int i = 0; i < m_shards.size(); i++){
+		delete m_shards[i];
+	}
+	m_shards.clear();
+	m_entries.clear();
+	m_modified.clear();
+}
+
+// ---------------------------------------------------------------------------
+
+Database* ShardedDatabase::getShard(int shard) const
+{
+	if(shard < 0 || shard >= (int)m_shards.size())
+		throw DUtils::DException("Wrong shard");
+
+	Database *db;
+	bool online = false;
+
+	// shards may be requested from several queries at a time
+	#pragma omp critical(DBowShardedDatabase)
+	{
+		db = m_shards[shard];
+
+		if(db == NULL){
+			db = new Database(m_voc);
+			try{
+				db->Load(shardFilename(m_filename, shard).c_str(), m_voc);
+
+				if(db->NumberOfEntries() != m_entries[shard])
+					throw DUtils::DException("Wrong number of entries in shard");
+
+				// the scores of the shards could not be merged
+				if(db->OnlineWeighting()){
+					online = true;
+					throw DUtils::DException("Online weighting in shard");
+				}
+			}catch(...){
+				delete db;
+				db = NULL;
+			}
+			m_shards[shard] = db;
+		}
+	}
+
+	// exceptions cannot leave the critical section
+	if(online) 
+		throw DUtils::DException("Shards must not use online weighting");
+	if(db == NULL) throw DUtils::DException("Cannot load shard");
+
+	return db;
+}
+
+void ShardedDatabase::Unload(int shard)
+{
+	if(shard < 0 || shard >= (int)m_shards.size())
+		throw DUtils::DException("Wrong shard");
+
+	if(m_modified[shard] || m_filename.empty())
+		throw DUtils::DException("The shard has not been saved");
+
+	delete m_shards[shard];
+	m_shards[shard] = NULL;
+}
+
+unsigned int ShardedDatabase::NumberOfEntries() const
+{
+	unsigned int n = 0;
+	for(unsigned int i = 0; i < m_entries.size(); i++) n += m_entries[i];
+	return n;
+}
+
+string ShardedDatabase::shardFilename(const string &filename, int shard)
+{
+	stringstream ss;
+	ss << filename << "." << shard;
+	return ss.str();
+}
+
+// ---------------------------------------------------------------------------
+
+void ShardedDatabase::saveShard(const Database &db, const string &filename,
+	const string &voc_filename, bool binary) const
+{
+	// the vocabulary file has just been saved by Save
+	if(binary)
+		db.SaveBinary(filename.c_str(), voc_filename.c_str(), false);
+	else
+		db.SaveText(filename.c_str(), voc_filename.c_str(), false);
+}
+
+// ---------------------------------------------------------------------------
+
+EntryId ShardedDatabase::AddEntry(int shard, const vector<float> &features)
+{
+	return AddEntry(shard, DescriptorView(features, m_voc->DescriptorLength()));
+}
+
+EntryId ShardedDatabase::AddEntry(int shard, const DescriptorView &features)
+{
+	EntryId id = getShard(shard)->AddEntry(features);
+	m_entries[shard]++;
+	m_modified[shard] = true;
+	return GlobalId(shard, id);
+}
+
+EntryId ShardedDatabase::AddEntry(int shard, const BowVector &v)
+{
+	EntryId id = getShard(shard)->AddEntry(v);
+	m_entries[shard]++;
+	m_modified[shard] = true;
+	return GlobalId(shard, id);
+}
+
+// ---------------------------------------------------------------------------
+
+void ShardedDatabase::Query(QueryResults &ret, const vector<float> &features,
+	int max_results) const
+{
+	Query(ret, DescriptorView(features, m_voc->DescriptorLength()),
+		max_results);
+}
+
+void ShardedDatabase::Query(QueryResults &ret,
+	const DescriptorView &features, int max_results) const
+{
+	// the features are transformed only once for all the shards
+	BowVector v;
+	m_voc->Transform(features, v, true);
+	Query(ret, v, max_results);
+}
+
+void ShardedDatabase::Query(QueryResults &ret, const BowVector &v,
+	int max_results) const
+{
+	const int N = (int)m_shards.size();
+
+	// shards are read from disk before querying, one by one. Their 
+	// results can only be merged if all of them use the same weights
+	vector<const Database*> shards(N);
+	for(int s = 0; s < N; s++){
+		shards[s] = getShard(s);
+		if(shards[s]->OnlineWeighting())
+			throw DUtils::DException("Shards must not use online weighting");
+	}
+
+	vector<QueryResults> partial(N);
+
+	#pragma omp parallel for schedule(dynamic)
+	for(int s = 0; s < N; s++){
+		QueryContext context;
+		shards[s]->Query(partial[s], v, max_results, context);
+	}
+
+	ret.clear();
+	for(int s = 0; s < N; s++){
+		QueryResults::const_iterator rit;
+		for(rit = partial[s].begin(); rit != partial[s].end(); ++rit){
+			ret.push_back(Result(GlobalId(s, rit->Id), rit->Score));
+		}
+	}
+
+	BetterResult better(LowerIsBetter(m_voc->Scoring(), m_voc->ScaleScore()));
+
+	if(max_results > 0 && (int)ret.size() > max_results){
+		partial_sort(ret.begin(), ret.begin() + max_results, ret.end(), better);
+		ret.resize(max_results);
+	}else{
+		sort(ret.begin(), ret.end(), better);
+	}
+}
+
+// ---------------------------------------------------------------------------
+
+void ShardedDatabase::Save(const char *filename, bool binary)
+{
+	const int N = (int)m_shards.size();
+	const bool same_file = (m_filename == filename);
+
+	// index
+	fstream f(filename, ios::out);
+	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+
+	f << N << " " << (int)m_voc->RetrieveInfo().VocType << endl;
+	for(int s = 0; s < N; s++){
+		f << m_entries[s] << " ";
+	}
+	f << endl;
+	f.close();
+
+	// vocabulary, in binary so that its hash is kept
+	string voc_filename = string(filename) + ".voc";
+	m_voc->Save(voc_filename.c_str(), true);
+
+	// shards reference the vocabulary file, which is in their directory
+	string::size_type i = voc_filename.find_last_of("/\\");
+	if(i != string::npos) voc_filename = voc_filename.substr(i + 1);
+
+	// shards
+	for(int s = 0; s < N; s++){
+		string shard_filename = shardFilename(filename, s);
+
+		if(m_shards[s] != NULL){
+			if(!same_file || m_modified[s]){
+				saveShard(*m_shards[s], shard_filename, voc_filename, binary);
+			}
+		}else if(!same_file){
+			// the shard must be copied to the new file
+			saveShard(*getShard(s), shard_filename, voc_filename, binary);
+			delete m_shards[s];
+			m_shards[s] = NULL;
+		}
+	}
+
+	m_filename = filename;
+	m_modified.assign(N, false);
+}
+
+void ShardedDatabase::Load(const char *filename)
+{
+	fstream f(filename, ios::in);
+	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+
+	int N, voctype;
+	f >> N >> voctype;
+	if(!f.good() || N < 1) throw DUtils::DException("Wrong number of shards");
+
+	vector<unsigned int> entries(N);
+	for(int s = 0; s < N; s++) f >> entries[s];
+	if(f.fail()) throw DUtils::DException("Wrong file format");
+	f.close();
+
+	string voc_filename = string(filename) + ".voc";
+	Vocabulary *voc = Database::createVoc((VocParams::VocType)voctype);
+	SharedVocabulary handle(voc);
+	voc->Load(voc_filename.c_str());
+
+	clear();
+
+	m_voc = handle;
+	m_filename = filename;
+	m_entries = entries;
+	m_shards.resize(N, NULL);
+	m_modified.resize(N, false);
+}
+
@@ -0,0 +1,310 @@
+/**
+ * File: ShardedDatabase.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: database split into several databases with the same
+ *   vocabulary
+ *
+ * Note: entries are added to the shard given by the user (e.g. the region
+ *   of the map where the image was taken). Queries are run in all the
+ *   shards in parallel and their results are merged, so that they look like
+ *   the results of a single database. Entry ids are unique in the whole
+ *   sharded database: the entry i of the shard s has the id i * N + s,
+ *   where N is the number of shards.
+ *
+ *   Each shard is stored in its own file. Shards are only read from disk
+ *   when they are first needed, and can be unloaded again to save memory:
+ *
+ *     ShardedDatabase db("map.db"); // reads the vocabulary only
+ *     db.Query(ret, features, 10);  // loads all the shards
+ *     db.Unload(3);
+ *
+ *   All the shards use the same vocabulary and the default query settings.
+ *   Results of different shards are only comparable if they use the
+ *   weights of the vocabulary, so shards with online weighting are 
+ *   rejected when they are loaded.
+ *   Queries can run in parallel with each other, but not with functions
+ *   that modify the database.
+ */
+
+#pragma once
+#ifndef __D_SHARDED_DATABASE__
+#define __D_SHARDED_DATABASE__
+
+#include "Database.h"
+#include "SharedVocabulary.h"
+#include "BowVector.h"
+#include "DescriptorView.h"
+#include "DatabaseTypes.h"
+#include "QueryResults.h"
+#include <vector>
+#include <string>
+using namespace std;
+
+namespace DBow {
+
+class ShardedDatabase
+{
+public:
+
+	/**
+	 * Creates an empty database with the given number of shards
+	 * @param voc vocabulary of all the shards
+	 * @param nshards number of shards
+	 * @throws DException if voc is empty or nshards < 1
+	 */
+	ShardedDatabase(const SharedVocabulary &voc, int nshards);
+
+	/**
+	 * Creates a database from a file, without loading its shards
+	 * @param filename
+	 * @see Load
+	 */
+	ShardedDatabase(const char *filename);
+
+	/**
+	 * Destructor
+	 */
+	virtual ~ShardedDatabase(void);
+
+	/**
+	 * Adds an entry to a shard
+	 * @param shard shard of the entry
+	 * @param features features of the image, in the opencv format
+	 * @return id of the new entry in the sharded database
+	 * @throws DException if the shard does not exist or uses online 
+	 *   weighting
+	 */
+	EntryId AddEntry(int shard, const vector<float> &features);
+
+	/**
+	 * Adds an entry to a shard
+	 * @param shard shard of the entry
+	 * @param features view of the descriptors of the image
+	 * @return id of the new entry in the sharded database
+	 * @throws DException if the shard does not exist or uses online 
+	 *   weighting
+	 */
+	EntryId AddEntry(int shard, const DescriptorView &features);
+
+	/**
+	 * Adds an entry to a shard
+	 * @param shard shard of the entry
+	 * @param v bow vector of the image
+	 * @return id of the new entry in the sharded database
+	 * @throws DException if the shard does not exist or uses online 
+	 *   weighting
+	 */
+	EntryId AddEntry(int shard, const BowVector &v);
+
+	/**
+	 * Queries all the shards, loading them if necessary
+	 * @param ret (out) best results of all the shards, with their ids in
+	 *   the sharded database
+	 * @param features query features, in the opencv format
+	 * @param max_results number of results to return. If <= 0, all of
+	 *   them are returned
+	 * @throws DException if a shard cannot be loaded or uses online
+	 *   weighting
+	 */
+	void Query(QueryResults &ret, const vector<float> &features,
+		int max_results = 1) const;
+
+	/**
+	 * Queries all the shards, loading them if necessary
+	 * @param ret (out) results
+	 * @param features view of the query descriptors
+	 * @param max_results number of results to return
+	 * @see Query(QueryResults&, const BowVector&, int)
+	 */
+	void Query(QueryResults &ret, const DescriptorView &features,
+		int max_results = 1) const;
+
+	/**
+	 * Queries all the shards, loading them if necessary
+	 * @param ret (out) results
+	 * @param v bow vector of the query
+	 * @param max_results number of results to return
+	 * @see Query(QueryResults&, const vector<float>&, int)
+	 */
+	void Query(QueryResults &ret, const BowVector &v,
+		int max_results = 1) const;
+
+	/**
+	 * Returns the number of shards
+	 * @return number of shards
+	 */
+	inline int NumberOfShards() const { return (int)m_shards.size(); }
+
+	/**
+	 * Returns the number of entries of all the shards
+	 * @return number of entries
+	 */
+	unsigned int NumberOfEntries() const;
+
+	/**
+	 * Returns the number of entries of a shard, even if it is not loaded
+	 * @param shard
+	 * @return number of entries
+	 */
+	inline unsigned int NumberOfEntries(int shard) const {
+		return m_entries[shard];
+	}
+
+	/**
+	 * Returns a shard, loading it if necessary. Its entries have local ids
+	 * @param shard
+	 * @return shard database
+	 * @throws DException if the shard does not exist, cannot be loaded or
+	 *   uses online weighting
+	 * @see GlobalId
+	 */
+	inline const Database& Shard(int shard) const {
+		return *getShard(shard);
+	}
+
+	/**
+	 * Says whether a shard is in memory
+	 * @param shard
+	 * @return true iif the shard is loaded
+	 */
+	inline bool isLoaded(int shard) const {
+		return m_shards[shard] != NULL;
+	}
+
+	/**
+	 * Frees the memory of a shard. It is loaded again from the file of the
+	 * database when it is needed
+	 * @param shard
+	 * @throws DException if the shard has changes not saved yet
+	 */
+	void Unload(int shard);
+
+	/**
+	 * Returns the id in the sharded database of an entry of a shard
+	 * @param shard
+	 * @param id id of the entry in the shard
+	 * @return global id
+	 */
+	inline EntryId GlobalId(int shard, EntryId id) const {
+		return id * (EntryId)m_shards.size() + shard;
+	}
+
+	/**
+	 * Returns the shard of an entry
+	 * @param id global id
+	 * @return shard
+	 */
+	inline int ShardOf(EntryId id) const {
+		return (int)(id % m_shards.size());
+	}
+
+	/**
+	 * Returns the id of an entry in its shard
+	 * @param id global id
+	 * @return local id
+	 */
+	inline EntryId LocalId(EntryId id) const {
+		return id / (EntryId)m_shards.size();
+	}
+
+	/**
+	 * Saves the database. The file given contains only an index; the
+	 * vocabulary is saved in binary format in <filename>.voc (and its 
+	 * hash, in <filename>.voc.hash) and each shard s, in <filename>.<s>, 
+	 * which references the vocabulary file.
+	 * Shards that are not loaded are only read from disk if they must be
+	 * copied to a new file
+	 * @param filename
+	 * @param binary (default: true) store shards in binary format
+	 */
+	void Save(const char *filename, bool binary = true);
+
+	/**
+	 * Loads a database saved with Save. Only the vocabulary is read; the
+	 * shards are loaded when they are needed
+	 * @param filename
+	 */
+	void Load(const char *filename);
+
+	/**
+	 * Returns the vocabulary of the shards
+	 * @return vocabulary
+	 */
+	inline const Vocabulary& Voc() const {
+		return *m_voc;
+	}
+
+	/**
+	 * Returns a handle to the vocabulary of the shards
+	 * @return handle to the vocabulary
+	 */
+	inline SharedVocabulary SharedVoc() const {
+		return m_voc;
+	}
+
+protected:
+
+	/**
+	 * Returns a shard, loading it if necessary
+	 * @param shard
+	 * @return shard
+	 * @throws DException if the shard does not exist or cannot be loaded
+	 */
+	Database* getShard(int shard) const;
+
+	/**
+	 * Returns the name of the file of a shard
+	 * @param filename file of the database
+	 * @param shard
+	 * @return file of the shard
+	 */
+	static string shardFilename(const string &filename, int shard);
+
+	/**
+	 * Saves a shard that references the vocabulary file, which is not
+	 * checked again
+	 * @param db shard
+	 * @param filename file of the shard
+	 * @param voc_filename vocabulary file, relative to the shard file
+	 * @param binary store in binary format
+	 */
+	void saveShard(const Database &db, const string &filename,
+		const string &voc_filename, bool binary) const;
+
+	/**
+	 * Frees all the shards
+	 */
+	void clear();
+
+protected:
+
+	// Vocabulary of all the shards
+	SharedVocabulary m_voc;
+
+	// Shards, or NULL if they are not loaded
+	mutable vector<Database*> m_shards;
+
+	// Number of entries of each shard
+	vector<unsigned int> m_entries;
+
+	// Shards with changes that are not saved yet
+	vector<bool> m_modified;
+
+	// File the database was loaded from or saved to, or empty
+	string m_filename;
+
+private:
+
+	/**
+	 * Copying is not allowed
+	 */
+	ShardedDatabase(const ShardedDatabase &db);
+	ShardedDatabase& operator=(const ShardedDatabase &db);
+
+};
+
+}
+
+#endif
+
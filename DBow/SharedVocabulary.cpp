@@ -0,0 +1,139 @@
+/**
+ * File: SharedVocabulary.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: reference-counted handle to an immutable vocabulary
+ */
+
+#include "SharedVocabulary.h"
+#include "Vocabulary.h"
+#include <cstddef>
+#include <string>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+using namespace DBow;
+using namespace std;
+
+// Handles in different threads update the counter at the same time, also 
+// when the library is not built with OpenMP, so a system mutex is used
+struct SharedVocabulary::Control {
+	int count; // number of handles
+	string hash; // hash of m_voc, empty until it is computed
+
+#ifdef WIN32
+	CRITICAL_SECTION mutex;
+
+	Control(): count(1){ InitializeCriticalSection(&mutex); }
+	~Control(){ DeleteCriticalSection(&mutex); }
+	inline void lock(){ EnterCriticalSection(&mutex); }
+	inline void unlock(){ LeaveCriticalSection(&mutex); }
+#else
+	pthread_mutex_t mutex;
+
+	Control(): count(1){ pthread_mutex_init(&mutex, NULL); }
+	~Control(){ pthread_mutex_destroy(&mutex); }
+	inline void lock(){ pthread_mutex_lock(&mutex); }
+	inline void unlock(){ pthread_mutex_unlock(&mutex); }
+#endif
+};
+
+SharedVocabulary::SharedVocabulary(void):
+	m_voc(NULL), m_control(NULL)
+{
+}
+
+SharedVocabulary::SharedVocabulary(Vocabulary *voc):
+	m_voc(voc), m_control(NULL)
+{
+	if(voc) m_control = new Control;
+}
+
+SharedVocabulary::SharedVocabulary(const SharedVocabulary &voc):
+	m_voc(voc.m_voc), m_control(voc.m_control)
+{
+	if(m_control){
+		// the counter may be updated by handles in other threads
+		m_control->lock();
+		++m_control->count;
+		m_control->unlock();
+	}
+}
+
+SharedVocabulary::~SharedVocabulary(void)
+{
+	release();
+}
+
+SharedVocabulary& SharedVocabulary::operator=(const SharedVocabulary &voc)
+{
+	// the copy is made first in case voc is this handle
+	SharedVocabulary tmp(voc);
+	swap(tmp);
+	return *this;
+}
+
+void SharedVocabulary::swap(SharedVocabulary &voc)
+{
+	const Vocabulary *v = m_voc;
+	m_voc = voc.m_voc;
+	voc.m_voc = v;
+
+	Control *c = m_control;
+	m_control = voc.m_control;
+	voc.m_control = c;
+}
+
+int SharedVocabulary::UseCount() const
+{
+	int n = 0;
+	if(m_control){
+		m_control->lock();
+		n = m_control->count;
+		m_control->unlock();
+	}
+	return n;
+}
+
+string SharedVocabulary::Hash() const
+{
+	string hash;
+	if(m_control){
+		// other handles may be asking for it at the same time. The hash
+		// is computed only once, so it can be done inside the lock
+		m_control->lock();
+		try{
+			if(m_control->hash.empty()) m_control->hash = m_voc->Hash();
+			hash = m_control->hash;
+		}catch(...){
+			m_control->unlock();
+			throw;
+		}
+		m_control->unlock();
+	}
+	return hash;
+}
+
+void SharedVocabulary::release()
+{
+	if(m_control){
+		bool last;
+
+		m_control->lock();
+		last = (--m_control->count == 0);
+		m_control->unlock();
+
+		if(last){
+			delete m_voc;
+			delete m_control;
+		}
+	}
+
+	m_voc = NULL;
+	m_control = NULL;
+}
+
@@ -0,0 +1,129 @@
+/**
+ * File: SharedVocabulary.h
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: reference-counted handle to an immutable vocabulary
+ *
+ * Note: a database created from a Vocabulary keeps its own copy of it.
+ *   Several databases can use the same vocabulary without copying it by
+ *   creating them from a SharedVocabulary. The vocabulary is freed when
+ *   the last handle to it is destroyed, and cannot be modified through
+ *   the handles:
+ *
+ *     SharedVocabulary voc(new HVocabulary("voc.bin"));
+ *     Database db1(voc), db2(voc); // one tree only
+ *
+ *   Handles can be copied and destroyed from different threads.
+ */
+
+#pragma once
+#ifndef __D_SHARED_VOCABULARY__
+#define __D_SHARED_VOCABULARY__
+
+#include "Vocabulary.h"
+#include <cstddef>
+#include <string>
+using namespace std;
+
+namespace DBow {
+
+	class SharedVocabulary
+	{
+	public:
+
+		/**
+		 * Creates a handle to no vocabulary
+		 */
+		SharedVocabulary(void);
+
+		/**
+		 * Creates the first handle to a vocabulary
+		 * @param voc vocabulary allocated with new. The handles take the
+		 *   ownership of it, so it must not be deleted or modified
+		 *   afterwards
+		 */
+		explicit SharedVocabulary(Vocabulary *voc);
+
+		/**
+		 * Creates another handle to the same vocabulary
+		 * @param voc
+		 */
+		SharedVocabulary(const SharedVocabulary &voc);
+
+		/**
+		 * Destructor. Frees the vocabulary if this is the last handle to it
+		 */
+		~SharedVocabulary(void);
+
+		/**
+		 * Makes this handle refer to the vocabulary of another one
+		 * @param voc
+		 * @return this handle
+		 */
+		SharedVocabulary& operator=(const SharedVocabulary &voc);
+
+		/**
+		 * Exchanges the vocabularies of two handles
+		 * @param voc
+		 */
+		void swap(SharedVocabulary &voc);
+
+		/**
+		 * Returns the vocabulary
+		 * @return pointer to the vocabulary, or NULL
+		 */
+		inline const Vocabulary* get() const { return m_voc; }
+
+		/**
+		 * Returns the vocabulary
+		 * @return vocabulary
+		 */
+		inline const Vocabulary& operator*() const { return *m_voc; }
+		inline const Vocabulary* operator->() const { return m_voc; }
+
+		/**
+		 * Says whether the handle refers to no vocabulary
+		 * @return true iif there is no vocabulary
+		 */
+		inline bool empty() const { return m_voc == NULL; }
+
+		/**
+		 * Returns the number of handles to the vocabulary
+		 * @return number of handles, or 0 if there is no vocabulary
+		 */
+		int UseCount() const;
+
+		/**
+		 * Returns the content hash of the vocabulary. It is computed only
+		 * once for all the handles, since the vocabulary cannot change
+		 * @return hash, or empty if there is no vocabulary
+		 * @see Vocabulary::Hash
+		 */
+		string Hash() const;
+
+	protected:
+
+		/**
+		 * Stops referring to the vocabulary, freeing it if necessary
+		 */
+		void release();
+
+	protected:
+
+		// Vocabulary
+		const Vocabulary *m_voc;
+
+		// Data shared by all the handles to m_voc (counter, hash and the
+		// mutex that protects them). Defined in SharedVocabulary.cpp so 
+		// that the system headers of the mutex are not included here
+		struct Control;
+
+		// Control data of m_voc
+		Control *m_control;
+
+	};
+
+}
+
+#endif
+
@@ -7,11 +7,13 @@
 
 #include "Vocabulary.h"
 #include "VocParams.h"
+#include "ContentHash.h"
 #include "DUtils.h"
 
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <vector>
 #include <list>
 #include <fstream>
@@ -53,12 +55,29 @@ Vocabulary::~Vocabulary(void)
 	delete m_params;
 }
 
+void Vocabulary::swap(Vocabulary &voc)
+{
+	std::swap(m_created, voc.m_created);
+	std::swap(m_frequent_words_stopped, voc.m_frequent_words_stopped);
+	std::swap(m_infrequent_words_stopped, voc.m_infrequent_words_stopped);
+	m_word_frequency.swap(voc.m_word_frequency);
+
+	std::swap(m_params, voc.m_params);
+	m_word_stopped.swap(voc.m_word_stopped);
+	m_stop_list.swap(voc.m_stop_list);
+	m_words_in_order.swap(voc.m_words_in_order);
+}
+
 void Vocabulary::Save(const char *filename, bool binary) const
 {
-	if(binary)
+	if(binary){
 		SaveBinary(filename);
-	else
-		SaveText(filename);	
+		StoreHash(filename, Hash());
+	}else{
+		SaveText(filename);
+		// a hash from a previous binary file would be stale
+		remove(hashFilename(filename).c_str());
+	}
 }
 
 unsigned int Vocabulary::Load(const char *filename)
@@ -80,6 +99,57 @@ unsigned int Vocabulary::Load(const char *filename)
 	
 }
 
+string Vocabulary::StoredHash(const char *filename)
+{
+	fstream f(hashFilename(filename).c_str(), ios::in);
+	if(!f.is_open()) return "";
+
+	string hash;
+	f >> hash;
+	f.close();
+
+	if(hash.size() != 16) return "";
+	return hash;
+}
+
+void Vocabulary::StoreHash(const char *filename, const string &hash)
+{
+	fstream f(hashFilename(filename).c_str(), ios::out);
+	if(!f.is_open()) throw DUtils::DException("Cannot open file");
+
+	f << hash << endl;
+	f.close();
+}
+
+string Vocabulary::hashFilename(const char *filename)
+{
+	return string(filename) + ".hash";
+}
+
+string Vocabulary::Hash() const
+{
+	ContentHash h;
+
+	h << (int)m_params->Type
+		<< (int)m_params->Weighting
+		<< (int)m_params->Scoring
+		<< (int)( m_params->ScaleScore ? 1 : 0 )
+		<< m_params->DescriptorLength
+		<< NumberOfWords()
+		<< m_frequent_words_stopped
+		<< m_infrequent_words_stopped;
+
+	if(m_created){
+		vector<float>::const_iterator it;
+		for(it = m_word_frequency.begin(); it != m_word_frequency.end(); it++)
+			h << *it;
+
+		hashContent(h);
+	}
+
+	return h.toString();
+}
+
 
 VocInfo Vocabulary::RetrieveInfo() const
 {
@@ -308,146 +378,201 @@ void Vocabulary::StopWords(int frequent_words, int infrequent_words)
 	m_infrequent_words_stopped = ninfrequent;	
 }
 
-void Vocabulary::Transform(const vector<float>& features, BowVector &v, bool arrange) const
+void Vocabulary::Create(const vector<vector<float> >& training_features)
 {
-	// words in v must be in ascending order
+	vector<DescriptorView> views;
+	views.reserve(training_features.size());
+
+	vector<vector<float> >::const_iterator it;
+	for(it = training_features.begin(); it != training_features.end(); it++){
+		views.push_back(DescriptorView(*it, m_params->DescriptorLength));
+	}
 
-	assert(features.size() % m_params->DescriptorLength == 0);
+	Create(views);
+}
+
+void Vocabulary::Transform(const DescriptorView& features, BowVector &v, bool arrange) const
+{
+	vector<WordId> words;
+	Transform(features, v, words, arrange);
+}
+
+void Vocabulary::Transform(const DescriptorView& features, BowVector &v, 
+	vector<WordId> &words, bool arrange) const
+{
+	assert(features.empty() || features.Cols() == m_params->DescriptorLength);
+
+	transformFeatures(features, words);
+
+	ComputeBowVector(words, v, arrange);
+}
+
+void Vocabulary::transformFeatures(const DescriptorView &features, 
+	vector<WordId> &words) const
+{
+	const int nfeatures = features.Rows();
+
+	words.resize(nfeatures);
+	for(int i = 0; i < nfeatures; i++){
+		words[i] = Transform(features[i]);
+	}
+}
+
+void Vocabulary::ComputeBowVector(const vector<WordId> &words, BowVector &v, 
+	bool arrange, const vector<WordValue> *contributions) const
+{
+	// words in v must be in ascending order
 
 	v.resize(0);
-	v.reserve(features.size() / m_params->DescriptorLength);
+	v.reserve(words.size());
 
-	vector<WordId> stopped;
-	stopped.reserve(v.capacity());
+	// Each feature is added as an entry, and the entries of the same word 
+	// are merged after sorting them, so that the cost is O(n log n). 
+	// Stopped words are kept until then to count them once in n_d.
+	// Entries are always left in order
 
-	// 3 implementations have been tried:
-	// 1) unordered vector + sort
-	// 2) ordered vector
-	// 3) ordered list + conversion to vector
-	// Number 1) worked better
+	assert(!contributions || contributions->size() == words.size());
 
-	vector<float>::const_iterator it;
+	const VocParams::WeightingType weighting = m_params->Weighting;
 
-	int nd = 0;
+	for(unsigned int i = 0; i < words.size(); i++){
+		const WordId id = words[i];
+		WordValue weight = 0;
 
-	switch(m_params->Weighting){
-		
-		case VocParams::TF:
-		case VocParams::IDF:
-		case VocParams::TF_IDF:
-			// Note: GetWordWeight returns at this moment the IDF value for TF_IDF and IDF, or 
-			// 1 in the TF case. So that by multiplying by the tf- part, we get the final score.
+		if(weighting == VocParams::BINARY){
+			// Weights are not used. Just put 1 in active words
+			weight = 1;
+
+		}else if(!isWordStopped(id)){
+			// Note: GetWordWeight returns at this moment the IDF value for 
+			// TF_IDF and IDF, or 1 in the TF case. So that by multiplying by
+			// the tf- part, we get the final score.
 			// We must multiply by n_i_d/n_d,
-			// where n_i_d is the number of occurrences of word i in the document,
-			// and n_d, the total number of words in the document
-
-			// implementation 1) unordered vector + sort
-			for(it = features.begin(); it < features.end(); it += m_params->DescriptorLength)
-			{
-				WordId id = Transform(it);
-				
-				if(isWordStopped(id)){
-					vector<WordId>::iterator fit = find(stopped.begin(), stopped.end(), id);
-					if(fit == stopped.end()){
-						stopped.push_back(id);
-						nd++;
-					}
-					
-				}else{
-
-					BowVector::iterator fit = find(v.begin(), v.end(), id);
-					if(fit == v.end()){
-						v.push_back(BowVectorEntry(id, GetWordWeight(id)));
-						nd++;
-					}else if(m_params->Weighting != VocParams::IDF){
-						fit->value += GetWordWeight(id); // n_i_d is implicit in this operation
-					}
-				} // if word is stopped
-			} // for feature
-
-			// tf or tf-idf
-			if(nd > 0 && m_params->Weighting != VocParams::IDF){
-				for(BowVector::iterator fit = v.begin(); fit != v.end(); fit++) 
-					fit->value /= (double)nd;
-			}
+			// where n_i_d is the number of occurrences of word i in the 
+			// document, and n_d, the total number of words in the document
+
+			// If contributions are given (soft assignment), the occurrences
+			// of each word are weighted by them
+			weight = GetWordWeight(id);
+			if(contributions && weighting != VocParams::IDF)
+				weight *= (*contributions)[i];
+		}
 
-			break;
+		v.push_back(BowVectorEntry(id, weight));
+	}
 
-		// - - 
+	v.PutInOrder();
 
-		case VocParams::BINARY:
-			// Weights are not used. Just put 1 in active words
-			for(it = features.begin(); it < features.end(); it += m_params->DescriptorLength)
-			{
-				WordId id = Transform(it);
-				
-				if(!isWordStopped(id)){
-					BowVector::iterator fit = find(v.begin(), v.end(), id);
-					if(fit == v.end()){
-						v.push_back(BowVectorEntry(id, 1));
-					}
-				} // if word is stopped
-			} // for feature
+	// merge the entries of each word
+	int nd = 0;
+	BowVector::iterator out = v.begin();
+	BowVector::const_iterator it = v.begin();
 
-			break;
+	while(it != v.end()){
+		const WordId id = it->id;
+		WordValue value = it->value;
+
+		for(++it; it != v.end() && it->id == id; ++it){
+			if(weighting == VocParams::TF || weighting == VocParams::TF_IDF)
+				value += it->value; // n_i_d is implicit in this operation
+		}
+
+		nd++;
+
+		if(!isWordStopped(id)){
+			*out = BowVectorEntry(id, value);
+			++out;
+		}
 	}
 
-	if(arrange) v.PutInOrder();
-	
+	v.resize(out - v.begin());
+
+	// tf or tf-idf
+	if(nd > 0 && 
+		(weighting == VocParams::TF || weighting == VocParams::TF_IDF))
+	{
+		for(BowVector::iterator fit = v.begin(); fit != v.end(); fit++) 
+			fit->value /= (double)nd;
+	}
 }
 
 void Vocabulary::GetWordWeightsAndCreateStopList(
-	const vector<vector<float> >& training_features,
+	const vector<DescriptorView>& training_features,
 	vector<WordValue> &weights)
 {
-	const int NWords = GetNumberOfWords();
-	const int NDocs = training_features.size();
+	assert(!training_features.empty());
 
-	assert(NWords > 0 && NDocs > 0);
+	vector<unsigned int> Ni;
+	InitWordStatistics(Ni);
 
-	weights.clear();
-	weights.insert(weights.end(), NWords, 0);
+	vector<DescriptorView>::const_iterator mit;
+	for(mit = training_features.begin(); mit != training_features.end(); mit++){
+		AddToWordStatistics(*mit, Ni);
+	}
+
+	SetWordWeightsAndCreateStopList(Ni, training_features.size(), weights);
+}
+
+void Vocabulary::InitWordStatistics(vector<unsigned int> &Ni)
+{
+	const int NWords = GetNumberOfWords();
 
-	vector<vector<float> >::const_iterator mit;
-	vector<float>::const_iterator fit;
+	assert(NWords > 0);
 
 	m_word_frequency.resize(0);
 	m_word_frequency.resize(NWords, 0);
 
+	Ni.resize(0);
+	Ni.resize(NWords, 0);
+}
+
+void Vocabulary::AddToWordStatistics(const DescriptorView &document,
+	vector<unsigned int> &Ni)
+{
+	// calculate Ni: number of images in the voc data with
+	// at least one descriptor vector path through node i.
+	// calculate word frequency too
+	vector<WordId> words;
+	words.reserve(document.Rows());
+
+	for(int i = 0; i < document.Rows(); i++){
+		WordId id = Transform(document[i]);
+		
+		m_word_frequency[id] += 1.f;
+		words.push_back(id);
+	}
+
+	// count each word once per document
+	sort(words.begin(), words.end());
+	vector<WordId>::const_iterator wend = unique(words.begin(), words.end());
+
+	vector<WordId>::const_iterator wit;
+	for(wit = words.begin(); wit != wend; wit++) Ni[*wit]++;
+}
+
+void Vocabulary::SetWordWeightsAndCreateStopList(
+	const vector<unsigned int> &Ni, int NDocs, vector<WordValue> &weights)
+{
+	const int NWords = GetNumberOfWords();
+
+	assert(NWords > 0 && NDocs > 0);
+	assert((int)Ni.size() == NWords);
+
+	weights.clear();
+	weights.insert(weights.end(), NWords, 0);
+
 	switch(m_params->Weighting){
 		case VocParams::IDF:
 		case VocParams::TF_IDF:
-			{
-				// Note:
-				// This is not actually a tf-idf score, but a idf score.
-				// The complete tf-idf score is calculated in Vocabulary::Transform
-
-				// calculate Ni: number of images in the voc data with
-				// at least one descriptor vector path through node i.
-				// calculate word frequency too
-				vector<unsigned int> Ni(NWords, 0);
-				vector<bool> counted(NWords, false);
-
-				for(mit = training_features.begin(); mit != training_features.end(); mit++){
-					fill(counted.begin(), counted.end(), false);
-					
-					for(fit = mit->begin(); fit < mit->end(); fit += m_params->DescriptorLength){
-						WordId id = Transform(fit);
-						
-						m_word_frequency[id] += 1.f;
-						if(!counted[id]){
-							Ni[id]++;
-							counted[id] = true;
-						}
-					}
-				}
-
-				// set ln(N/Ni)
-				for(int i = 0; i < NWords; i++){
-					if(Ni[i] > 0){
-						weights[i] = log((double)NDocs / (double)Ni[i]);
-					}// else // This cannot occur if using kmeans++
-				}
+			// Note:
+			// This is not actually a tf-idf score, but a idf score.
+			// The complete tf-idf score is calculated in Vocabulary::Transform
+
+			// set ln(N/Ni)
+			for(int i = 0; i < NWords; i++){
+				if(Ni[i] > 0){
+					weights[i] = log((double)NDocs / (double)Ni[i]);
+				}// else // This cannot occur if using kmeans++
 			}
 
 			break;
@@ -460,17 +585,9 @@ void Vocabulary::GetWordWeightsAndCreateStopList(
 		case VocParams::BINARY:
 			// Note:
 			// The tf score is calculated in Vocabulary::Transform
-			// Here, we only create the frequency vector,
-			// and fill weights with 1's.
+			// Here, we only fill weights with 1's.
 			// In the binary case, weights are not necessary, so that their value
 			// do not matter
-			for(mit = training_features.begin(); mit != training_features.end(); mit++){
-				for(fit = mit->begin(); fit < mit->end(); fit += m_params->DescriptorLength){
-					WordId id = Transform(fit);
-					m_word_frequency[id] += 1.f;
-				}
-			}
-			
 			break;
 	}
 
@@ -560,7 +677,7 @@ void Vocabulary::SaveBinaryHeader(DUtils::BinaryFile &f) const
 		<< m_infrequent_words_stopped;
 }
 
-void Vocabulary::SaveTextHeader(fstream &f) const
+void Vocabulary::SaveTextHeader(DUtils::TextFile &f) const
 {
 	// Text header format:
 	// Vt Wt St Ss D W SfW SiW 
@@ -583,7 +700,7 @@ void Vocabulary::SaveTextHeader(fstream &f) const
 		<< NumberOfWords() << " "
 		<< m_frequent_words_stopped << " "
 		<< m_infrequent_words_stopped
-		<< endl;
+		<< '\n';
 }
 
 int Vocabulary::LoadBinaryHeader(DUtils::BinaryFile &f)
@@ -605,7 +722,7 @@ int Vocabulary::LoadBinaryHeader(DUtils::BinaryFile &f)
 	return nwords;
 }
 
-int Vocabulary::LoadTextHeader(fstream &f)
+int Vocabulary::LoadTextHeader(DUtils::TextFile &f)
 {
 	int voctype, weighting, scoring, scalescore, nwords, ndesc;
 
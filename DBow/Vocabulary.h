@@ -12,6 +12,8 @@
 #include "VocParams.h"
 #include "VocInfo.h"
 #include "BowVector.h"
+#include "DescriptorView.h"
+#include "ContentHash.h"
 #include "DUtils.h"
 
 namespace DBow {
@@ -48,6 +50,9 @@ namespace DBow {
 		 * The vocabulary can be saved in binary format (improves size and speed)
 		 * or in text format (good for interoperability).
 		 * Note that training data is not saved.
+		 * In binary format, the content hash of the vocabulary is also stored
+		 * in <filename>.hash, so that it can be checked without loading the
+		 * vocabulary (@see StoredHash)
 		 * @param filename file to store the vocabulary in
 		 * @param binary (default: true): sets if binary format must be used
 		 */
@@ -61,6 +66,32 @@ namespace DBow {
 		 */
 		unsigned int Load(const char *filename);
 
+		/**
+		 * Returns a hash of the content of the vocabulary (parameters, tree
+		 * and word frequencies). Two vocabularies with the same hash are 
+		 * the same, even if they were loaded from different files or 
+		 * formats. Its cost is linear in the size of the vocabulary
+		 * @return hash as 16 hexadecimal digits
+		 */
+		string Hash() const;
+
+		/**
+		 * Returns the content hash stored along with a vocabulary file, 
+		 * without reading the vocabulary. Only files saved in binary format
+		 * have it, since the text format does not keep the exact values
+		 * @param filename vocabulary file
+		 * @return hash, or an empty string if the file has no stored hash
+		 */
+		static string StoredHash(const char *filename);
+
+		/**
+		 * Stores the content hash of a vocabulary file saved in binary 
+		 * format, e.g. if it was saved without it by an older version
+		 * @param filename vocabulary file
+		 * @param hash content hash of the vocabulary of the file
+		 */
+		static void StoreHash(const char *filename, const string &hash);
+
 		/**
 		 * Returns whether the vocabulary is empty or has already been created
 		 */
@@ -73,7 +104,15 @@ namespace DBow {
 		 *    Each feature group represents a different source of features.
 		 *    This is necessary for some weighting methods, like tf-idf
 		 */
-		virtual void Create(const vector<vector<float> >& training_features) = 0;
+		void Create(const vector<vector<float> >& training_features);
+
+		/** 
+		 * Creates the vocabulary from some training data without copying it.
+		 * The current content of the vocabulary is cleared
+		 * @param training_features vector of views of groups of features.
+		 *    Each view represents a different source of features
+		 */
+		virtual void Create(const vector<DescriptorView>& training_features) = 0;
 
 		/** 
 		 * Transforms a set of image features into a bag-of-words vector
@@ -82,12 +121,43 @@ namespace DBow {
 		 * @see Vocabulary::isWordStopped
 		 * @param features image features in the OpenCV format
 		 * @param v (out) bow vector
-		 * @param arrange (default: true) iif true, puts entries in v in order.
-		 *    This is necessary if v is going to be used with Vocabulary::Score.
-		 *    If not (is only used with Database), setting arrange to false can
-		 *    slightly save some time
+		 * @param arrange (default: true) deprecated, not used: entries in v
+		 *    are always put in order, which Vocabulary::Score needs
+		 */
+		inline void Transform(const vector<float>& features, BowVector &v, 
+			bool arrange = true) const
+		{
+			Transform(DescriptorView(features, m_params->DescriptorLength), 
+				v, arrange);
+		}
+
+		/** 
+		 * Transforms a matrix of image features into a bag-of-words vector
+		 * without copying the features.
+		 * @see Vocabulary::Transform(const vector<float>&, BowVector&, bool)
+		 * @param features view of the image features. Its number of cols must
+		 *    be the descriptor length
+		 * @param v (out) bow vector
+		 * @param arrange (default: true) deprecated, not used: entries in v
+		 *    are always put in order
 		 */
-		void Transform(const vector<float>& features, BowVector &v, bool arrange = true) const;
+		void Transform(const DescriptorView& features, BowVector &v, 
+			bool arrange = true) const;
+
+		/** 
+		 * Transforms a matrix of image features into a bag-of-words vector
+		 * and returns the word each feature was quantized to, so that 
+		 * features can be matched later without transforming them again.
+		 * @see Vocabulary::Transform(const DescriptorView&, BowVector&, bool)
+		 * @param features view of the image features
+		 * @param v (out) bow vector
+		 * @param words (out) words[i] is the word id of the i-th feature. 
+		 *    Stopped words are also given here, although they are not in v
+		 * @param arrange (default: true) deprecated, not used: entries in v
+		 *    are always put in order
+		 */
+		void Transform(const DescriptorView& features, BowVector &v, 
+			vector<WordId> &words, bool arrange = true) const;
 
 		/** 
 		 * Returns the number of words in the vocabulary
@@ -131,6 +201,14 @@ namespace DBow {
 		 */
 		VocInfo RetrieveInfo() const;
 
+		/** 
+		 * Gets the type of vocabulary
+		 * @return vocabulary type
+		 */
+		inline VocParams::VocType Type() const {
+			return m_params->Type;
+		}
+
 		/** 
 		 * Gets the weighting method
 		 * @return weighting method
@@ -147,6 +225,41 @@ namespace DBow {
 			return m_params->Scoring;
 		}
 
+		/**
+		 * Says if scores are scaled
+		 * @return true iif scores are scaled to [0..1] when possible
+		 */
+		inline bool ScaleScore() const {
+			return m_params->ScaleScore;
+		}
+
+		/** 
+		 * Gets the length of the descriptors
+		 * @return descriptor length
+		 */
+		inline int DescriptorLength() const { 
+			return m_params->DescriptorLength;
+		}
+
+		/**
+		 * Returns the weight of a word (its idf if tf-idf or idf weighting 
+		 * is used, 1 otherwise)
+		 * @param id word id
+		 * @return word weight
+		 */
+		inline WordValue WordWeight(WordId id) const {
+			return GetWordWeight(id);
+		}
+
+		/**
+		 * Returns the frequency of a word in the training data
+		 * @param id word id
+		 * @return word frequency, in per one units
+		 */
+		inline float WordFrequency(WordId id) const {
+			return GetWordFrequency(id);
+		}
+
 		/** 
 		 * Returns the score between two vectors according to this voc.
 		 * BowVectors must be in order of ids
@@ -188,13 +301,50 @@ namespace DBow {
 		 */
 		virtual unsigned int LoadText(const char *filename) = 0;
 
+		/**
+		 * Adds the content of the vocabulary that is specific to the 
+		 * subclass to a hash. Must be implemented by subclasses
+		 * @param h (in/out) hash
+		 */
+		virtual void hashContent(ContentHash &h) const = 0;
+
+		/**
+		 * Returns the name of the file with the stored hash of a 
+		 * vocabulary file
+		 * @param filename vocabulary file
+		 * @return hash file
+		 */
+		static string hashFilename(const char *filename);
+
 		/**
 		 * Transforms a feature into its word id
 		 * @param feature descriptor. Pointer to the beginning of a DescriptorLenght
 		 *     size vector containing the feature descriptor
 		 * @return word id
 		 */
-		virtual WordId Transform(const vector<float>::const_iterator &pfeature) const = 0;
+		virtual WordId Transform(const float *pfeature) const = 0;
+
+		/**
+		 * Creates the bag-of-words vector of a document from the words of 
+		 * its features, applying the weighting method and the stop list
+		 * @param words word id of each feature of the document
+		 * @param v (out) bow vector
+		 * @param arrange not used: entries in v are always put in order
+		 * @param contributions (default: NULL) if given, contributions[i] is
+		 *    the fraction of an occurrence that words[i] counts as (this is
+		 *    used when a feature is softly assigned to several words)
+		 */
+		void ComputeBowVector(const vector<WordId> &words, BowVector &v, 
+			bool arrange, const vector<WordValue> *contributions = NULL) const;
+
+		/**
+		 * Transforms the features of an image into their word ids. 
+		 * Subclasses can override this to reuse memory between features
+		 * @param features view of the image features
+		 * @param words (out) words[i] is the word id of the i-th feature
+		 */
+		virtual void transformFeatures(const DescriptorView &features,
+			vector<WordId> &words) const;
 
 		/**
 		 * Returns the weight of a word
@@ -232,10 +382,10 @@ namespace DBow {
 		void SaveBinaryHeader(DUtils::BinaryFile &f) const;
 
 		/**
-		 * Saves a header with vocabulary info in binary text
+		 * Saves a header with vocabulary info in text format
 		 * @param f (in/out) file
 		 */
-		void SaveTextHeader(fstream &f) const;
+		void SaveTextHeader(DUtils::TextFile &f) const;
 
 		/**
 		 * Loads header with vocabulary info in binary format
@@ -245,11 +395,11 @@ namespace DBow {
 		int LoadBinaryHeader(DUtils::BinaryFile &f);
 
 		/**
-		 * Loads a header with vocabulary info in binary format
+		 * Loads a header with vocabulary info in text format
 		 * @param f (in/out) file
 		 * @return number of words
 		 */
-		int LoadTextHeader(fstream &f);
+		int LoadTextHeader(DUtils::TextFile &f);
 
 	protected:
 
@@ -260,9 +410,41 @@ namespace DBow {
 		 *    (same format as in ::Create)
 		 * @param weigths (out) vector such that weights[WordId] = weight
 		 */
-		void GetWordWeightsAndCreateStopList(const vector<vector<float> >& training_features,
+		void GetWordWeightsAndCreateStopList(
+			const vector<DescriptorView>& training_features,
 			vector<WordValue> &weights);
 
+		/**
+		 * Does the same as GetWordWeightsAndCreateStopList, but allows to
+		 * give the training documents one by one, so that they do not have
+		 * to be in memory at the same time. Usage:
+		 *   InitWordStatistics(Ni);
+		 *   for each document: AddToWordStatistics(document, Ni);
+		 *   SetWordWeightsAndCreateStopList(Ni, number of documents, weights);
+		 * @param Ni (out) number of documents in which each word appears
+		 */
+		void InitWordStatistics(vector<unsigned int> &Ni);
+
+		/**
+		 * Updates the word frequencies and Ni with a training document
+		 * @see InitWordStatistics
+		 * @param document features of a training image
+		 * @param Ni (in/out) number of documents in which each word appears
+		 */
+		void AddToWordStatistics(const DescriptorView &document, 
+			vector<unsigned int> &Ni);
+
+		/**
+		 * Calculates the word weights and creates the stop list once all 
+		 * the training documents are given
+		 * @see InitWordStatistics
+		 * @param Ni number of documents in which each word appears
+		 * @param NDocs number of training documents
+		 * @param weigths (out) vector such that weights[WordId] = weight
+		 */
+		void SetWordWeightsAndCreateStopList(const vector<unsigned int> &Ni,
+			int NDocs, vector<WordValue> &weights);
+
 		/**
 		 * Creates an empty stop list with the word frequencies given.
 		 * m_word_frequency must be filled for all the words in the vocabulary.
@@ -271,6 +453,15 @@ namespace DBow {
 		 */
 		void CreateStopList();
 
+	protected:
+
+		/**
+		 * Exchanges the data of this class with another vocabulary. 
+		 * Subclasses use this to exchange whole vocabularies
+		 * @param voc vocabulary
+		 */
+		void swap(Vocabulary &voc);
+
 	protected:
 
 		// Says if the vocabulary was already created
@@ -106,19 +106,24 @@ void BinaryFile::OpenForAppending(const char *filename)
 	}
 }
 
-void BinaryFile::DiscardBytes(int count)
+void BinaryFile::Flush()
 {
 	if(!m_f.is_open()) throw DException("File is not open");
 
-	if(m_mode & READ){
-		m_f.ignore(count);
+	if(m_mode & WRITE){
+		m_f.flush();
 	}else
 		throw DException("Wrong access mode");
 }
 
-inline bool BinaryFile::Eof()
+void BinaryFile::DiscardBytes(int count)
 {
-	return(!m_f.is_open() || m_f.eof());
+	if(!m_f.is_open()) throw DException("File is not open");
+
+	if(m_mode & READ){
+		m_f.ignore(count);
+	}else
+		throw DException("Wrong access mode");
 }
 
 unsigned int BinaryFile::BytesRead()
@@ -232,6 +237,41 @@ BinaryFile& BinaryFile::operator>>(double &v)
 	return *this;
 }
 
+void BinaryFile::Write(const float *v, int count)
+{
+	if(!m_f.is_open()) throw DException("File is not open");
+
+	if(m_mode & WRITE){
+		// convert and write the values in chunks
+		char buf[4 * 1024];
+		while(count > 0){
+			const int n = (count < 1024 ? count : 1024);
+			for(int i = 0; i < n; i++) hton_f(v[i], buf + 4*i);
+			m_f.write(buf, 4*n);
+			v += n;
+			count -= n;
+		}
+	}else
+		throw DException("Wrong access mode");
+}
+
+void BinaryFile::Read(float *v, int count)
+{
+	if(!m_f.is_open()) throw DException("File is not open");
+
+	if(m_mode & READ){
+		// read all the bytes at once and convert them in place
+		m_f.read((char*)v, 4*count);
+		if(isLittleEndian()){
+			char *p = (char*)v;
+			for(int i = 0; i < count; i++, p += 4){
+				char aux[8] = { p[0], p[1], p[2], p[3] };
+				v[i] = ntoh_f(aux);
+			}
+		}
+	}else
+		throw DException("Wrong access mode");
+}
 
 void BinaryFile::hton_f(float v, char buf[8]) const
 {
@@ -73,13 +73,20 @@ public:
 	 * @return true iif the end of the file has been already read
 	 * @throws DException if wrong access mode
 	 */
-	inline bool Eof();
+	inline bool Eof(){
+		return(!m_f.is_open() || m_f.eof());
+	}
 
 	/* Closes any opened file. It is not necessary to call this function
 	 * explicitly
 	 */
 	void Close();
 
+	/* Writes the buffered data to the file, in writing mode
+	 * @throws DException if wrong access mode
+	 */
+	void Flush();
+
 	/**
 	 * Reads the next byte and throws it away
 	 * @throws DException if wrong access mode
@@ -141,6 +148,20 @@ public:
 	 */
 	BinaryFile& operator>>(double &v);
 
+	/* Writes an array of 4 byte float values at a time
+	 * @param v pointer to the first value
+	 * @param count number of values to write
+	 * @throws DException if wrong access mode
+	 */
+	void Write(const float *v, int count);
+
+	/* Reads an array of 4 byte float values at a time
+	 * @param v (out) pointer to memory for count floats
+	 * @param count number of values to read
+	 * @throws DException if wrong access mode
+	 */
+	void Read(float *v, int count);
+
 protected:
 
 	/**
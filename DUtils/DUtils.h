@@ -19,6 +19,7 @@
 #include "FileModes.h"
 #include "LineFile.h"
 #include "BinaryFile.h"
+#include "TextFile.h"
 #include "FileFunctions.h"
 
 // Timestamp
@@ -26,6 +27,7 @@
 
 // Random numbers
 #include "Random.h"
+#include "RandomGenerator.h"
 
 // MAth
 #include "Math.hpp"
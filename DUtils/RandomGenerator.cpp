@@ -0,0 +1,100 @@
+/*
+ * File: RandomGenerator.cpp
+ * Project: DUtils library
+ * Author: DBow contributors
+ * Date: October 2026
+ * Description: seeded pseudo-random number generator with its own state
+ *
+ */
+
+#include "RandomGenerator.h"
+#include "Timestamp.h"
+
+using namespace DUtils;
+
+static inline unsigned long long rotl(unsigned long long x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+RandomGenerator::RandomGenerator()
+{
+	Timestamp time;
+	time.setToCurrentTime();
+	Seed((unsigned long long)(time.getFloatTime() * 1e6));
+}
+
+RandomGenerator::RandomGenerator(unsigned long long seed)
+{
+	Seed(seed);
+}
+
+void RandomGenerator::Seed(unsigned long long seed)
+{
+	// the state is filled with splitmix64, so that similar seeds give
+	// very different states
+	for(int i = 0; i < 4; i++){
+		seed += 0x9e3779b97f4a7c15ULL;
+		unsigned long long z = seed;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		m_s[i] = z ^ (z >> 31);
+	}
+}
+
+unsigned long long RandomGenerator::Next()
+{
+	const unsigned long long result = rotl(m_s[1] * 5, 7) * 9;
+	const unsigned long long t = m_s[1] << 17;
+
+	m_s[2] ^= m_s[0];
+	m_s[3] ^= m_s[1];
+	m_s[1] ^= m_s[2];
+	m_s[0] ^= m_s[3];
+
+	m_s[2] ^= t;
+	m_s[3] = rotl(m_s[3], 45);
+
+	return result;
+}
+
+void RandomGenerator::Jump()
+{
+	static const unsigned long long JUMP[] = {
+		0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+		0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+
+	unsigned long long s[4] = {0, 0, 0, 0};
+
+	for(int i = 0; i < 4; i++){
+		for(int b = 0; b < 64; b++){
+			if(JUMP[i] & (1ULL << b)){
+				s[0] ^= m_s[0];
+				s[1] ^= m_s[1];
+				s[2] ^= m_s[2];
+				s[3] ^= m_s[3];
+			}
+			Next();
+		}
+	}
+
+	m_s[0] = s[0];
+	m_s[1] = s[1];
+	m_s[2] = s[2];
+	m_s[3] = s[3];
+}
+
+RandomGenerator RandomGenerator::Split()
+{
+	// copying the state and jumping this generator would make the children
+	// of a child repeat the numbers of the next children of this one, so
+	// the child is seeded (through splitmix64) with a number of this one
+	return RandomGenerator(Next());
+}
+
+int RandomGenerator::RandomInt(int min, int max)
+{
+	const unsigned long long d = (unsigned long long)((long long)max - min + 1);
+	return (int)(min + (long long)(RandomValue<double>() * d));
+}
+
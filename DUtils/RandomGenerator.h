@@ -0,0 +1,111 @@
+/*
+ * File: RandomGenerator.h
+ * Project: DUtils library
+ * Author: DBow contributors
+ * Date: October 2026
+ * Description: seeded pseudo-random number generator with its own state
+ *
+ * Note: unlike Random, which uses the global rand(), each RandomGenerator
+ *   object keeps its own state, so that several threads can draw numbers
+ *   at the same time from different generators. Generators can be split
+ *   into streams so that parallel computations give the same results as
+ *   sequential ones for the same seed:
+ *
+ *     RandomGenerator rng(seed);
+ *     vector<RandomGenerator> streams;
+ *     for(int i = 0; i < n; i++) streams.push_back(rng.Split());
+ *     // each task i uses streams[i]
+ *
+ *   Numbers are generated with xoshiro256** (Blackman and Vigna, 2018).
+ */
+
+#pragma once
+#ifndef __D_RANDOM_GENERATOR__
+#define __D_RANDOM_GENERATOR__
+
+namespace DUtils {
+
+class RandomGenerator
+{
+public:
+
+	/**
+	 * Creates a generator with a seed taken from the current time
+	 */
+	RandomGenerator();
+
+	/**
+	 * Creates a generator with the given seed
+	 * @param seed
+	 */
+	RandomGenerator(unsigned long long seed);
+
+	/**
+	 * Sets the seed of the generator, which restarts its sequence
+	 * @param seed
+	 */
+	void Seed(unsigned long long seed);
+
+	/**
+	 * Returns a new generator seeded with the next number of this one.
+	 * Generators split from the same seed, also from other split 
+	 * generators (at any depth), always get the same sequences. These are
+	 * different for any two generators split from different numbers, but 
+	 * they are not guaranteed not to overlap: they are random positions of
+	 * a sequence of period 2^256 - 1, so an overlap is only possible with 
+	 * a negligible probability. This generator is advanced one number
+	 * @return new generator
+	 */
+	RandomGenerator Split();
+
+	/**
+	 * Advances the generator 2^128 numbers
+	 */
+	void Jump();
+
+	/**
+	 * Returns a random 64-bit integer
+	 * @return random number
+	 */
+	unsigned long long Next();
+
+	/**
+	 * Returns a random number in the range [0..1)
+	 * @return random T number in [0..1)
+	 */
+	template <class T>
+	inline T RandomValue(){
+		// 53 random bits
+		return (T)((Next() >> 11) * (1.0 / 9007199254740992.0));
+	}
+
+	/**
+	 * Returns a random number in the range [min..max)
+	 * @param min
+	 * @param max
+	 * @return random T number in [min..max)
+	 */
+	template <class T>
+	inline T RandomValue(T min, T max){
+		return RandomValue<T>() * (max - min) + min;
+	}
+
+	/**
+	 * Returns a random int in the range [min..max]
+	 * @param min
+	 * @param max
+	 * @return random int in [min..max]
+	 */
+	int RandomInt(int min, int max);
+
+protected:
+
+	// State of the generator
+	unsigned long long m_s[4];
+
+};
+
+}
+
+#endif
+
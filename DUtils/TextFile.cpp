@@ -0,0 +1,564 @@
+/*
+ * File: TextFile.cpp
+ * Project: DUtils library
+ * Author: DBow contributors
+ * Date: October 2026
+ * Description: reads and writes text files of numbers. Files are read at
+ *    once and written in large blocks, and numbers are converted without
+ *    streams.
+ */
+
+#include "FileModes.h"
+#include "TextFile.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+
+using namespace DUtils;
+using namespace std;
+
+// Size of the text buffered before writing it
+#define TEXT_FILE_BLOCK (1 << 20)
+
+// Real numbers with more chars are not converted
+#define TEXT_FILE_MAX_NUMBER 512
+
+// Powers of 10 that are exact in double, for the numbers whose mantissa
+// is exact too (the numbers written with up to 15 digits)
+static const double Pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+	1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+	1e20, 1e21, 1e22 };
+
+static inline bool isSpaceChar(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' ||
+		c == '\v' || c == '\f';
+}
+
+static inline bool isDigitChar(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// ---------------------------------------------------------------------------
+
+TextFile::TextFile(void): m_mode(READ), m_data(1, '\0'), m_size(0),
+	m_pos(0), m_fail(false), m_precision(6)
+{
+}
+
+TextFile::~TextFile(void)
+{
+	try{
+		Close();
+	}catch(...){
+	}
+}
+
+TextFile::TextFile(const char *filename, const FILE_MODES mode)
+{
+	Init(filename, mode);
+}
+
+TextFile::TextFile(const string &filename, const FILE_MODES mode)
+{
+	Init(filename.c_str(), mode);
+}
+
+void TextFile::Init(const char *filename, const FILE_MODES mode)
+{
+	m_mode = READ;
+	m_data.assign(1, '\0');
+	m_size = m_pos = 0;
+	m_fail = false;
+	m_precision = 6;
+
+	if(mode & READ){
+		OpenForReading(filename);
+	}else if((mode & WRITE) && (mode & APPEND)){
+		OpenForAppending(filename);
+	}else if(mode & WRITE){
+		OpenForWriting(filename);
+	}else{
+		throw DException("Wrong access mode");
+	}
+}
+
+void TextFile::OpenForReading(const char *filename)
+{
+	Close();
+
+	fstream f(filename, ios::in | ios::binary);
+	if(!f.is_open()){
+		throw DException(string("Cannot open ") + filename + " for reading");
+	}
+
+	f.seekg(0, ios::end);
+	m_size = (unsigned int)f.tellg();
+	f.seekg(0, ios::beg);
+
+	// the content ends with a 0 so that it can be given to the C library
+	m_data.resize(m_size + 1);
+	if(m_size > 0) f.read(&m_data[0], m_size);
+	m_data[m_size] = '\0';
+
+	if((unsigned int)f.gcount() != m_size){
+		Close();
+		throw DException(string("Cannot read ") + filename);
+	}
+
+	m_mode = READ;
+}
+
+void TextFile::OpenForWriting(const char *filename)
+{
+	Close();
+
+	m_f.open(filename, ios::out | ios::binary);
+	if(!m_f.is_open()){
+		throw DException(string("Cannot open ") + filename + " for writing");
+	}else{
+		m_mode = WRITE;
+		m_data.clear();
+		m_data.reserve(TEXT_FILE_BLOCK + TEXT_FILE_MAX_NUMBER);
+	}
+}
+
+void TextFile::OpenForAppending(const char *filename)
+{
+	Close();
+
+	m_f.open(filename, ios::out | ios::app | ios::binary);
+	if(!m_f.is_open()){
+		throw DException(string("Cannot open ") + filename + " for writing at the end");
+	}else{
+		m_mode = DUtils::FILE_MODES(WRITE | APPEND);
+		m_data.clear();
+		m_data.reserve(TEXT_FILE_BLOCK + TEXT_FILE_MAX_NUMBER);
+	}
+}
+
+void TextFile::Close()
+{
+	bool written = true;
+
+	if(m_f.is_open()){
+		if(!m_data.empty()) m_f.write(&m_data[0], m_data.size());
+		written = !m_f.fail();
+		m_f.close();
+	}
+
+	vector<char>(1, '\0').swap(m_data);
+	m_size = m_pos = 0;
+	m_fail = false;
+	m_mode = READ;
+
+	if(!written) throw DException("Cannot write the file");
+}
+
+void TextFile::flush()
+{
+	if(!m_data.empty()){
+		m_f.write(&m_data[0], m_data.size());
+		m_data.clear();
+
+		if(m_f.fail()) throw DException("Cannot write the file");
+	}
+}
+
+// ---------------------------------------------------------------------------
+
+void TextFile::Seek(unsigned int pos)
+{
+	if(!(m_mode & READ)) throw DException("Wrong access mode");
+
+	m_pos = (pos < m_size ? pos : m_size);
+	m_fail = false;
+}
+
+bool TextFile::FindLines(int n, vector<unsigned int> &lines) const
+{
+	const char *data = Data();
+	const char *end = data + m_size;
+
+	lines.resize(n + 1);
+
+	// rest of the current line
+	const char *p = (const char *)memchr(data + m_pos, '\n', m_size - m_pos);
+	if(p == NULL) return false;
+	p++;
+
+	for(int i = 0; i < n; i++){
+		if(p >= end) return false;
+		lines[i] = p - data;
+
+		const char *q = (const char *)memchr(p, '\n', end - p);
+		p = (q ? q + 1 : end);
+	}
+	lines[n] = p - data;
+
+	return true;
+}
+
+void TextFile::GetLine(string &line)
+{
+	if(!(m_mode & READ)) throw DException("Wrong access mode");
+
+	if(m_fail || m_pos >= m_size){
+		m_fail = true;
+		return;
+	}
+
+	const char *p = Data() + m_pos;
+	const char *q = (const char *)memchr(p, '\n', m_size - m_pos);
+	if(q == NULL) q = Data() + m_size;
+
+	line.assign(p, q);
+
+	m_pos = q - Data();
+	if(m_pos < m_size) m_pos++; // end of line
+}
+
+// ---------------------------------------------------------------------------
+
+TextFile& TextFile::operator>>(int &v)
+{
+	if(!(m_mode & READ)) throw DException("Wrong access mode");
+
+	if(!m_fail){
+		const char *p = Parse(Data() + m_pos, Data() + m_size, v);
+		if(p) m_pos = p - Data();
+		else m_fail = true;
+	}
+	if(m_fail) v = 0;
+	return *this;
+}
+
+TextFile& TextFile::operator>>(float &v)
+{
+	if(!(m_mode & READ)) throw DException("Wrong access mode");
+
+	if(!m_fail){
+		const char *p = Parse(Data() + m_pos, Data() + m_size, v);
+		if(p) m_pos = p - Data();
+		else m_fail = true;
+	}
+	if(m_fail) v = 0;
+	return *this;
+}
+
+TextFile& TextFile::operator>>(double &v)
+{
+	if(!(m_mode & READ)) throw DException("Wrong access mode");
+
+	if(!m_fail){
+		const char *p = Parse(Data() + m_pos, Data() + m_size, v);
+		if(p) m_pos = p - Data();
+		else m_fail = true;
+	}
+	if(m_fail) v = 0;
+	return *this;
+}
+
+TextFile& TextFile::operator>>(string &v)
+{
+	if(!(m_mode & READ)) throw DException("Wrong access mode");
+
+	if(!m_fail){
+		const char *p = Data() + m_pos;
+		const char *end = Data() + m_size;
+
+		while(p < end && isSpaceChar(*p)) p++;
+
+		const char *first = p;
+		while(p < end && !isSpaceChar(*p)) p++;
+
+		if(p > first){
+			v.assign(first, p);
+			m_pos = p - Data();
+		}else
+			m_fail = true;
+	}
+	return *this;
+}
+
+// ---------------------------------------------------------------------------
+
+TextFile& TextFile::operator<<(char v)
+{
+	if(!(m_mode & WRITE)) throw DException("Wrong access mode");
+
+	m_data.push_back(v);
+	if(m_data.size() >= TEXT_FILE_BLOCK) flush();
+	return *this;
+}
+
+TextFile& TextFile::operator<<(const char *v)
+{
+	if(!(m_mode & WRITE)) throw DException("Wrong access mode");
+
+	m_data.insert(m_data.end(), v, v + strlen(v));
+	if(m_data.size() >= TEXT_FILE_BLOCK) flush();
+	return *this;
+}
+
+TextFile& TextFile::operator<<(const string &v)
+{
+	if(!(m_mode & WRITE)) throw DException("Wrong access mode");
+
+	m_data.insert(m_data.end(), v.begin(), v.end());
+	if(m_data.size() >= TEXT_FILE_BLOCK) flush();
+	return *this;
+}
+
+TextFile& TextFile::operator<<(int v)
+{
+	if(v < 0){
+		*this << '-';
+		return *this << (0u - (unsigned int)v);
+	}else
+		return *this << (unsigned int)v;
+}
+
+TextFile& TextFile::operator<<(unsigned int v)
+{
+	if(!(m_mode & WRITE)) throw DException("Wrong access mode");
+
+	char buf[16];
+	char *p = buf + sizeof(buf);
+	do{
+		*(--p) = (char)('0' + v % 10);
+		v /= 10;
+	}while(v > 0);
+
+	m_data.insert(m_data.end(), p, buf + sizeof(buf));
+	if(m_data.size() >= TEXT_FILE_BLOCK) flush();
+	return *this;
+}
+
+TextFile& TextFile::operator<<(float v)
+{
+	// floats are printed as doubles by fstream too
+	return *this << (double)v;
+}
+
+TextFile& TextFile::operator<<(double v)
+{
+	if(!(m_mode & WRITE)) throw DException("Wrong access mode");
+
+	// %g is the default format of fstream
+	char buf[64];
+	int n = sprintf(buf, "%.*g", m_precision, v);
+
+	m_data.insert(m_data.end(), buf, buf + n);
+	if(m_data.size() >= TEXT_FILE_BLOCK) flush();
+	return *this;
+}
+
+// ---------------------------------------------------------------------------
+
+const char* TextFile::Parse(const char *p, const char *end, int &v)
+{
+	while(p < end && isSpaceChar(*p)) p++;
+
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		p++;
+	}
+
+	if(p >= end || !isDigitChar(*p)) return NULL;
+
+	long long n = 0;
+	for(; p < end && isDigitChar(*p); p++){
+		n = n * 10 + (*p - '0');
+		if(n > 2147483648LL) return NULL;
+	}
+
+	if(negative) n = -n;
+	if(n > 2147483647LL) return NULL;
+
+	v = (int)n;
+	return p;
+}
+
+const char* TextFile::Parse(const char *p, const char *end, double &v)
+{
+	bool negative, exact;
+	unsigned long long mantissa;
+	int exponent;
+	const char *first;
+
+	const char *last = scanReal(p, end, negative, mantissa, exponent,
+		exact, first);
+	if(last == NULL) return NULL;
+
+	if(exact && mantissa <= (1ULL << 53) &&
+		exponent >= -22 && exponent <= 22)
+	{
+		// both numbers are exact, so that the result is rounded only once
+		double r = (double)mantissa;
+		if(exponent < 0) r /= Pow10[-exponent];
+		else r *= Pow10[exponent];
+
+		v = (negative ? -r : r);
+	}else if(!convertReal(first, last, v)){
+		return NULL;
+	}
+
+	return last;
+}
+
+const char* TextFile::Parse(const char *p, const char *end, float &v)
+{
+	bool negative, exact;
+	unsigned long long mantissa;
+	int exponent;
+	const char *first;
+
+	const char *last = scanReal(p, end, negative, mantissa, exponent,
+		exact, first);
+	if(last == NULL) return NULL;
+
+	bool done = false;
+
+	if(exact && mantissa <= (1ULL << 53) &&
+		exponent >= -22 && exponent <= 22)
+	{
+		double r = (double)mantissa;
+		if(exponent < 0) r /= Pow10[-exponent];
+		else r *= Pow10[exponent];
+
+		// the double is the nearest one to the number, so that rounding it
+		// again gives the nearest float, unless it is halfway between two
+		// floats or out of their normal range
+		unsigned long long bits;
+		memcpy(&bits, &r, sizeof(bits));
+
+		if(r == 0 || (r >= FLT_MIN && r <= FLT_MAX && 
+			(bits & 0x1fffffffULL) != 0x10000000ULL))
+		{
+			v = (float)(negative ? -r : r);
+			done = true;
+		}
+	}
+	
+	if(!done && !convertReal(first, last, v)){
+		return NULL;
+	}
+
+	return last;
+}
+
+bool TextFile::isBlank(const char *p, const char *end)
+{
+	for(; p < end; p++) if(!isSpaceChar(*p)) return false;
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+
+const char* TextFile::scanReal(const char *p, const char *end,
+	bool &negative, unsigned long long &mantissa, int &exponent,
+	bool &exact, const char *&first)
+{
+	while(p < end && isSpaceChar(*p)) p++;
+
+	first = p;
+	negative = false;
+	mantissa = 0;
+	exponent = 0;
+	exact = true;
+
+	if(p < end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		p++;
+	}
+
+	// up to 19 significant digits fit in the mantissa
+	int ndigits = 0;
+	bool any = false;
+
+	for(; p < end && isDigitChar(*p); p++){
+		any = true;
+		if(ndigits < 19){
+			mantissa = mantissa * 10 + (*p - '0');
+			if(mantissa > 0) ndigits++;
+		}else{
+			exponent++;
+			if(*p != '0') exact = false;
+		}
+	}
+
+	if(p < end && *p == '.'){
+		for(p++; p < end && isDigitChar(*p); p++){
+			any = true;
+			if(ndigits < 19){
+				mantissa = mantissa * 10 + (*p - '0');
+				if(mantissa > 0) ndigits++;
+				exponent--;
+			}else if(*p != '0'){
+				exact = false;
+			}
+		}
+	}
+
+	if(!any) return NULL;
+
+	if(p < end && (*p == 'e' || *p == 'E')){
+		const char *q = p + 1;
+		bool eneg = false;
+
+		if(q < end && (*q == '-' || *q == '+')){
+			eneg = (*q == '-');
+			q++;
+		}
+
+		if(q < end && isDigitChar(*q)){
+			int e = 0;
+			for(; q < end && isDigitChar(*q); q++){
+				if(e < 100000) e = e * 10 + (*q - '0');
+			}
+			exponent += (eneg ? -e : e);
+			p = q;
+		}
+	}
+
+	if(p - first >= TEXT_FILE_MAX_NUMBER) return NULL;
+
+	return p;
+}
+
+bool TextFile::convertReal(const char *first, const char *last, double &v)
+{
+	char buf[TEXT_FILE_MAX_NUMBER];
+	const int n = last - first;
+	memcpy(buf, first, n);
+	buf[n] = '\0';
+
+	char *q;
+	v = strtod(buf, &q);
+	return q == buf + n;
+}
+
+bool TextFile::convertReal(const char *first, const char *last, float &v)
+{
+	char buf[TEXT_FILE_MAX_NUMBER];
+	const int n = last - first;
+	memcpy(buf, first, n);
+	buf[n] = '\0';
+
+	char *q;
+#ifdef WIN32
+	v = (float)strtod(buf, &q);
+#else
+	v = strtof(buf, &q);
+#endif
+	return q == buf + n;
+}
+
@@ -0,0 +1,232 @@
+/*
+ * File: TextFile.h
+ * Project: DUtils library
+ * Author: DBow contributors
+ * Date: October 2026
+ * Description: reads and writes text files of numbers. Files are read at
+ *    once and written in large blocks, and numbers are converted without
+ *    streams.
+ *
+ * Note: numbers are written as fstream does, so that files are the same
+ *    (real numbers with 6 significant digits by default). Files are
+ *    opened in binary mode: lines always end with \n when written, and \r
+ *    is taken as a blank when read.
+ */
+
+#pragma once
+#ifndef __D_TEXT_FILE__
+#define __D_TEXT_FILE__
+
+#include "DException.h"
+#include "FileModes.h"
+#include <vector>
+#include <string>
+#include <fstream>
+using namespace std;
+
+namespace DUtils {
+
+class TextFile
+{
+public:
+
+	/* Creates a text file with no file
+	 */
+	TextFile(void);
+
+	/* Closes any opened file
+	*/
+	~TextFile(void);
+
+	/* Creates a text file by opening a file
+	 * @param filename
+	 * @param mode: READ, WRITE or WRITE | APPEND
+	 * @throws DException if cannot open the file
+	 */
+	TextFile(const char *filename, const FILE_MODES mode);
+	TextFile(const string &filename, const FILE_MODES mode);
+
+	/* Opens a file for reading and reads all its content. It closes any
+	 * other opened file
+	 * @param filename
+	 * @throws DException if cannot open the file
+	 */
+	void OpenForReading(const char *filename);
+	inline void OpenForReading(const string &filename)
+	{
+		OpenForReading(filename.c_str());
+	}
+
+	/* Opens a file for writing. It closes any other opened file
+	 * @param filename
+	 * @throws DException if cannot create the file
+	 */
+	void OpenForWriting(const char *filename);
+	inline void OpenForWriting(const string &filename)
+	{
+		OpenForWriting(filename.c_str());
+	}
+
+	/* Opens a file for writing at the end. It closes any other opened file
+	 * @param filename
+	 * @throws DException if cannot open the file
+	 */
+	void OpenForAppending(const char *filename);
+	inline void OpenForAppending(const string &filename)
+	{
+		OpenForAppending(filename.c_str());
+	}
+
+	/* Closes any opened file, writing the buffered text. It is not
+	 * necessary to call this function explicitly
+	 * @throws DException if the text cannot be written
+	 */
+	void Close();
+
+	/* Sets the number of significant digits of the real numbers written,
+	 * as fstream::precision
+	 * @param digits
+	 */
+	inline void SetPrecision(int digits) { m_precision = digits; }
+
+	/* Says whether the last read failed because the end of the file was
+	 * reached or the text was not the expected one. Once a read fails, the
+	 * next ones fail too
+	 * @return true iif a read failed
+	 */
+	inline bool Fail() const { return m_fail; }
+
+	/* Returns the position of the next char to read
+	 * @return number of chars read so far
+	 */
+	inline unsigned int Position() const { return m_pos; }
+
+	/* Moves to the given position and clears the failure state
+	 * @param pos number of chars from the beginning of the file
+	 */
+	void Seek(unsigned int pos);
+
+	/* Returns the next char without reading it
+	 * @return next char, or -1 if the end was reached
+	 */
+	inline int Peek() const {
+		return (m_pos < m_size ? (int)(unsigned char)m_data[m_pos] : -1);
+	}
+
+	/* Returns the content of the file in reading mode. It ends with a 0
+	 * @return pointer to the first char of the file
+	 */
+	inline const char* Data() const { return &m_data[0]; }
+
+	/* Finds the beginning of some lines after the current one, so that
+	 * they can be parsed apart (e.g. by several threads). The position is
+	 * not changed
+	 * @param n number of lines to find
+	 * @param lines (out) lines[i] is the position of the i-th line, and
+	 *   lines[n], the position after the last one
+	 * @return false if the file has fewer lines
+	 */
+	bool FindLines(int n, vector<unsigned int> &lines) const;
+
+	/* Reads the rest of the current line
+	 * @param line (out) chars up to the end of the line, which is skipped
+	 */
+	void GetLine(string &line);
+
+	/* Reads a number or a word after some blanks. If the read fails, a
+	 * number is set to 0, as fstream does
+	 * @throws DException if wrong access mode
+	 */
+	TextFile& operator>>(int &v);
+	TextFile& operator>>(float &v);
+	TextFile& operator>>(double &v);
+	TextFile& operator>>(string &v);
+
+	/* Writes a number or some text
+	 * @throws DException if wrong access mode
+	 */
+	TextFile& operator<<(char v);
+	TextFile& operator<<(const char *v);
+	TextFile& operator<<(const string &v);
+	TextFile& operator<<(int v);
+	TextFile& operator<<(unsigned int v);
+	TextFile& operator<<(float v);
+	TextFile& operator<<(double v);
+
+	/* Parses a number after some blanks in a piece of text
+	 * @param p first char to parse
+	 * @param end end of the text
+	 * @param v (out) number
+	 * @return pointer to the char after the number, or NULL if there is no
+	 *   number before end
+	 */
+	static const char* Parse(const char *p, const char *end, int &v);
+	static const char* Parse(const char *p, const char *end, float &v);
+	static const char* Parse(const char *p, const char *end, double &v);
+
+	/* Says whether a piece of text is made of blanks only
+	 * @param p first char
+	 * @param end end of the text
+	 * @return true iif there are only blanks in [p, end)
+	 */
+	static bool isBlank(const char *p, const char *end);
+
+protected:
+
+	/**
+	 * Initializes the object by opening a file
+	 * @param filename file to open
+	 * @param mode opening mode
+	 * @throws DException if cannot open the file
+	 */
+	void Init(const char *filename, const FILE_MODES mode);
+
+	/**
+	 * Writes the buffered text to the file
+	 * @throws DException if the text cannot be written
+	 */
+	void flush();
+
+	/**
+	 * Finds the chars of a real number after some blanks
+	 * @param p first char
+	 * @param end end of the text
+	 * @param negative (out) the number has a minus sign
+	 * @param mantissa (out) significant digits, as an integer
+	 * @param exponent (out) power of 10 mantissa must be multiplied by
+	 * @param exact (out) false if some digits did not fit in mantissa
+	 * @param first (out) first char of the number
+	 * @return pointer to the char after the number, or NULL if there is no
+	 *   number
+	 */
+	static const char* scanReal(const char *p, const char *end,
+		bool &negative, unsigned long long &mantissa, int &exponent, 
+		bool &exact, const char *&first);
+
+	/**
+	 * Converts a real number with the C library
+	 * @param first first char of the number
+	 * @param last char after the number
+	 * @param v (out) number
+	 * @return false if the text is not a number
+	 */
+	static bool convertReal(const char *first, const char *last, double &v);
+	static bool convertReal(const char *first, const char *last, float &v);
+
+protected:
+	FILE_MODES m_mode;		// opening mode
+	fstream m_f;			// fstream, only used in writing mode
+
+	vector<char> m_data;	// content of the file in reading mode, or
+							// text to write in writing mode
+	unsigned int m_size;	// number of chars of the file in reading mode
+	unsigned int m_pos;		// position of the next char to read
+	bool m_fail;			// a read failed
+	int m_precision;		// significant digits of the real numbers written
+
+};
+
+}
+
+#endif
+
@@ -16,6 +16,9 @@ using namespace std;
 
 void loadFeatures(vector<vector<float> > &features);
 void testVocCreation(const vector<vector<float> > &features);
+void testAcceleratedKMeans(const vector<vector<float> > &features);
+void testPruning(const vector<vector<float> > &features);
+void testLogReplay(const vector<vector<float> > &features);
 void testDatabase(const vector<vector<float> > &features);
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - 
@@ -43,10 +46,22 @@ int main()
 
 	wait();
 
+	testAcceleratedKMeans(features);
+
+	wait();
+
 	testDatabase(features);
 
 	wait();
 
+	testPruning(features);
+
+	wait();
+
+	testLogReplay(features);
+
+	wait();
+
 	return 0;
 }
 
@@ -109,6 +124,32 @@ void testVocCreation(const vector<vector<float> > &features)
 
 }
 
+void testAcceleratedKMeans(const vector<vector<float> > &features)
+{
+	// accelerated kmeans only skips distance computations, so it must
+	// create the same tree as plain kmeans with the same random seed
+	const int k = 9;
+	const int L = 3;
+
+	HVocParams params(k, L, (extended_surf ? 128 : 64));
+	params.RandomSeed = 1;
+
+	params.AcceleratedKMeans = false;
+	HVocabulary plain(params);
+
+	params.AcceleratedKMeans = true;
+	HVocabulary accelerated(params);
+
+	cout << "Creating the vocabulary with plain and accelerated kmeans..." << endl;
+	plain.Create(features);
+	accelerated.Create(features);
+
+	if(plain.Hash() == accelerated.Hash())
+		cout << "The trees are the same" << endl;
+	else
+		cout << "ERROR: the trees are different" << endl;
+}
+
 void testDatabase(const vector<vector<float> > &features)
 {
 	cout << "Creating a small database..." << endl;
@@ -140,3 +181,131 @@ void testDatabase(const vector<vector<float> > &features)
 	}
 
 }
+
+void testPruning(const vector<vector<float> > &features)
+{
+	// queries for a few results skip the entries that cannot reach the top,
+	// so they must give the same results as queries for all the entries
+	const int k = 9;
+	const int L = 3;
+	const int D = (extended_surf ? 128 : 64);
+
+	// number of features of each entry and results of each query
+	const int nfeatures = 20;
+	const int nresults = 5;
+
+	const VocParams::ScoringType scorings[] = { VocParams::L1_NORM, 
+		VocParams::L2_NORM, VocParams::CHI_SQUARE, VocParams::BHATTACHARYYA, 
+		VocParams::DOT_PRODUCT };
+	const char *names[] = { "L1", "L2", "chi square", "Bhattacharyya", 
+		"dot product" };
+
+	cout << "Comparing pruned and exhaustive queries..." << endl;
+
+	for(int s = 0; s < 5; s++){
+		HVocParams params(k, L, D, VocParams::TF_IDF, scorings[s]);
+		params.RandomSeed = 1;
+
+		HVocabulary voc(params);
+		voc.Create(features);
+
+		// each group of features of the images is an entry
+		Database db(voc);
+		vector<DescriptorView> entries;
+
+		for(int i = 0; i < Nimages; i++){
+			const int n = features[i].size() / D;
+			for(int j = 0; j + nfeatures <= n; j += nfeatures){
+				entries.push_back(DescriptorView(&features[i][j * D], nfeatures, D));
+				db.AddEntry(entries.back());
+			}
+		}
+
+		bool same = true;
+		QueryResults pruned, all;
+
+		for(unsigned int i = 0; i < entries.size(); i++){
+			db.Query(pruned, entries[i], nresults);
+			db.Query(all, entries[i], 0);
+
+			if(all.size() > (unsigned int)nresults) all.resize(nresults);
+
+			// entries with the same score may come in any order, so that
+			// only the scores are compared
+			same = same && (pruned.size() == all.size());
+			for(unsigned int j = 0; same && j < all.size(); j++){
+				same = fabs(pruned[j].Score - all[j].Score) < 1e-6;
+			}
+		}
+
+		cout << names[s] << " scoring, " << entries.size() << " entries: " 
+			<< (same ? "same results" : "ERROR: different results") << endl;
+	}
+}
+
+void testLogReplay(const vector<vector<float> > &features)
+{
+	// a database recovered from its last snapshot and its log must give the
+	// same results as the original one
+	const int k = 9;
+	const int L = 3;
+	const int D = (extended_surf ? 128 : 64);
+	const int nfeatures = 20;
+
+	cout << "Comparing a database with its snapshot and log..." << endl;
+
+	HVocParams params(k, L, D);
+	params.RandomSeed = 1;
+
+	HVocabulary voc(params);
+	voc.Create(features);
+
+	vector<DescriptorView> entries;
+	for(int i = 0; i < Nimages; i++){
+		const int n = features[i].size() / D;
+		for(int j = 0; j + nfeatures <= n; j += nfeatures){
+			entries.push_back(DescriptorView(&features[i][j * D], nfeatures, D));
+		}
+	}
+
+	// with online weighting, the weights of the snapshot must be kept too
+	for(int online = 0; online < 2; online++){
+
+		// half of the entries are in the snapshot and the rest, in the log
+		Database db(voc);
+		if(online) db.SetOnlineWeighting(true, 0.5);
+		db.OpenLog("demo_log.bin");
+
+		for(unsigned int i = 0; i < entries.size(); i++){
+			if(i == entries.size() / 2) db.Compact("demo_snapshot.bin");
+			db.AddEntry(entries[i]);
+		}
+		db.Checkpoint();
+
+		Database recovered("demo_snapshot.bin");
+		recovered.ReplayLog("demo_log.bin");
+
+		bool same = (recovered.NumberOfEntries() == db.NumberOfEntries());
+		QueryResults a, b;
+
+		for(unsigned int i = 0; same && i < entries.size(); i++){
+			db.Query(a, entries[i], 5);
+			recovered.Query(b, entries[i], 5);
+
+			same = (a.size() == b.size());
+			for(unsigned int j = 0; same && j < a.size(); j++){
+				same = (a[j].Id == b[j].Id && 
+					fabs(a[j].Score - b[j].Score) < 1e-6);
+			}
+		}
+
+		cout << (online ? "Online" : "Vocabulary") << " weights, " 
+			<< db.NumberOfEntries() << " entries, " << entries.size() / 2 
+			<< " in the snapshot: " 
+			<< (same ? "same results" : "ERROR: different results") << endl;
+
+		db.CloseLog();
+		remove("demo_log.bin");
+		remove("demo_snapshot.bin");
+	}
+}
@@ -0,0 +1,215 @@
+/**
+ * File: LoadGenerator.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: measures the latency and throughput of a query server with
+ *   several clients querying at the same time
+ *
+ * Usage: LoadGenerator <vocabulary file> <socket file | tcp port>
+ *          [clients] [queries per client] [features per query]
+ *          [max results] [desc | bow]
+ *
+ * Queries are made of random descriptors. They are sent as descriptors
+ * (default) or as bow vectors computed with the given vocabulary, which
+ * must be the one of the served database.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <pthread.h>
+
+// DBow
+#include "DUtils.h"
+#include "DBow.h"
+
+using namespace DBow;
+using namespace DUtils;
+using namespace std;
+
+// number of different queries to send
+const int Npool = 100;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Work of a client thread
+struct ClientJob
+{
+	string address;
+	int nqueries;
+	int max_results;
+	bool send_bow;
+	int first; // first query of the pool to send
+	int desc_length;
+
+	const vector<vector<float> > *descriptors;
+	const vector<BowVector> *vectors;
+
+	vector<double> latencies; // seconds
+	string error;
+};
+
+bool isPort(const string &address);
+void* runClient(void *arg);
+double percentile(const vector<double> &sorted, double p);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main(int argc, char *argv[])
+{
+	if(argc < 3){
+		cout << "Usage: " << argv[0] << " <vocabulary file> "
+			"<socket file | tcp port> [clients] [queries per client] "
+			"[features per query] [max results] [desc | bow]" << endl;
+		return 1;
+	}
+
+	const string address = argv[2];
+	const int nclients = (argc > 3 ? atoi(argv[3]) : 8);
+	const int nqueries = (argc > 4 ? atoi(argv[4]) : 1000);
+	const int nfeatures = (argc > 5 ? atoi(argv[5]) : 300);
+	const int max_results = (argc > 6 ? atoi(argv[6]) : 10);
+	const bool send_bow = (argc > 7 && string(argv[7]) == "bow");
+
+	vector<vector<float> > descriptors(Npool);
+	vector<BowVector> vectors;
+	int D;
+
+	try{
+		HVocabulary voc(argv[1]);
+		D = voc.DescriptorLength();
+
+		Random::SeedRand(0);
+		for(int i = 0; i < Npool; i++){
+			descriptors[i].resize(nfeatures * D);
+			for(unsigned int j = 0; j < descriptors[i].size(); j++)
+				descriptors[i][j] = Random::RandomValue<float>(0, 1);
+		}
+
+		if(send_bow){
+			vectors.resize(Npool);
+			for(int i = 0; i < Npool; i++) voc.Transform(descriptors[i], vectors[i]);
+		}
+	}catch(DUtils::DException &ex){
+		cout << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	vector<ClientJob> jobs(nclients);
+	vector<pthread_t> threads(nclients);
+
+	for(int i = 0; i < nclients; i++){
+		jobs[i].address = address;
+		jobs[i].nqueries = nqueries;
+		jobs[i].max_results = max_results;
+		jobs[i].send_bow = send_bow;
+		jobs[i].first = (i * Npool) / nclients;
+		jobs[i].desc_length = D;
+		jobs[i].descriptors = &descriptors;
+		jobs[i].vectors = &vectors;
+	}
+
+	cout << nclients << " clients sending " << nqueries << " queries each ("
+		<< (send_bow ? "bow vectors" : "descriptors") << ", "
+		<< nfeatures << " features)..." << endl;
+
+	Timestamp start;
+	start.setToCurrentTime();
+
+	for(int i = 0; i < nclients; i++)
+		pthread_create(&threads[i], NULL, runClient, &jobs[i]);
+	for(int i = 0; i < nclients; i++)
+		pthread_join(threads[i], NULL);
+
+	Timestamp end;
+	end.setToCurrentTime();
+	const double elapsed = end - start;
+
+	vector<double> latencies;
+	for(int i = 0; i < nclients; i++){
+		if(!jobs[i].error.empty())
+			cout << "Client " << i << ": " << jobs[i].error << endl;
+		latencies.insert(latencies.end(), jobs[i].latencies.begin(),
+			jobs[i].latencies.end());
+	}
+
+	if(latencies.empty()){
+		cout << "No query was answered" << endl;
+		return 1;
+	}
+
+	sort(latencies.begin(), latencies.end());
+
+	double mean = 0;
+	for(unsigned int i = 0; i < latencies.size(); i++) mean += latencies[i];
+	mean /= latencies.size();
+
+	cout << fixed << setprecision(3);
+	cout << "Queries: " << latencies.size() << " in " << elapsed << " s" << endl;
+	cout << "Throughput: " << latencies.size() / elapsed << " queries/s" << endl;
+	cout << "Latency (ms): mean " << mean * 1e3
+		<< ", p50 " << percentile(latencies, 0.5) * 1e3
+		<< ", p90 " << percentile(latencies, 0.9) * 1e3
+		<< ", p99 " << percentile(latencies, 0.99) * 1e3
+		<< ", max " << latencies.back() * 1e3 << endl;
+
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool isPort(const string &address)
+{
+	return !address.empty() &&
+		address.find_first_not_of("0123456789") == string::npos;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void* runClient(void *arg)
+{
+	ClientJob &job = *(ClientJob*)arg;
+	job.latencies.reserve(job.nqueries);
+
+	try{
+		QueryClient client;
+		if(isPort(job.address))
+			client.ConnectTcp(atoi(job.address.c_str()));
+		else
+			client.ConnectUnix(job.address.c_str());
+
+		QueryResults ret;
+		Timestamp t1, t2;
+
+		for(int i = 0; i < job.nqueries; i++){
+			const int q = (job.first + i) % Npool;
+
+			t1.setToCurrentTime();
+			if(job.send_bow){
+				client.Query(ret, (*job.vectors)[q], job.max_results);
+			}else{
+				client.Query(ret, DescriptorView((*job.descriptors)[q],
+					job.desc_length), job.max_results);
+			}
+			t2.setToCurrentTime();
+
+			job.latencies.push_back(t2 - t1);
+		}
+	}catch(DUtils::DException &ex){
+		job.error = ex.what();
+	}
+
+	return NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+double percentile(const vector<double> &sorted, double p)
+{
+	int i = (int)(p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
@@ -0,0 +1,102 @@
+/**
+ * File: Server.cpp
+ * Date: October 2026
+ * Author: DBow contributors
+ * Description: serves queries to a database file through a local socket
+ *
+ * Usage: Server <database file> <socket file | tcp port>
+ *          [max batch] [max wait (us)]
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <csignal>
+#include <pthread.h>
+
+// DBow
+#include "DUtils.h"
+#include "DBow.h"
+
+using namespace DBow;
+using namespace std;
+
+/**
+ * Says whether a socket address is a tcp port
+ * @param address
+ * @return true iif address is a number
+ */
+bool isPort(const string &address)
+{
+	return !address.empty() &&
+		address.find_first_not_of("0123456789") == string::npos;
+}
+
+/**
+ * Waits for SIGINT or SIGTERM and stops the server
+ * @param arg server
+ */
+void* waitForSignal(void *arg)
+{
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+
+	int sig;
+	sigwait(&signals, &sig);
+
+	((QueryServer*)arg)->Stop();
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc < 3){
+		cout << "Usage: " << argv[0] << " <database file> "
+			"<socket file | tcp port> [max batch] [max wait (us)]" << endl;
+		return 1;
+	}
+
+	const string address = argv[2];
+	const int max_batch = (argc > 3 ? atoi(argv[3]) : 32);
+	const int max_wait = (argc > 4 ? atoi(argv[4]) : 200);
+
+	// signals are handled by a thread only
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	try{
+		cout << "Loading database..." << endl;
+		Database db(argv[1]);
+		cout << "... done! " << db.NumberOfEntries() << " entries" << endl;
+
+		QueryServer server(db, max_batch, max_wait);
+
+		if(isPort(address))
+			server.ListenTcp(atoi(address.c_str()));
+		else
+			server.ListenUnix(address.c_str());
+
+		pthread_t thread;
+		pthread_create(&thread, NULL, waitForSignal, &server);
+
+		cout << "Listening on " << address << endl;
+		server.Run();
+
+		pthread_join(thread, NULL);
+
+		cout << "Stopped. " << server.NumberOfRequests() << " requests in "
+			<< server.NumberOfBatches() << " batches" << endl;
+
+	}catch(DUtils::DException &ex){
+		cout << "Error: " << ex.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
+